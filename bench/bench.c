@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "../include/midi_parser.h"
+#include "../include/json_generator.h"
+
+// times parsing, JSON rendering and freeing of each file on its own and
+// prints one JSON object per file. allocations are counted by linking
+// with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free so
+// only calls made by the parser and writer show up, not libc's own
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void  __real_free(void *p);
+
+static size_t nallocs;
+static size_t nfrees;
+
+void *__wrap_malloc(size_t n)
+{
+    __atomic_fetch_add(&nallocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_fetch_add(&nallocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n)
+{
+    __atomic_fetch_add(&nallocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, n);
+}
+
+void __wrap_free(void *p)
+{
+    if (p) __atomic_fetch_add(&nfrees, 1, __ATOMIC_RELAXED);
+    __real_free(p);
+}
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    double best;
+    double total;
+    size_t allocs;
+    size_t frees;
+} Phase;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static void phase_begin(double *t0, size_t *a0, size_t *f0)
+{
+    *a0 = __atomic_load_n(&nallocs, __ATOMIC_RELAXED);
+    *f0 = __atomic_load_n(&nfrees, __ATOMIC_RELAXED);
+    *t0 = now();
+}
+
+static void phase_end(Phase *ph, double t0, size_t a0, size_t f0)
+{
+    double s = now() - t0;
+    if (ph->total == 0 || s < ph->best) ph->best = s;
+    ph->total += s;
+    ph->allocs = __atomic_load_n(&nallocs, __ATOMIC_RELAXED) - a0;
+    ph->frees  = __atomic_load_n(&nfrees, __ATOMIC_RELAXED) - f0;
+}
+
+static double rate(double amount, double s)
+{
+    return s > 0 ? amount / s : 0;
+}
+
+static void print_phase(const char *name, const Phase *ph, unsigned repeat)
+{
+    printf("\"%s\":{\"best_s\":%.6f,\"mean_s\":%.6f,\"allocs\":%zu,\"frees\":%zu}",
+           name, ph->best, ph->total / repeat, ph->allocs, ph->frees);
+}
+
+// ---------------------------------------------------
+
+static int bench_file(const char *path, unsigned repeat, const MIDI_parse_opts *popts,
+                      const JSON_writer_opts *jopts, FILE *sink)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "Error: Could not open '%s'\n", path);
+        return 0;
+    }
+
+    Phase parse = {0}, json = {0}, release = {0};
+    size_t tracks = 0, events = 0, arena_allocs = 0, arena_blocks = 0;
+    double t0;
+    size_t a0, f0;
+
+    for (unsigned r = 0; r < repeat; ++r)
+    {
+        int status;
+        phase_begin(&t0, &a0, &f0);
+        MIDI_file midi = get_MIDI_path_opts(path, popts, &status);
+        phase_end(&parse, t0, a0, f0);
+        if (status != 0)
+        {
+            fprintf(stderr, "Error: Failed to parse '%s' (status %d)\n", path, status);
+            return 0;
+        }
+
+        tracks = midi.mthd.ntracks;
+        events = 0;
+        for (size_t t = 0; t < tracks; ++t) events += midi.mtrk[t].count;
+        arena_allocs = midi.arena.nallocs;
+        arena_blocks = midi.arena.nblocks;
+
+        phase_begin(&t0, &a0, &f0);
+        int ok = write_MIDI_to_JSON_opts(&midi, sink, jopts) && fflush(sink) == 0;
+        phase_end(&json, t0, a0, f0);
+
+        phase_begin(&t0, &a0, &f0);
+        free_MIDI_file(&midi);
+        phase_end(&release, t0, a0, f0);
+
+        if (!ok)
+        {
+            fprintf(stderr, "Error: Failed to write JSON for '%s'\n", path);
+            return 0;
+        }
+    }
+
+    double mb = (double) st.st_size / 1e6;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("{\"file\":\"%s\",\"bytes\":%lld,\"tracks\":%zu,\"events\":%zu,\"repeat\":%u,",
+           path, (long long) st.st_size, tracks, events, repeat);
+    printf("\"parse_mb_s\":%.2f,\"parse_events_s\":%.0f,",
+           rate(mb, parse.best), rate((double) events, parse.best));
+    printf("\"json_mb_s\":%.2f,\"json_events_s\":%.0f,",
+           rate(mb, json.best), rate((double) events, json.best));
+    print_phase("parse", &parse, repeat);
+    printf(",");
+    print_phase("json", &json, repeat);
+    printf(",");
+    print_phase("free", &release, repeat);
+    printf(",\"arena_allocs\":%zu,\"arena_blocks\":%zu,\"peak_rss_kb\":%ld}\n",
+           arena_allocs, arena_blocks, ru.ru_maxrss);
+    fflush(stdout);
+    return 1;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] <file.mid>...\n", prog);
+    printf("  --repeat <n>    runs per file, the best and mean are reported (default 5)\n");
+    printf("  --threads <n>   threads for parsing and rendering (default 1)\n");
+    printf("  --style <s>     pretty, compact or ndjson (default pretty)\n");
+    printf("JSON goes to /dev/null, peak RSS covers the whole process so run\n");
+    printf("one file per process when comparing memory\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned repeat = 5;
+    MIDI_parse_opts  popts = {0};
+    JSON_writer_opts jopts = {0};
+    int first = argc;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+            repeat = (unsigned) atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            popts.nthreads = jopts.nthreads = (unsigned) atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--style") && i + 1 < argc)
+        {
+            const char *s = argv[++i];
+            if      (!strcmp(s, "pretty"))  jopts.style = JSON_PRETTY;
+            else if (!strcmp(s, "compact")) jopts.style = JSON_COMPACT;
+            else if (!strcmp(s, "ndjson"))  jopts.style = JSON_NDJSON;
+            else usage(argv[0]);
+        }
+        else if (argv[i][0] == '-')
+            usage(argv[0]);
+        else
+        {
+            first = i;
+            break;
+        }
+    }
+    if (first == argc || repeat == 0) usage(argv[0]);
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (!sink)
+    {
+        fprintf(stderr, "Error: Could not open /dev/null\n");
+        return 1;
+    }
+
+    int ok = 1;
+    for (int i = first; i < argc; ++i)
+        ok &= bench_file(argv[i], repeat, &popts, &jopts, sink);
+
+    fclose(sink);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// deterministic synthetic SMF files for benchmarking, the same options
+// and seed always give the same bytes
+
+#define GEN_BLOCK (1 << 16)
+
+typedef struct
+{
+    unsigned tracks;
+    uint64_t events;     // per track, ignored when size is set
+    uint64_t size;       // approximate file size in bytes
+    double   running;    // chance a repeated status byte is left out
+    double   meta;       // share of meta events
+    double   sysex;      // share of sysex events
+    uint64_t seed;
+    const char *out;
+} Gen_opts;
+
+typedef struct
+{
+    FILE    *fp;
+    uint8_t  buf[GEN_BLOCK];
+    size_t   len;
+    uint64_t written;
+    int      error;
+} Gen_out;
+
+// ---------------------------------------------------
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static uint32_t rng_below(uint32_t n)
+{
+    return (uint32_t)((rng_next() >> 32) % n);
+}
+
+static double rng_unit(void)
+{
+    return (double)(rng_next() >> 11) / 9007199254740992.0;
+}
+
+// ---------------------------------------------------
+
+static void out_flush_gen(Gen_out *o)
+{
+    if (o->len && fwrite(o->buf, 1, o->len, o->fp) != o->len) o->error = 1;
+    o->written += o->len;
+    o->len = 0;
+}
+
+static void put(Gen_out *o, uint8_t b)
+{
+    if (o->len == GEN_BLOCK) out_flush_gen(o);
+    o->buf[o->len++] = b;
+}
+
+static void put_be(Gen_out *o, uint32_t v, int n)
+{
+    for (int i = n - 1; i >= 0; --i) put(o, (uint8_t)(v >> (8 * i)));
+}
+
+static void put_vlq(Gen_out *o, uint32_t v)
+{
+    uint8_t tmp[4];
+    int n = 0;
+    do
+    {
+        tmp[n++] = (uint8_t)(v & 0x7F);
+        v >>= 7;
+    } while (v && n < 4);
+
+    while (n-- > 0) put(o, tmp[n] | (n ? 0x80 : 0));
+}
+
+static uint64_t out_pos(const Gen_out *o)
+{
+    return o->written + o->len;
+}
+
+// ---------------------------------------------------
+
+static uint32_t random_delta(void)
+{
+    uint32_t r = rng_below(100);
+    if (r < 35) return 0;
+    if (r < 85) return 1 + rng_below(120);
+    if (r < 98) return 128 + rng_below(4000);
+    return 16384 + rng_below(200000);
+}
+
+static void put_meta_text(Gen_out *o, uint8_t type)
+{
+    uint32_t len = 1 + rng_below(32);
+    put(o, 0xFF);
+    put(o, type);
+    put_vlq(o, len);
+    for (uint32_t i = 0; i < len; ++i) put(o, (uint8_t)('a' + rng_below(26)));
+}
+
+static void put_meta(Gen_out *o)
+{
+    switch (rng_below(4))
+    {
+    case 0:
+        put(o, 0xFF); put(o, 0x51); put(o, 3);
+        put_be(o, 300000 + rng_below(400000), 3);
+        break;
+    case 1:
+        put(o, 0xFF); put(o, 0x58); put(o, 4);
+        put(o, (uint8_t)(2 + rng_below(6))); put(o, 2); put(o, 24); put(o, 8);
+        break;
+    case 2:
+        put_meta_text(o, 0x06);
+        break;
+    default:
+        put_meta_text(o, 0x01);
+        break;
+    }
+}
+
+static void put_sysex(Gen_out *o)
+{
+    uint32_t len = 4 + rng_below(60);
+    put(o, 0xF0);
+    put_vlq(o, len);
+    for (uint32_t i = 0; i + 1 < len; ++i) put(o, (uint8_t) rng_below(128));
+    put(o, 0xF7);
+}
+
+// mostly notes, like real performances, with some controllers on top
+static void put_channel(Gen_out *o, uint8_t *running, double keep, uint8_t channel)
+{
+    uint32_t r = rng_below(100);
+    uint8_t  kind = r < 80 ? 0x9 : r < 88 ? 0x8 : r < 95 ? 0xB : r < 97 ? 0xC : 0xE;
+    uint8_t  status = (uint8_t)(kind << 4 | channel);
+
+    if (status != *running || rng_unit() >= keep) put(o, status);
+    *running = status;
+
+    put(o, (uint8_t) rng_below(128));
+    if (kind != 0xC) put(o, (uint8_t) rng_below(128));
+}
+
+static int put_track(Gen_out *o, const Gen_opts *opts, unsigned t, uint64_t budget)
+{
+    put_be(o, 0x4D54726B, 4);
+    uint64_t size_at = out_pos(o);
+    put_be(o, 0, 4);
+    uint64_t start = out_pos(o);
+
+    uint8_t running = 0;
+    uint8_t channel = (uint8_t)(t % 16);
+
+    // a name first so tools have something to show
+    put(o, 0);
+    put_meta_text(o, 0x03);
+
+    for (uint64_t i = 0; opts->size ? out_pos(o) - start < budget : i < opts->events; ++i)
+    {
+        put_vlq(o, random_delta());
+
+        double r = rng_unit();
+        if (r < opts->meta)
+        {
+            put_meta(o);
+            running = 0;
+        }
+        else if (r < opts->meta + opts->sysex)
+        {
+            put_sysex(o);
+            running = 0;
+        }
+        else
+        {
+            put_channel(o, &running, opts->running, channel);
+        }
+
+        if (out_pos(o) - start > 0xFFFFFF00ull)
+        {
+            fprintf(stderr, "Error: track %u would pass 4 GiB, use more tracks\n", t);
+            return 0;
+        }
+    }
+
+    put(o, 0); put(o, 0xFF); put(o, 0x2F); put(o, 0);
+
+    // the chunk size is only known now, patch it in place
+    uint64_t end = out_pos(o);
+    out_flush_gen(o);
+    if (fseeko(o->fp, (off_t) size_at, SEEK_SET) != 0) return 0;
+    uint8_t be[4] = {
+        (uint8_t)((end - start) >> 24), (uint8_t)((end - start) >> 16),
+        (uint8_t)((end - start) >> 8),  (uint8_t)(end - start)
+    };
+    if (fwrite(be, 1, 4, o->fp) != 4) return 0;
+    return fseeko(o->fp, (off_t) end, SEEK_SET) == 0;
+}
+
+// ---------------------------------------------------
+
+static uint64_t parse_count(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+    if (*end == 'k' || *end == 'K') v *= 1e3;
+    if (*end == 'm' || *end == 'M') v *= 1e6;
+    if (*end == 'g' || *end == 'G') v *= 1e9;
+    return v < 0 ? 0 : (uint64_t) v;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] -o <file.mid>\n", prog);
+    printf("  --tracks <n>    number of MTrk chunks (default 4)\n");
+    printf("  --events <n>    events per track, k/M/G suffixes (default 100k)\n");
+    printf("  --size <bytes>  aim for this file size instead, k/M/G suffixes\n");
+    printf("  --running <p>   chance a repeated status byte is omitted (default 0.8)\n");
+    printf("  --meta <p>      share of meta events (default 0.02)\n");
+    printf("  --sysex <p>     share of sysex events (default 0.005)\n");
+    printf("  --seed <n>      generator seed (default 1)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    Gen_opts opts = { 4, 100000, 0, 0.8, 0.02, 0.005, 1, NULL };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (i + 1 == argc) usage(argv[0]);
+        const char *v = argv[++i];
+        if      (!strcmp(argv[i - 1], "--tracks"))  opts.tracks  = (unsigned) atoi(v);
+        else if (!strcmp(argv[i - 1], "--events"))  opts.events  = parse_count(v);
+        else if (!strcmp(argv[i - 1], "--size"))    opts.size    = parse_count(v);
+        else if (!strcmp(argv[i - 1], "--running")) opts.running = atof(v);
+        else if (!strcmp(argv[i - 1], "--meta"))    opts.meta    = atof(v);
+        else if (!strcmp(argv[i - 1], "--sysex"))   opts.sysex   = atof(v);
+        else if (!strcmp(argv[i - 1], "--seed"))    opts.seed    = parse_count(v);
+        else if (!strcmp(argv[i - 1], "-o"))        opts.out     = v;
+        else usage(argv[0]);
+    }
+    if (!opts.out || opts.tracks == 0 || opts.tracks > 65535) usage(argv[0]);
+    if (opts.meta + opts.sysex > 1.0) usage(argv[0]);
+
+    rng_state = opts.seed * 0x9E3779B97F4A7C15ull + 1;
+
+    static Gen_out o;
+    o.fp = fopen(opts.out, "wb");
+    if (!o.fp)
+    {
+        fprintf(stderr, "Error: Could not open '%s'\n", opts.out);
+        return 1;
+    }
+
+    put_be(&o, 0x4D546864, 4);
+    put_be(&o, 6, 4);
+    put_be(&o, opts.tracks > 1 ? 1 : 0, 2);
+    put_be(&o, opts.tracks, 2);
+    put_be(&o, 480, 2);
+
+    uint64_t budget = opts.size ? (opts.size > 14 ? opts.size - 14 : 0) / opts.tracks : 0;
+    int ok = 1;
+    for (unsigned t = 0; ok && t < opts.tracks; ++t)
+        ok = put_track(&o, &opts, t, budget);
+
+    out_flush_gen(&o);
+    if (fclose(o.fp) != 0 || o.error) ok = 0;
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Failed to write '%s'\n", opts.out);
+        return 1;
+    }
+
+    fprintf(stderr, "%s: %u tracks, %llu bytes\n", opts.out, opts.tracks,
+            (unsigned long long) o.written);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/vlq.h"
+
+#define BENCH_VALUES 4000000
+#define BENCH_ROUNDS 10
+
+// the byte at a time loop get_VLQ used before, kept as the baseline
+static size_t decode_bytewise(const uint8_t *p, size_t avail, uint32_t *value)
+{
+    uint32_t vlq = 0;
+    for (size_t n = 0; n < 4; ++n)
+    {
+        if (n == avail) return 0;
+        uint8_t c = p[n];
+        vlq = (vlq << 7) | (uint32_t)(c & 0x7F);
+        if ((c & 0x80) == 0)
+        {
+            *value = vlq;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static size_t encode(uint8_t *p, uint32_t v)
+{
+    uint8_t tmp[4];
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = (uint8_t)(v & 0x7F);
+        v >>= 7;
+    } while (v);
+
+    for (size_t i = 0; i < n; ++i)
+        p[i] = tmp[n - 1 - i] | (i + 1 < n ? 0x80 : 0);
+    return n;
+}
+
+// mostly one byte delta times, like real tracks
+static uint32_t random_value(void)
+{
+    int r = rand() % 100;
+    if (r < 70) return (uint32_t)(rand() % 128);
+    if (r < 90) return 128 + (uint32_t)(rand() % 16000);
+    if (r < 98) return 16384 + (uint32_t)(rand() % 2000000);
+    return 2097152 + (uint32_t)(rand() % 200000000);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double secs, size_t bytes, uint64_t check)
+{
+    double n = (double) BENCH_VALUES * BENCH_ROUNDS;
+    printf("  %-22s %8.3f ms  %7.1f Mvalues/s  %7.1f MB/s  (check %llu)\n",
+           name, secs * 1e3, n / secs / 1e6,
+           (double) bytes * BENCH_ROUNDS / secs / 1e6, (unsigned long long) check);
+}
+
+int main(void)
+{
+    uint8_t  *buf    = (uint8_t*) malloc((size_t) BENCH_VALUES * 4);
+    uint32_t *values = (uint32_t*) malloc(sizeof(uint32_t) * BENCH_VALUES);
+    uint32_t *out    = (uint32_t*) malloc(sizeof(uint32_t) * BENCH_VALUES);
+    if (!buf || !values || !out) return 1;
+
+    srand(42);
+    size_t len = 0;
+    for (size_t i = 0; i < BENCH_VALUES; ++i)
+    {
+        values[i] = random_value();
+        len += encode(buf + len, values[i]);
+    }
+    printf("%d values in %zu bytes, kernel: %s\n", BENCH_VALUES, len, MIDI_vlq_kernel());
+
+    uint64_t check;
+    double t;
+
+    check = 0;
+    t = now_seconds();
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+    {
+        size_t pos = 0;
+        for (size_t i = 0; i < BENCH_VALUES; ++i)
+        {
+            uint32_t v = 0;
+            pos += decode_bytewise(buf + pos, len - pos, &v);
+            check += v;
+        }
+    }
+    report("bytewise (old get_VLQ)", now_seconds() - t, len, check);
+
+    check = 0;
+    t = now_seconds();
+    for (int r = 0; r < BENCH_ROUNDS; ++r)
+    {
+        size_t pos = 0;
+        for (size_t i = 0; i < BENCH_VALUES; ++i)
+        {
+            uint32_t v = 0;
+            pos += MIDI_vlq_decode(buf + pos, len - pos, &v);
+            check += v;
+        }
+    }
+    report("MIDI_vlq_decode", now_seconds() - t, len, check);
+
+    const char *names[2] = { "decode_many scalar", "decode_many simd" };
+    for (int k = 0; k < 2; ++k)
+    {
+        check = 0;
+        t = now_seconds();
+        for (int r = 0; r < BENCH_ROUNDS; ++r)
+        {
+            size_t used, n = k ? MIDI_vlq_decode_many(buf, len, out, BENCH_VALUES, &used)
+                               : MIDI_vlq_decode_many_scalar(buf, len, out, BENCH_VALUES, &used);
+            if (n != BENCH_VALUES || used != len) return 1;
+            check += out[r];
+        }
+        double secs = now_seconds() - t;
+        if (memcmp(out, values, sizeof(uint32_t) * BENCH_VALUES) != 0)
+        {
+            printf("  %s decoded the wrong values\n", names[k]);
+            return 1;
+        }
+        report(names[k], secs, len, check);
+    }
+
+    free(buf);
+    free(values);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "json_generator.h"
+#include "parse_cache.h"
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    char   *path;
+    size_t  name;    // offset of the part of path used for the output name
+} MIDI_path;
+
+typedef struct
+{
+    MIDI_path *items;
+    size_t     count;
+    size_t     cap;
+} MIDI_path_list;
+
+typedef struct
+{
+    const char       *out_dir;    // NULL converts without writing anything
+    unsigned          nthreads;
+    JSON_writer_opts  json;       // json.nthreads is ignored, files run in parallel
+    MIDI_cache       *cache;      // optional, shared by every worker
+} MIDI_batch_opts;
+
+typedef struct
+{
+    size_t   files;
+    size_t   failed;
+    uint64_t bytes;     // input bytes of the files that converted
+    uint64_t events;
+    double   seconds;
+} MIDI_batch_stats;
+
+// ---------------------------------------------------
+
+// src is a directory (walked recursively for .mid/.midi/.smf files, not
+// into symlinked directories),
+// a text file with one path per line, or "-" for paths on stdin.
+// the list comes back sorted so runs are reproducible
+int  collect_MIDI_paths(const char *src, MIDI_path_list *list);
+void free_MIDI_path_list(MIDI_path_list *list);
+
+// converts every file in list, a file that fails is reported on stderr
+// and counted but doesn't stop the others. files whose output names in
+// out_dir would be the same all fail instead of overwriting each other.
+// returns 0 only if the batch itself couldn't run
+int run_MIDI_batch(const MIDI_path_list *list, const MIDI_batch_opts *opts,
+                   MIDI_batch_stats *stats);
+
+#endif /* BATCH_H */
@@ -0,0 +1,55 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+#define MIDI_TABLE_MAX_COLUMNS 6
+
+// ---------------------------------------------------
+
+typedef enum { MIDI_COL_U8, MIDI_COL_U16, MIDI_COL_U32, MIDI_COL_U64, MIDI_COL_BINARY } MIDI_column_type;
+
+// one contiguous array per column. binary columns keep rows + 1 int32
+// offsets in values, row i is bytes[values[i]..values[i + 1])
+typedef struct
+{
+    const char      *name;
+    MIDI_column_type type;
+    void            *values;
+    uint8_t         *bytes;
+    size_t           nbytes;
+} MIDI_column;
+
+typedef struct
+{
+    const char *name;
+    size_t      rows;
+    MIDI_column cols[MIDI_TABLE_MAX_COLUMNS];
+    unsigned    ncols;
+} MIDI_table;
+
+// rows in file order, track by track, ticks absolute inside their track
+typedef struct
+{
+    MIDI_table channel;   // track, tick, channel, type, param1, param2
+    MIDI_table meta;      // track, tick, type, length, data
+    MIDI_table tempo;     // track, tick, usec, tempo (microseconds per quarter)
+} MIDI_tables;
+
+// ---------------------------------------------------
+
+int  MIDI_tables_from_file(const MIDI_file *midi, MIDI_tables *out);
+void free_MIDI_tables(MIDI_tables *tables);
+
+// a header line, then one line per row. binary cells are uppercase hex
+int  write_MIDI_table_csv(const MIDI_table *table, FILE *fp);
+// an Arrow IPC file (what pyarrow.ipc.open_file and Feather v2 read)
+// holding the table as one record batch of non-nullable unsigned ints
+// and binary. every column goes out as one write, never row by row.
+// little-endian hosts only
+int  write_MIDI_table_arrow(const MIDI_table *table, FILE *fp);
+
+#endif /* COLUMNAR_H */
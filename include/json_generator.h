@@ -2,11 +2,56 @@
 #define JSON_GENERATOR_H
 
 #include "midi_parser.h"
+#include "out_buffer.h"
 #include <stdio.h>
 
+typedef enum
+{
+    JSON_PRETTY,     // the indented document, the default
+    JSON_COMPACT,    // the same document without any whitespace
+    JSON_NDJSON      // header object, then one line per event
+} JSON_style;
+
+typedef struct
+{
+    JSON_style style;
+    // tracks are rendered on this many threads, 0 or 1 keeps it serial
+    unsigned   nthreads;
+    // nonzero writes one list of all events ordered by time, each with its
+    // track, absolute tick and microseconds, instead of one list per track
+    int        timeline;
+    // nonzero writes the paired note spans, a piano roll, instead of events.
+    // with sustain set CC64 holds released notes until the pedal comes up
+    int        notes;
+    int        sustain;
+    // when set, the write time, output bytes and allocations are added
+    // here, see midi_stats.h
+    MIDI_stats *stats;
+} JSON_writer_opts;
+
 // ---------------------------------------------------
 
 int write_MIDI_to_JSON(const MIDI_file *midi, FILE *fp);
 int write_MIDI_to_JSON_file(const MIDI_file *midi, const char *filename);
 
+// same output straight from an SMF image, memory use does not grow
+// with the number of events, except for timelines and notes that need
+// every track
+int write_MIDI_buffer_to_JSON(const uint8_t *buf, size_t len, FILE *fp);
+
+// same as above, opts may be NULL for the defaults
+int write_MIDI_to_JSON_opts(const MIDI_file *midi, FILE *fp, const JSON_writer_opts *opts);
+int write_MIDI_to_JSON_file_opts(const MIDI_file *midi, const char *filename,
+                                 const JSON_writer_opts *opts);
+int write_MIDI_buffer_to_JSON_opts(const uint8_t *buf, size_t len, FILE *fp,
+                                   const JSON_writer_opts *opts);
+// NDJSON read from a pipe or socket as it arrives, through the push
+// parser. events are written as soon as they are complete, so nothing
+// but a split meta or sysex payload is ever held. a broken file leaves
+// the lines written before the error
+int write_MIDI_stream_to_NDJSON(FILE *in, FILE *fp, const JSON_writer_opts *opts);
+// appends the whole document to out, always on the calling thread
+int write_MIDI_to_JSON_buffer(const MIDI_file *midi, Out_buffer *out,
+                              const JSON_writer_opts *opts);
+
 #endif /* JSON_GENERATOR_H */
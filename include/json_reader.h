@@ -0,0 +1,21 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+// reads back what write_MIDI_to_JSON emits, pretty, compact or NDJSON,
+// straight into MTrk arrays without building a document tree. keys may
+// come in any order and unknown ones are skipped, payloads are decoded
+// into the file's arena. NDJSON carries no chunk sizes, those stay 0.
+// events are checked like the SMF parser checks them, so anything that
+// loads can be written out again
+MIDI_file get_MIDI_JSON_buffer(const char *buf, size_t len, int *status);
+// maps the file read-only and reads it in place
+MIDI_file get_MIDI_JSON_path(const char *path, int *status);
+
+// nonzero when the first thing in buf, whitespace aside, is a '{'
+int MIDI_JSON_sniff(const uint8_t *buf, size_t len);
+
+#endif /* JSON_READER_H */
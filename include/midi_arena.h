@@ -0,0 +1,38 @@
+#ifndef MIDI_ARENA_H
+#define MIDI_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MIDI_ARENA_MIN_BLOCK 4096
+#define MIDI_ARENA_MAX_BLOCK (1 << 20)
+
+// ---------------------------------------------------
+
+typedef struct MIDI_arena_block
+{
+    struct MIDI_arena_block *next;
+    size_t  used;
+    size_t  cap;
+    uint8_t data[];
+} MIDI_arena_block;
+
+// bump allocator for event payloads, everything is released at once
+typedef struct
+{
+    MIDI_arena_block *head;
+    size_t nallocs;    // payloads handed out
+    size_t nblocks;    // blocks obtained from malloc
+    size_t bytes;      // payload bytes handed out
+} MIDI_arena;
+
+// ---------------------------------------------------
+
+void *arena_alloc(MIDI_arena *arena, size_t n);
+// moves every block of src into dst, src is left empty
+void arena_splice(MIDI_arena *dst, MIDI_arena *src);
+// drops every payload but keeps the largest block around for reuse
+void arena_reset(MIDI_arena *arena);
+void arena_free(MIDI_arena *arena);
+
+#endif /* MIDI_ARENA_H */
@@ -0,0 +1,45 @@
+#ifndef MIDI_FOLLOW_H
+#define MIDI_FOLLOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+// ---------------------------------------------------
+
+typedef enum { FOLLOW_MTHD, FOLLOW_CHUNK, FOLLOW_EVENTS, FOLLOW_DONE } Follow_state;
+
+// a file that is still being written, parsed a little more on every
+// update. the MTrk size fields are ignored because a recorder only fixes
+// them up at the end, a track is over at its End Of Track and the next
+// chunk header follows right after it
+typedef struct
+{
+    int          fd;
+    uint64_t     offset;    // file bytes read so far
+    uint8_t     *buf;       // read but not parsed yet, at most a partial
+    size_t       len;       // header or event once an update returns
+    size_t       cap;
+    Follow_state state;
+    MIDI_file    midi;      // tracks not reached yet have no events
+    uint16_t     track;     // the one being appended to
+    MTrk_reader  rd;        // its running status and tick between updates
+} MIDI_follow;
+
+// ---------------------------------------------------
+
+// nothing is read until the first update, so the file may still be empty
+int  MIDI_follow_open(MIDI_follow *fw, const char *path);
+void MIDI_follow_close(MIDI_follow *fw);
+
+// parses whatever was appended since the last update, the cost follows
+// the new bytes only. *added gets the events appended, 0 on bad data or
+// when the file shrank
+int  MIDI_follow_update(MIDI_follow *fw, size_t *added);
+// the last track has ended, later updates read nothing
+int  MIDI_follow_done(const MIDI_follow *fw);
+
+// hands the parsed file over, the follower is closed afterwards
+MIDI_file MIDI_follow_take(MIDI_follow *fw);
+
+#endif /* MIDI_FOLLOW_H */
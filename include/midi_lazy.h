@@ -0,0 +1,46 @@
+#ifndef MIDI_LAZY_H
+#define MIDI_LAZY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+// ---------------------------------------------------
+
+// a file whose tracks are decoded the first time they're asked for.
+// payloads borrow from the image, so decoded tracks cost only their event
+// arrays. not thread safe, one handle belongs to one thread
+typedef struct
+{
+    MIDI_map    map;        // the image, owned only when opened by path
+    int         owns_map;
+    MThd        mthd;
+    MTrk_chunk *chunks;
+    MTrk       *mtrk;
+    uint8_t    *decoded;    // per track, set while mtrk holds its events
+    uint64_t   *last_use;   // per track, for least recently used eviction
+    uint64_t    clock;
+    size_t      budget;     // bytes of decoded events, 0 for no limit
+    size_t      bytes;
+} MIDI_lazy;
+
+// ---------------------------------------------------
+
+// only MThd and the chunk headers are read
+int  MIDI_lazy_open_path(MIDI_lazy *lz, const char *path, size_t budget);
+// buf is borrowed and must outlive the handle
+int  MIDI_lazy_open_buffer(MIDI_lazy *lz, const uint8_t *buf, size_t len, size_t budget);
+void MIDI_lazy_close(MIDI_lazy *lz);
+
+// decodes the track if needed, NULL on bad data. when the budget is
+// exceeded older tracks are evicted, so the result is only good until
+// the next call on the handle
+const MTrk *MIDI_lazy_track(MIDI_lazy *lz, uint16_t track);
+void        MIDI_lazy_evict(MIDI_lazy *lz, uint16_t track);
+
+// events of one track straight from the image, nothing is kept, so
+// reading a name or the first tempo costs only the bytes it touches
+int  MIDI_lazy_stream_track(const MIDI_lazy *lz, uint16_t track,
+                            MIDI_event_cb cb, void *user);
+
+#endif /* MIDI_LAZY_H */
@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include "midi_arena.h"
+#include "midi_stats.h"
 
 #define MThd_string 0x4D546864
 #define MTrk_string 0x4D54726B
@@ -23,6 +25,7 @@ typedef struct
             uint8_t ticks;
         } frames_per_sec;
     } timediv;
+    uint16_t division;    // the raw word, bit 15 is set for SMPTE timing
 } MThd;
 
 typedef struct
@@ -42,6 +45,7 @@ typedef struct
 
 typedef struct
 {
+    uint8_t  type;     // 0xF0 or 0xF7, the status byte it came with
     uint32_t len;
     void*    data;
 } Sysex_event;
@@ -72,19 +76,178 @@ typedef struct
 {
     MThd  mthd;
     MTrk *mtrk;
+    MIDI_arena arena;   // owns every meta and sysex payload
 } MIDI_file;
 
+struct MIDI_cache;
+
+// events a parse leaves out, all zero keeps everything. a skipped event is
+// stepped over by its length, its payload is neither checked nor copied,
+// and its delta time is added to the next event that is kept. End Of
+// Track is never dropped, so filtered tracks keep their length
+typedef struct
+{
+    uint8_t  skip_kinds;       // bit per Event_kind, 1 << SYS drops sysex
+    uint16_t skip_channels;    // bit per channel, channel events only
+    uint16_t skip_messages;    // bit per status nibble, 1 << 0xA drops poly pressure
+    uint8_t  skip_meta[32];    // bit per meta type, see MIDI_FILTER_SKIP_META
+} MIDI_event_filter;
+
+#define MIDI_FILTER_SKIP_META(f, type) \
+    ((f)->skip_meta[(uint8_t)(type) >> 3] |= (uint8_t)(1u << ((type) & 7)))
+
+typedef struct
+{
+    // tracks are decoded on this many threads, 0 or 1 keeps it serial
+    unsigned nthreads;
+    // when set, payloads go here instead of the file's own arena, so the
+    // caller can reuse it and must keep it alive as long as the file
+    MIDI_arena *arena;
+    // when set, a file seen before is loaded from the cache instead of
+    // parsed, and a new one is stored after parsing (see parse_cache.h)
+    struct MIDI_cache *cache;
+    // when set, only the events it lets through are kept. filtered parses
+    // bypass the cache, whose entries always hold every event
+    const MIDI_event_filter *filter;
+    // when set, counters and timings of the parse are added here, see
+    // midi_stats.h. the caller zeroes it and frees it with MIDI_stats_free
+    MIDI_stats *stats;
+} MIDI_parse_opts;
+
+// meta or sysex event kept next to an MTrk_soa
+typedef struct
+{
+    uint32_t       event;   // index of the event it belongs to
+    uint8_t        type;    // meta type, 0 for sysex
+    uint32_t       len;
+    const uint8_t *data;    // borrowed from wherever the track came from
+} MTrk_soa_payload;
+
+// struct-of-arrays track: channel scans only walk the dense status,
+// params and delta arrays. status holds the full status byte (0xFF for
+// meta, 0xF0/0xF7 for sysex), params are zero for non channel events
+typedef struct
+{
+    uint32_t          size;
+    size_t            count;
+    uint32_t         *delta;
+    uint8_t          *status;
+    uint8_t         (*params)[2];
+    MTrk_soa_payload *payloads;   // sorted by event index
+    size_t            npayloads;
+} MTrk_soa;
+
+// bounds-checked read position over an in-memory SMF image
+typedef struct
+{
+    const uint8_t *buf;
+    size_t         len;
+    size_t         pos;
+} MIDI_cursor;
+
+// where a track's events live in the buffer, found without decoding
+typedef struct
+{
+    size_t   offset;   // first event byte, relative to the buffer
+    size_t   avail;    // bytes of the chunk actually present
+    uint32_t size;     // declared chunk size
+} MTrk_chunk;
+
+// decoding state of one track, events come out one at a time
+typedef struct
+{
+    MIDI_cursor cur;
+    uint32_t    size;
+    uint8_t     running_status;
+    uint64_t    tick;      // absolute tick of the last event returned
+    int         done;
+    const MIDI_event_filter *filter;   // NULL after init, returns every event
+} MTrk_reader;
+
+typedef struct
+{
+    uint16_t   track;
+    size_t     index;      // position of the event inside its track
+    uint64_t   tick;       // absolute tick inside its track
+    MTrk_event event;      // payloads point into the input buffer
+} MIDI_stream_event;
+
+// return 0 to stop the stream
+typedef int (*MIDI_event_cb)(const MIDI_stream_event *ev, void *user);
+
+// a whole file in memory, mmapped when possible
+typedef struct
+{
+    const uint8_t *buf;
+    size_t         len;
+    int            mapped;
+} MIDI_map;
+
 // ---------------------------------------------------
 
-int check_for_MThd(MThd *mthd, FILE *fp);
-int parse_MTrk_channel_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read);
-int parse_MTrk_meta_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read);
-int parse_MTrk_sysex_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read);
-int parse_MTrk_events(MTrk *mtrk, FILE *fp);
-int parse_MTrk(MTrk *mtrk, FILE *fp);
+// data bytes after a channel status, by its high nibble, 0 for the
+// nibbles that aren't channel messages
+extern const uint8_t MIDI_channel_data_len[16];
+
+int check_for_MThd(MThd *mthd, MIDI_cursor *cur);
+int parse_MTrk_channel_event(MTrk_event *ev, MIDI_cursor *cur, uint32_t *bytes_read);
+// 0 for a malformed payload, 2 for End of Track, 1 otherwise
+int check_MTrk_meta_payload(uint8_t type, uint32_t len, const uint8_t *p);
+// meta and sysex payloads are left pointing into the cursor's buffer
+int parse_MTrk_meta_event(MTrk_event *ev, MIDI_cursor *cur, uint32_t *bytes_read);
+int parse_MTrk_sysex_event(MTrk_event *ev, MIDI_cursor *cur, uint32_t *bytes_read);
+// walks a chunk decoding only lengths, 0 when it's malformed
+int MTrk_count_events(const uint8_t *data, size_t avail, uint32_t size, size_t *count);
+// same, counting only the events filter keeps, filter may be NULL
+int MTrk_count_events_filtered(const uint8_t *data, size_t avail, uint32_t size,
+                               const MIDI_event_filter *filter, size_t *count);
+// a NULL arena leaves payloads pointing into the cursor's buffer
+int parse_MTrk_events(MTrk *mtrk, MIDI_cursor *cur, MIDI_arena *arena);
+int parse_MTrk_events_filtered(MTrk *mtrk, MIDI_cursor *cur, MIDI_arena *arena,
+                               const MIDI_event_filter *filter);
+int parse_MTrk(MTrk *mtrk, MIDI_cursor *cur, MIDI_arena *arena);
+int scan_MTrk_chunks(MIDI_cursor *cur, uint16_t ntracks, MTrk_chunk *chunks);
+
+void MTrk_reader_init(MTrk_reader *rd, const uint8_t *data, size_t avail, uint32_t size);
+// 1 when an event was decoded, 0 at the end of the track, -1 on bad data
+int  MTrk_reader_next(MTrk_reader *rd, MTrk_event *ev);
+// decodes the complete events at the start of data onto the end of mtrk,
+// going on from rd's running status and tick. an event cut off by the end
+// of data is left for the next call, *used gets the bytes taken, and
+// rd->done is set once End Of Track was appended. 0 on bad data
+int  MTrk_append_events(MTrk *mtrk, MTrk_reader *rd, const uint8_t *data, size_t avail,
+                        MIDI_arena *arena, size_t *used);
 
+int  open_MIDI_map(const char *path, MIDI_map *map);
+void close_MIDI_map(MIDI_map *map);
+
+// the buffer only needs to outlive the call, payloads are copied
+MIDI_file get_MIDI_buffer(const uint8_t *buf, size_t len, int *status);
+// maps the file read-only and parses it in place
+MIDI_file get_MIDI_path(const char *path, int *status);
+// reads the rest of the stream into memory, then parses it as a buffer
 MIDI_file get_MIDI_file(FILE *fp, int *status);
 
+// same as above, opts may be NULL for the defaults
+MIDI_file get_MIDI_buffer_opts(const uint8_t *buf, size_t len,
+                               const MIDI_parse_opts *opts, int *status);
+MIDI_file get_MIDI_path_opts(const char *path, const MIDI_parse_opts *opts, int *status);
+MIDI_file get_MIDI_file_opts(FILE *fp, const MIDI_parse_opts *opts, int *status);
+
+// calls cb for every event in file order without building any MTrk.
+// events of earlier tracks are delivered before a later track can fail
+int stream_MIDI_buffer(const uint8_t *buf, size_t len, MThd *mthd,
+                       MIDI_event_cb cb, void *user);
+
+// the soa borrows payloads, so it must not outlive mtrk or buf
+int  MTrk_to_soa(const MTrk *mtrk, MTrk_soa *soa);
+int  parse_MTrk_soa(const uint8_t *buf, const MTrk_chunk *chunk, MTrk_soa *soa);
+void free_MTrk_soa(MTrk_soa *soa);
+const MTrk_soa_payload *MTrk_soa_payload_at(const MTrk_soa *soa, size_t event);
+size_t MTrk_soa_bytes(const MTrk_soa *soa);
+size_t MTrk_soa_count_notes(const MTrk_soa *soa);
+void   MTrk_soa_transpose(MTrk_soa *soa, int semitones);
+
 void free_MTrk(MTrk *mtrk);
 void free_MIDI_file(MIDI_file *midi);
 
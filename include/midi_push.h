@@ -0,0 +1,69 @@
+#ifndef MIDI_PUSH_H
+#define MIDI_PUSH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+// ---------------------------------------------------
+
+// where the next byte goes, the same steps MTrk_reader_next takes
+typedef enum
+{
+    PUSH_MTHD,        // collecting the 14 header bytes
+    PUSH_CHUNK,       // collecting an 8 byte MTrk header
+    PUSH_DELTA,       // delta time VLQ
+    PUSH_STATUS,      // status byte, or the first data byte under running status
+    PUSH_META_TYPE,
+    PUSH_LENGTH,      // meta or sysex length VLQ
+    PUSH_PAYLOAD,
+    PUSH_DATA,        // channel event parameters
+    PUSH_SKIP,        // chunk bytes after End Of Track
+    PUSH_DONE,        // every track ended, anything more is ignored
+    PUSH_FAILED       // bad data or the callback stopped, feeding is over
+} Push_state;
+
+// an SMF fed in pieces of any size, e.g. as they come off a pipe. events
+// go to the callback as soon as their last byte arrives, the payload
+// pointers only live until it returns. nothing but a split meta or sysex
+// payload is buffered, so memory stays at the largest such payload
+typedef struct
+{
+    Push_state    state;
+    MIDI_event_cb cb;
+    void         *user;
+
+    MThd     mthd;
+    uint8_t  head[14];       // header bytes so far
+    uint8_t  nhead;
+    uint32_t chunk_left;     // bytes of the current MTrk not consumed yet
+
+    uint32_t vlq;            // partial delta time or length
+    uint8_t  vlq_bytes;
+    uint32_t delta;
+    uint8_t  running_status;
+    uint8_t  status;         // of the event being collected
+    uint8_t  meta_type;
+    uint8_t  data[2];
+    uint8_t  ndata;
+
+    uint8_t *payload;        // only used when a payload arrives split
+    size_t   payload_cap;
+    uint32_t payload_len;
+    uint32_t payload_got;
+
+    MIDI_stream_event sev;   // track, index and tick of the next event
+} MIDI_push;
+
+// ---------------------------------------------------
+
+void MIDI_push_init(MIDI_push *ps, MIDI_event_cb cb, void *user);
+void MIDI_push_free(MIDI_push *ps);
+
+// 1 while the data is fine so far, 0 on bad data or when the callback
+// asked to stop, later calls then fail straight away
+int  MIDI_push_feed(MIDI_push *ps, const uint8_t *bytes, size_t n);
+// at the end of the input, 1 only if every track was complete
+int  MIDI_push_finish(const MIDI_push *ps);
+
+#endif /* MIDI_PUSH_H */
@@ -0,0 +1,81 @@
+#ifndef MIDI_STATS_H
+#define MIDI_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// counters and timers for one conversion. they are only kept when the
+// library is built with MIDI_STATS defined (make STATS=1, the default),
+// otherwise every hook below compiles to nothing and the struct stays zero
+
+enum
+{
+    // channel kinds follow the status nibble, 0x8 to 0xE
+    MIDI_STAT_NOTE_OFF,
+    MIDI_STAT_NOTE_ON,
+    MIDI_STAT_POLY_PRESSURE,
+    MIDI_STAT_CONTROL,
+    MIDI_STAT_PROGRAM,
+    MIDI_STAT_CHANNEL_PRESSURE,
+    MIDI_STAT_PITCH_BEND,
+    MIDI_STAT_META,
+    MIDI_STAT_SYSEX,
+    MIDI_STAT_KINDS
+};
+
+typedef struct
+{
+    uint64_t bytes_read;       // track bytes decoded into events
+    uint64_t bytes_written;    // output bytes handed to the stream
+    uint64_t events[MIDI_STAT_KINDS];
+    uint64_t running_status;   // channel events without their own status byte
+    uint64_t skipped;          // events a parse filter stepped over
+    uint64_t grows;            // event array reallocations
+    uint64_t mallocs;          // heap requests, reallocations included
+    uint64_t malloc_bytes;
+} MIDI_stat_counts;
+
+typedef struct
+{
+    MIDI_stat_counts counts;
+    uint64_t  parse_ns;    // whole parse, cache lookups included
+    uint64_t  json_ns;     // whole JSON write
+    uint64_t *track_ns;    // decode time of each track, ntracks entries
+    uint16_t  ntracks;
+} MIDI_stats;
+
+// ---------------------------------------------------
+
+void MIDI_stats_free(MIDI_stats *st);
+// plain text, or one JSON object when json is set
+void MIDI_stats_print(const MIDI_stats *st, FILE *fp, int json);
+// zero when the hooks were compiled out
+int  MIDI_stats_enabled(void);
+
+// ---------------------------------------------------
+
+// hooks for the library itself. tallies are per thread so the hot path
+// never touches shared memory, they reach a MIDI_stats on flush
+#ifdef MIDI_STATS
+
+extern __thread MIDI_stat_counts MIDI_stat_tally;
+
+#define MIDI_STAT_ADD(field, n) ((void)(MIDI_stat_tally.field += (n)))
+#define MIDI_STAT_ALLOC(n) \
+    ((void)(MIDI_stat_tally.mallocs++, MIDI_stat_tally.malloc_bytes += (n)))
+
+uint64_t MIDI_stat_now(void);
+// adds the calling thread's tallies to st and clears them, st may be NULL
+void MIDI_stat_flush(MIDI_stats *st);
+// sizes st->track_ns for ntracks, zeroed
+int  MIDI_stat_tracks(MIDI_stats *st, uint16_t ntracks);
+
+#else
+
+#define MIDI_STAT_ADD(field, n) ((void)0)
+#define MIDI_STAT_ALLOC(n)      ((void)0)
+
+#endif
+
+#endif /* MIDI_STATS_H */
@@ -0,0 +1,27 @@
+#ifndef MIDI_WRITER_H
+#define MIDI_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+#include "out_buffer.h"
+
+// largest value a delta time or length VLQ can carry
+#define MIDI_VLQ_MAX 0x0FFFFFFFu
+
+// ---------------------------------------------------
+
+// SMF bytes of one track, chunk header included. channel events reuse the
+// previous status byte where they can, meta and sysex events reset it as
+// the spec asks. events are written as they are, no End of Track is added
+int write_MTrk_SMF(const MTrk *mtrk, Out_buffer *out);
+
+// the whole file: MThd with the header's raw division word, then every
+// track. returns 0 for events that can't be encoded (out of range
+// parameters, a payload without data, a track over 4 GiB)
+int write_MIDI_to_SMF_buffer(const MIDI_file *midi, Out_buffer *out);
+int write_MIDI_file(const MIDI_file *midi, FILE *fp);
+int write_MIDI_file_path(const MIDI_file *midi, const char *filename);
+
+#endif /* MIDI_WRITER_H */
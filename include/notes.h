@@ -0,0 +1,76 @@
+#ifndef NOTES_H
+#define NOTES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+#define MIDI_NOTE_DEPTH   8             // open notes per channel and key
+#define MIDI_NOTES_MAGIC  0x4D4E4F54    // "MNOT"
+#define MIDI_NOTES_VERSION 1
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    uint64_t start;          // absolute tick of the Note On
+    uint64_t duration;       // ticks until the Note Off, or the pedal release
+    uint16_t track;
+    uint8_t  channel;
+    uint8_t  key;
+    uint8_t  velocity;
+    uint8_t  off_velocity;   // 0 when the note was cut short instead
+} MIDI_note;
+
+typedef struct
+{
+    MIDI_note *items;
+    size_t     count;
+    size_t     cap;
+} MIDI_note_list;
+
+typedef struct
+{
+    uint64_t start;
+    uint8_t  velocity;
+    uint8_t  off_velocity;
+    uint8_t  held;           // released while the pedal was down
+} Open_note;
+
+// pairs Note On with Note Off one event at a time. a Note On with velocity
+// 0 is a Note Off, overlapping notes on one key end first in first out,
+// and with sustain set a release under CC64 >= 64 waits for the pedal.
+// a key with MIDI_NOTE_DEPTH notes open ends its oldest one early
+typedef struct
+{
+    Open_note open[16][128][MIDI_NOTE_DEPTH];   // oldest first
+    uint8_t   count[16][128];
+    uint8_t   pedal[16];
+    uint16_t  track;
+    int       sustain;
+} MIDI_note_pairer;
+
+// ---------------------------------------------------
+
+// cheap to call again for the next track, the slots aren't cleared
+void MIDI_note_pairer_init(MIDI_note_pairer *p, uint16_t track, int sustain);
+int  MIDI_note_pairer_feed(MIDI_note_pairer *p, uint64_t tick, const MTrk_event *ev,
+                           MIDI_note_list *out);
+// ends everything still sounding at tick
+int  MIDI_note_pairer_flush(MIDI_note_pairer *p, uint64_t tick, MIDI_note_list *out);
+
+// spans come back sorted by start tick, then track, channel and key.
+// every track is paired on its own
+int  MIDI_notes_from_MTrk(const MTrk *mtrk, uint16_t track, int sustain,
+                          MIDI_note_list *out);
+int  MIDI_notes_from_file(const MIDI_file *midi, int sustain, MIDI_note_list *out);
+void MIDI_notes_sort(MIDI_note_list *list);
+void free_MIDI_note_list(MIDI_note_list *list);
+
+// piano roll as a fixed little-endian table: magic, version, count, then
+// 24 bytes per note (start u64, duration u64, track u16, channel, key,
+// velocity, off_velocity, 2 bytes of padding)
+int  write_MIDI_notes_binary(const MIDI_note_list *list, FILE *fp);
+
+#endif /* NOTES_H */
@@ -0,0 +1,123 @@
+#ifndef OUT_BUFFER_H
+#define OUT_BUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define OUT_BUFFER_SIZE (1 << 18)
+
+// ---------------------------------------------------
+
+// output staging area, bytes go to fp in large blocks or, when fp is
+// NULL, stay in memory and the buffer grows as needed
+typedef struct
+{
+    char   *data;
+    size_t  len;
+    size_t  cap;
+    FILE   *fp;
+    int     error;
+} Out_buffer;
+
+int   out_init_file(Out_buffer *out, FILE *fp);
+int   out_init_mem(Out_buffer *out, size_t initial);
+// returns 0 if anything failed since the buffer was set up
+int   out_flush(Out_buffer *out);
+void  out_free(Out_buffer *out);
+char *out_reserve_slow(Out_buffer *out, size_t n);
+
+// ---------------------------------------------------
+
+// room for n more bytes, commit them by advancing out->len
+static inline char *out_reserve(Out_buffer *out, size_t n)
+{
+    if (out->cap - out->len >= n) return out->data + out->len;
+    return out_reserve_slow(out, n);
+}
+
+static inline void out_write(Out_buffer *out, const void *src, size_t n)
+{
+    char *p = out_reserve(out, n);
+    if (!p) return;
+    memcpy(p, src, n);
+    out->len += n;
+}
+
+// string literals only, the length is taken at compile time
+#define out_lit(out, s) out_write((out), (s), sizeof(s) - 1)
+
+static inline void out_str(Out_buffer *out, const char *s)
+{
+    out_write(out, s, strlen(s));
+}
+
+static inline void out_char(Out_buffer *out, char c)
+{
+    char *p = out_reserve(out, 1);
+    if (!p) return;
+    *p = c;
+    out->len++;
+}
+
+static inline void out_u32(Out_buffer *out, uint32_t v)
+{
+    char tmp[10];
+    size_t n = 0;
+    do
+    {
+        tmp[9 - n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    out_write(out, tmp + 10 - n, n);
+}
+
+static inline void out_u64(Out_buffer *out, uint64_t v)
+{
+    char tmp[20];
+    size_t n = 0;
+    do
+    {
+        tmp[19 - n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    out_write(out, tmp + 20 - n, n);
+}
+
+static inline void out_i32(Out_buffer *out, int32_t v)
+{
+    if (v < 0)
+    {
+        out_char(out, '-');
+        out_u32(out, (uint32_t)0 - (uint32_t)v);
+    }
+    else out_u32(out, (uint32_t)v);
+}
+
+static const char out_hex_digits[] = "0123456789ABCDEF";
+
+// uppercase hex without leading zeros, like "%X"
+static inline void out_hex(Out_buffer *out, uint32_t v)
+{
+    char tmp[8];
+    size_t n = 0;
+    do
+    {
+        tmp[7 - n++] = out_hex_digits[v & 0xF];
+        v >>= 4;
+    } while (v);
+    out_write(out, tmp + 8 - n, n);
+}
+
+// exactly two uppercase hex digits, like "%02X"
+static inline void out_hex2(Out_buffer *out, uint8_t v)
+{
+    char *p = out_reserve(out, 2);
+    if (!p) return;
+    p[0] = out_hex_digits[v >> 4];
+    p[1] = out_hex_digits[v & 0xF];
+    out->len += 2;
+}
+
+#endif /* OUT_BUFFER_H */
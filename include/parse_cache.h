@@ -0,0 +1,52 @@
+#ifndef PARSE_CACHE_H
+#define PARSE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "midi_parser.h"
+
+#define MIDI_CACHE_DEFAULT_SIZE ((uint64_t) 256 << 20)
+#define MIDI_CACHE_STALE_TMP    3600    // seconds before a leftover temp file is removed
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+    uint64_t errors;      // entries that couldn't be written or read back
+} MIDI_cache_stats;
+
+// a directory of snapshots named by a 128 bit hash of the raw file.
+// entries are written to a temp file and renamed into place, so other
+// processes only ever see whole entries. a hit bumps the entry's mtime,
+// eviction drops the oldest ones once the directory outgrows max_bytes.
+// one handle can be shared by threads
+typedef struct MIDI_cache
+{
+    char            *dir;
+    uint64_t         max_bytes;
+    uint64_t         bytes;      // estimate, recounted whenever it goes over
+    uint64_t         tmp_seq;
+    MIDI_cache_stats stats;
+    pthread_mutex_t  lock;
+} MIDI_cache;
+
+// ---------------------------------------------------
+
+// creates dir if needed, max_bytes 0 picks the default
+int  MIDI_cache_open(MIDI_cache *cache, const char *dir, uint64_t max_bytes);
+void MIDI_cache_close(MIDI_cache *cache);
+void MIDI_cache_get_stats(MIDI_cache *cache, MIDI_cache_stats *stats);
+
+void MIDI_cache_key(const uint8_t *buf, size_t len, uint64_t key[2]);
+
+// 1 on a hit with the file in *midi, its payloads copied into arena
+int  MIDI_cache_lookup(MIDI_cache *cache, const uint64_t key[2],
+                       MIDI_file *midi, MIDI_arena *arena);
+int  MIDI_cache_store(MIDI_cache *cache, const uint64_t key[2], const MIDI_file *midi);
+
+#endif /* PARSE_CACHE_H */
@@ -0,0 +1,60 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+#define MIDI_SEEK_DEFAULT_INTERVAL 256
+#define MIDI_SEEK_MAGIC            0x4D534958    // "MSIX"
+#define MIDI_SEEK_VERSION          2
+
+// ---------------------------------------------------
+
+// enough MTrk_reader state to resume decoding a track at one event
+typedef struct
+{
+    uint32_t offset;           // byte of the event inside its chunk
+    uint32_t index;            // position of the event inside its track
+    uint64_t tick;             // absolute tick of the event before it
+    uint8_t  running_status;
+} MIDI_seek_point;
+
+// a point every `interval` events of every track, the first one at the
+// start of the chunk. points of track t are points[first[t]..first[t+1])
+typedef struct
+{
+    MThd             mthd;
+    uint64_t         len;       // size of the SMF image it was built from
+    uint64_t         key[2];    // content hash of that image, see MIDI_cache_key
+    uint32_t         interval;
+    MTrk_chunk      *chunks;
+    size_t          *first;     // ntracks + 1 entries
+    MIDI_seek_point *points;
+} MIDI_seek_index;
+
+// ---------------------------------------------------
+
+// one pass over every track, interval 0 picks the default
+int  MIDI_seek_index_build(MIDI_seek_index *idx, const uint8_t *buf, size_t len,
+                           uint32_t interval);
+void MIDI_seek_index_free(MIDI_seek_index *idx);
+
+// sidecar file, fixed little-endian layout. loading fails when the
+// index doesn't match the header, size and content hash of buf, so an
+// edit that keeps the size can't bring back stale offsets
+int  MIDI_seek_index_save(const MIDI_seek_index *idx, const char *path);
+int  MIDI_seek_index_load(MIDI_seek_index *idx, const char *path,
+                          const uint8_t *buf, size_t len);
+
+// the reader resumes at p, the next event it returns is the one p points at
+int  MIDI_seek_reader(const MIDI_seek_index *idx, const uint8_t *buf, uint16_t track,
+                      const MIDI_seek_point *p, MTrk_reader *rd);
+
+// calls cb for every event with from <= tick < to, track by track like
+// stream_MIDI_buffer, decoding only from the nearest point before from.
+// MIDI_tempo_map_tick turns a time range into ticks
+int  MIDI_seek_range(const MIDI_seek_index *idx, const uint8_t *buf,
+                     uint64_t from, uint64_t to, MIDI_event_cb cb, void *user);
+
+#endif /* SEEK_INDEX_H */
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+#define MIDI_SNAP_MAGIC    0x50414E53    // "SNAP" read as little-endian
+#define MIDI_SNAP_VERSION  1
+#define MIDI_SNAP_NO_DATA  0xFFFFFFFFu   // payload offset of a NULL data pointer
+
+// ---------------------------------------------------
+
+// the on-disk layout, little-endian with every field naturally aligned,
+// so a mapped file is used as is. header, then the track table, then
+// the events of all tracks back to back, then the payload blob
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint16_t fmt;
+    uint16_t ntracks;
+    uint16_t division;
+    uint16_t reserved;
+    uint64_t nevents;
+    uint64_t tracks_offset;
+    uint64_t events_offset;
+    uint64_t blob_offset;
+    uint64_t blob_size;
+    uint64_t file_size;
+} MIDI_snap_header;             // 64 bytes
+
+typedef struct
+{
+    uint32_t size;              // MTrk chunk size in the source file
+    uint32_t reserved;
+    uint64_t first;             // index of its first event
+    uint64_t count;
+} MIDI_snap_track;              // 24 bytes
+
+typedef struct
+{
+    uint32_t delta_time;
+    uint8_t  kind;              // Event_kind
+    uint8_t  type;              // channel nibble, meta type or sysex status
+    uint8_t  channel;
+    uint8_t  param1;
+    uint32_t arg;               // param2 of channel events, payload length otherwise
+    uint32_t offset;            // payload position in the blob
+} MIDI_snap_event;              // 16 bytes
+
+// a snapshot opened read-only, every pointer is into the mapping
+typedef struct
+{
+    MIDI_map                map;
+    const MIDI_snap_header *header;
+    const MIDI_snap_track  *tracks;
+    const MIDI_snap_event  *events;
+    const uint8_t          *blob;
+} MIDI_snapshot;
+
+// ---------------------------------------------------
+
+int write_MIDI_snapshot(const MIDI_file *midi, FILE *fp);
+int write_MIDI_snapshot_file(const MIDI_file *midi, const char *filename);
+
+// maps the file and checks every offset once, nothing is copied or
+// patched. fails on big-endian hosts, where the records can't be used as is
+int  open_MIDI_snapshot(const char *path, MIDI_snapshot *snap);
+void close_MIDI_snapshot(MIDI_snapshot *snap);
+
+// one event array per track. with an arena the payloads are copied into
+// it in one piece, with NULL they point into the mapping and the file
+// must be freed before the snapshot is closed
+int MIDI_snapshot_to_file(const MIDI_snapshot *snap, MIDI_file *midi, MIDI_arena *arena);
+
+#endif /* SNAPSHOT_H */
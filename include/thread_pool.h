@@ -0,0 +1,18 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// ---------------------------------------------------
+
+// task is the index in [0, ntasks), worker in [0, nthreads)
+typedef void (*pool_task_fn)(size_t task, unsigned worker, void *ctx);
+
+// runs fn once for every task index on up to nthreads threads, the
+// calling thread included, and returns when all of them are done.
+// workers start on even slices of the index range and steal from each
+// other when theirs runs dry, so uneven task costs still balance out.
+// with nthreads <= 1 the tasks run in order on the calling thread
+void parallel_for(size_t ntasks, unsigned nthreads, pool_task_fn fn, void *ctx);
+
+#endif /* THREAD_POOL_H */
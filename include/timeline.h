@@ -0,0 +1,73 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+#define MIDI_DEFAULT_TEMPO 500000    // microseconds per quarter note, 120 bpm
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    uint16_t          track;
+    size_t            index;    // position in midi->mtrk[track].events
+    uint64_t          tick;     // absolute, counted from the start of the track
+    uint64_t          usec;     // time since the start, tempo changes applied
+    const MTrk_event *event;
+} MIDI_timeline_event;
+
+// where the clock stood at the last tempo change
+typedef struct
+{
+    uint64_t tick;
+    uint64_t usec;
+    uint32_t tempo;
+} Timeline_clock;
+
+// k-way merge of every track of a parsed file, events come out ordered by
+// absolute tick, ties go to the lower track and then to file order.
+// format 2 tracks are independent songs, so each keeps its own tempo
+typedef struct
+{
+    const MIDI_file *midi;
+    size_t          *next;      // per track, index of its next event
+    uint64_t        *ticks;     // per track, absolute tick of that event
+    uint16_t        *heap;      // tracks with events left, min-heap on ticks
+    uint16_t         nheap;
+    Timeline_clock  *clocks;    // one, or one per track for format 2
+} MIDI_timeline;
+
+// every tempo change of a file, sorted by tick, each segment starting where
+// the clock stood at its change. segs[0] is always at tick 0. SMPTE files
+// have no tempo, their single segment is never read
+typedef struct
+{
+    const MThd     *mthd;
+    Timeline_clock *segs;
+    size_t          count;
+} MIDI_tempo_map;
+
+// ---------------------------------------------------
+
+int  MIDI_timeline_init(MIDI_timeline *tl, const MIDI_file *midi);
+// 1 with the next event in *out, 0 once every track is exhausted
+int  MIDI_timeline_next(MIDI_timeline *tl, MIDI_timeline_event *out);
+void MIDI_timeline_free(MIDI_timeline *tl);
+
+// tempo events of every track, or only those of `track` for format 2
+// files where each track keeps its own tempo. the map points at
+// midi->mthd, so it must not outlive the file
+int      MIDI_tempo_map_init(MIDI_tempo_map *map, const MIDI_file *midi, uint16_t track);
+void     MIDI_tempo_map_free(MIDI_tempo_map *map);
+uint64_t MIDI_tempo_map_usec(const MIDI_tempo_map *map, uint64_t tick);
+// the last tick that starts at or before usec
+uint64_t MIDI_tempo_map_tick(const MIDI_tempo_map *map, uint64_t usec);
+// n lookups at once, ascending input only walks forward from the last hit
+void     MIDI_tempo_map_usecs(const MIDI_tempo_map *map, const uint64_t *ticks,
+                              uint64_t *usecs, size_t n);
+void     MIDI_tempo_map_ticks(const MIDI_tempo_map *map, const uint64_t *usecs,
+                              uint64_t *ticks, size_t n);
+
+#endif /* TIMELINE_H */
@@ -0,0 +1,69 @@
+#ifndef VLQ_H
+#define VLQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MIDI_VLQ_MAX_BYTES 4
+
+// ---------------------------------------------------
+
+// one quantity, 1 to 4 bytes used, 0 when it's truncated or longer than
+// 4 bytes. single byte values, most delta times, skip the rest entirely;
+// longer ones find their last byte from one 32 bit load instead of
+// branching per byte
+static inline size_t MIDI_vlq_decode(const uint8_t *p, size_t avail, uint32_t *value)
+{
+    if (avail > 0 && p[0] < 0x80)
+    {
+        *value = p[0];
+        return 1;
+    }
+
+    if (avail >= MIDI_VLQ_MAX_BYTES)
+    {
+        uint32_t x = (uint32_t) p[0]       | (uint32_t) p[1] << 8 |
+                     (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+        uint32_t stop = ~x & 0x80808080u;
+        if (!stop) return 0;
+
+#if defined(__GNUC__)
+        size_t n = ((size_t) __builtin_ctz(stop) >> 3) + 1;
+#else
+        size_t n = 1;
+        while (!(stop & (0x80u << (8 * (n - 1))))) ++n;
+#endif
+        // all four groups as if n were 4, the shift drops the extra ones
+        uint32_t full = (x & 0x7Fu) << 21 | (x >> 8 & 0x7Fu) << 14 |
+                        (x >> 16 & 0x7Fu) << 7 | (x >> 24 & 0x7Fu);
+        *value = full >> (7 * (MIDI_VLQ_MAX_BYTES - n));
+        return n;
+    }
+
+    uint32_t v = 0;
+    for (size_t n = 0; n < avail; ++n)
+    {
+        v = (v << 7) | (p[n] & 0x7Fu);
+        if (p[n] < 0x80)
+        {
+            *value = v;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------
+
+// up to n back to back quantities from p, how many were decoded comes
+// back and *used gets the bytes they took. stops early at a malformed
+// one. picks the widest kernel the CPU has on first use
+size_t MIDI_vlq_decode_many(const uint8_t *p, size_t len, uint32_t *out, size_t n,
+                            size_t *used);
+// the same without SIMD, for comparison
+size_t MIDI_vlq_decode_many_scalar(const uint8_t *p, size_t len, uint32_t *out, size_t n,
+                                   size_t *used);
+// "avx2", "sse2" or "scalar"
+const char *MIDI_vlq_kernel(void);
+
+#endif /* VLQ_H */
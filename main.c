@@ -1,52 +1,633 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
 #include "include/midi_parser.h"
 #include "include/json_generator.h"
+#include "include/batch.h"
+#include "include/midi_lazy.h"
+#include "include/notes.h"
+#include "include/snapshot.h"
+#include "include/midi_writer.h"
+#include "include/json_reader.h"
+#include "include/midi_follow.h"
+#include "include/columnar.h"
 
-int main(int argc, char **argv)
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] <input_midi_file> <output_json_file>\n", prog);
+    printf("       %s [options] --batch <dir|list|-> [-o <output_dir>]\n", prog);
+    printf("       %s --info <input_midi_file>\n", prog);
+    printf("Options:\n");
+    printf("  -j, --threads <n>  decode and render tracks on <n> threads (default 1)\n");
+    printf("  -s, --stream       convert event by event without building tracks,\n");
+    printf("                     JSON output only, not with --skip or --cache,\n");
+    printf("                     with --ndjson an input of '-' is read from stdin\n");
+    printf("                     and converted as it arrives\n");
+    printf("  -c, --compact      write JSON without whitespace\n");
+    printf("  -n, --ndjson       write one JSON object per line and event\n");
+    printf("  -t, --timeline     write all tracks merged in time order, with ticks\n");
+    printf("                     and microseconds from the start\n");
+    printf("  -p, --notes        write paired note spans (a piano roll) instead of events\n");
+    printf("      --notes-bin    same spans as a binary table instead of JSON\n");
+    printf("      --sustain      let CC64 hold released notes until the pedal is up\n");
+    printf("  -m, --midi         write a Standard MIDI File instead of JSON\n");
+    printf("      --columns <fmt> write channel, meta and tempo tables as csv or arrow,\n");
+    printf("                     to <output>.channel.<fmt> and so on\n");
+    printf("      --snapshot     write a binary snapshot that loads back without parsing,\n");
+    printf("                     snapshots are accepted as input wherever MIDI files are\n");
+    printf("                     and so is JSON this tool wrote, e.g. with -m to get SMF\n");
+    printf("      --cache <dir>  reuse parses of identical files across runs, keyed\n");
+    printf("                     by content, shared safely between processes,\n");
+    printf("                     not with --stream, which never builds a parse\n");
+    printf("      --cache-size <mb>  evict least recently used entries past this\n");
+    printf("                     size (default 256)\n");
+    printf("  -b, --batch <src>  convert every file in a directory, a list file or\n");
+    printf("                     the paths read from stdin ('-'), one per thread\n");
+    printf("  -o, --out-dir <d>  where batch mode writes its JSON files\n");
+    printf("  -i, --info         print the header and track names, decode nothing\n");
+    printf("  -f, --follow       parse a file that is still being recorded as it\n");
+    printf("                     grows, until its last track ends\n");
+    printf("      --skip <list>  leave events out of the parse, comma separated:\n");
+    printf("                     channel, meta, sysex, meta:<type>, ch:<0-15> or\n");
+    printf("                     msg:<status nibble>, e.g. --skip sysex,meta:0x05\n");
+    printf("      --stats[=json] print counters and timings of the parse and the\n");
+    printf("                     JSON write, as text or as one JSON object\n");
+    exit(1);
+}
+
+static void print_header(const MThd *mthd)
 {
-    if (argc != 3)
+    printf("  Format: %u\n", mthd->fmt);
+    printf("  Tracks: %u\n", mthd->ntracks);
+    if (!(mthd->division & 0x8000))
+        printf("  Ticks per beat: %u\n", mthd->timediv.ticks_per_beat);
+    else
+        printf("  SMPTE: %d, Ticks per frame: %u\n",
+               mthd->timediv.frames_per_sec.smpte,
+               mthd->timediv.frames_per_sec.ticks);
+}
+
+// fills f from the --skip list, 0 on an item it doesn't know
+static int parse_skip_list(char *list, MIDI_event_filter *f)
+{
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
     {
-        printf("Usage: %s <input_midi_file> <output_json_file>\n", argv[0]);
-        exit(1);
+        char *end;
+        long v;
+        if (!strcmp(item, "channel"))
+            f->skip_kinds |= 1u << CH;
+        else if (!strcmp(item, "meta"))
+            f->skip_kinds |= 1u << META;
+        else if (!strcmp(item, "sysex"))
+            f->skip_kinds |= 1u << SYS;
+        else if (!strncmp(item, "meta:", 5))
+        {
+            v = strtol(item + 5, &end, 0);
+            if (end == item + 5 || *end || v < 0 || v > 0xFF) return 0;
+            MIDI_FILTER_SKIP_META(f, v);
+        }
+        else if (!strncmp(item, "ch:", 3))
+        {
+            v = strtol(item + 3, &end, 0);
+            if (end == item + 3 || *end || v < 0 || v > 15) return 0;
+            f->skip_channels |= (uint16_t)(1u << v);
+        }
+        else if (!strncmp(item, "msg:", 4))
+        {
+            v = strtol(item + 4, &end, 0);
+            if (end == item + 4 || *end || v < 0x8 || v > 0xE) return 0;
+            f->skip_messages |= (uint16_t)(1u << v);
+        }
+        else return 0;
     }
+    return 1;
+}
+
+// polls the file until its last track has ended, each pass only parses
+// what the recorder appended since the one before
+static int follow_MIDI_path(const char *input, MIDI_file *midi)
+{
+    MIDI_follow fw;
+    if (!MIDI_follow_open(&fw, input)) return 0;
 
-    FILE *fp = fopen(argv[1], "rb");
-    if (!fp)
+    size_t total = 0;
+    while (!MIDI_follow_done(&fw))
     {
-        printf("Error: Could not open MIDI file '%s'\n", argv[1]);
-        exit(1);
+        size_t added;
+        if (!MIDI_follow_update(&fw, &added))
+        {
+            MIDI_follow_close(&fw);
+            return 0;
+        }
+        if (added)
+        {
+            total += added;
+            printf("  Following: track %u, %zu events\n", fw.track, total);
+        }
+
+        struct timespec nap = { 0, 100 * 1000000L };
+        if (!MIDI_follow_done(&fw)) nanosleep(&nap, NULL);
+    }
+
+    *midi = MIDI_follow_take(&fw);
+    return 1;
+}
+
+static void print_cache_stats(MIDI_cache *cache)
+{
+    MIDI_cache_stats st;
+    MIDI_cache_get_stats(cache, &st);
+    printf("  Cache: %llu hits, %llu misses, %llu stored, %llu evicted, %llu errors\n",
+           (unsigned long long) st.hits, (unsigned long long) st.misses,
+           (unsigned long long) st.stores, (unsigned long long) st.evictions,
+           (unsigned long long) st.errors);
+}
+
+static int convert_batch(const char *src, const char *out_dir, unsigned nthreads,
+                         const JSON_writer_opts *jopts, MIDI_cache *cache)
+{
+    MIDI_path_list list;
+    if (!collect_MIDI_paths(src, &list))
+    {
+        printf("Error: Could not read the file list '%s'\n", src);
+        return 1;
     }
 
-    int status;
-    MIDI_file midi = get_MIDI_file(fp, &status);
+    MIDI_batch_opts bopts;
+    memset(&bopts, 0, sizeof(bopts));
+    bopts.out_dir  = out_dir;
+    bopts.nthreads = nthreads;
+    bopts.json     = *jopts;
+    bopts.cache    = cache;
+
+    MIDI_batch_stats stats;
+    int ok = run_MIDI_batch(&list, &bopts, &stats);
+    free_MIDI_path_list(&list);
+    if (!ok)
+    {
+        printf("Error: Could not start the batch\n");
+        return 1;
+    }
+
+    double secs = stats.seconds > 0 ? stats.seconds : 1e-9;
+    printf("Converted %zu of %zu files in %.3f s\n",
+           stats.files - stats.failed, stats.files, stats.seconds);
+    printf("  %.1f files/s, %.2f MB/s, %.0f events/s\n",
+           (double)(stats.files - stats.failed) / secs,
+           (double) stats.bytes / 1e6 / secs,
+           (double) stats.events / secs);
+    if (cache) print_cache_stats(cache);
+    return stats.failed ? 1 : 0;
+}
+
+typedef struct
+{
+    const char *name;
+    uint32_t    len;
+} Track_name;
+
+// names come before the first timed event, anything later isn't one
+static int find_track_name(const MIDI_stream_event *sev, void *user)
+{
+    Track_name *tn = (Track_name*) user;
+    if (sev->tick > 0) return 0;
+
+    const MTrk_event *ev = &sev->event;
+    if (ev->kind == META && ev->ev.meta_ev.type == 0x03)
+    {
+        tn->name = (const char*) ev->ev.meta_ev.data;
+        tn->len  = ev->ev.meta_ev.len;
+        return 0;
+    }
+    return 1;
+}
+
+static int print_info(const char *input)
+{
+    MIDI_lazy lz;
+    if (!MIDI_lazy_open_path(&lz, input, 0))
+    {
+        printf("Error: Failed to parse MIDI file\n");
+        return 1;
+    }
+
+    printf("MIDI file %s:\n", input);
+    print_header(&lz.mthd);
+    for (uint16_t i = 0; i < lz.mthd.ntracks; ++i)
+    {
+        Track_name tn = { NULL, 0 };
+        MIDI_lazy_stream_track(&lz, i, find_track_name, &tn);
+        printf("  Track %u: %u bytes", i, lz.chunks[i].size);
+        if (tn.name) printf(", \"%.*s\"", (int) tn.len, tn.name);
+        printf("\n");
+    }
+
+    MIDI_lazy_close(&lz);
+    return 0;
+}
+
+static int write_notes_binary(const MIDI_file *midi, const char *output, int sustain)
+{
+    MIDI_note_list notes = { NULL, 0, 0 };
+    int ok = MIDI_notes_from_file(midi, sustain, &notes);
+
+    FILE *fp = ok ? fopen(output, "wb") : NULL;
+    ok = fp && write_MIDI_notes_binary(&notes, fp);
+    if (fp && fclose(fp) != 0) ok = 0;
+
+    if (ok) printf("  Notes: %zu\n", notes.count);
+    free_MIDI_note_list(&notes);
+    return ok;
+}
+
+// one file per table, named after the output with the table and format
+static int write_columns(const MIDI_file *midi, const char *output, int arrow)
+{
+    MIDI_tables tables;
+    if (!MIDI_tables_from_file(midi, &tables)) return 0;
+
+    const MIDI_table *list[3] = { &tables.channel, &tables.meta, &tables.tempo };
+    int ok = 1;
+    for (int i = 0; i < 3 && ok; ++i)
+    {
+        char path[4096];
+        int n = snprintf(path, sizeof path, "%s.%s.%s", output, list[i]->name,
+                         arrow ? "arrow" : "csv");
+        FILE *fp = n > 0 && (size_t) n < sizeof path ? fopen(path, "wb") : NULL;
+        ok = fp && (arrow ? write_MIDI_table_arrow(list[i], fp) : write_MIDI_table_csv(list[i], fp));
+        if (fp && fclose(fp) != 0) ok = 0;
+        if (ok) printf("  %s: %zu rows in %s\n", list[i]->name, list[i]->rows, path);
+    }
+
+    free_MIDI_tables(&tables);
+    return ok;
+}
+
+// JSON written by this tool reads back in place of a MIDI file
+static int is_JSON_file(const char *path)
+{
+    uint8_t head[64];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+    size_t n = fread(head, 1, sizeof head, fp);
     fclose(fp);
+    return MIDI_JSON_sniff(head, n);
+}
+
+static int convert_stream(const char *input, const char *output,
+                          const JSON_writer_opts *jopts, int stats_json)
+{
+    MIDI_map map;
+    if (!open_MIDI_map(input, &map))
+    {
+        printf("Error: Could not open MIDI file '%s'\n", input);
+        return 1;
+    }
 
-    if (status != 0)
+    MThd mthd;
+    MIDI_cursor cur = { map.buf, map.len, 0 };
+    if (!check_for_MThd(&mthd, &cur))
     {
         printf("Error: Failed to parse MIDI file\n");
+        close_MIDI_map(&map);
+        return 1;
+    }
+
+    printf("Streaming MIDI file:\n");
+    print_header(&mthd);
+
+    FILE *fp = fopen(output, "w");
+    int ok = fp && write_MIDI_buffer_to_JSON_opts(map.buf, map.len, fp, jopts);
+    if (fp && fclose(fp) != 0) ok = 0;
+    close_MIDI_map(&map);
+
+    if (!ok)
+    {
+        printf("Error: Failed to write JSON file\n");
+        return 1;
+    }
+
+    printf("Successfully generated JSON file: %s\n", output);
+    if (jopts->stats) MIDI_stats_print(jopts->stats, stdout, stats_json);
+    return 0;
+}
+
+// stdin can't be mapped, so events are parsed and written as they arrive
+static int convert_pipe(const char *output, const JSON_writer_opts *jopts, int stats_json)
+{
+    FILE *fp = fopen(output, "w");
+    int ok = fp && write_MIDI_stream_to_NDJSON(stdin, fp, jopts);
+    if (fp && fclose(fp) != 0) ok = 0;
+
+    if (!ok)
+    {
+        printf("Error: Failed to convert MIDI stream\n");
+        return 1;
+    }
+
+    printf("Successfully generated JSON file: %s\n", output);
+    if (jopts->stats) MIDI_stats_print(jopts->stats, stdout, stats_json);
+    return 0;
+}
+
+// every output that succeeds ends here, so --stats is printed whatever
+// was written
+static int finish_stats(MIDI_stats *stats, int want_stats, int stats_json)
+{
+    if (want_stats) MIDI_stats_print(stats, stdout, stats_json);
+    MIDI_stats_free(stats);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    MIDI_parse_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    JSON_writer_opts jopts;
+    memset(&jopts, 0, sizeof(jopts));
+
+    const char *input = NULL, *output = NULL;
+    const char *batch = NULL, *out_dir = NULL, *cache_dir = NULL;
+    uint64_t cache_size = 0;
+    int stream = 0, info = 0, notes_bin = 0, snapshot = 0, smf = 0, columns = 0;
+    int want_stats = 0, stats_json = 0, follow = 0;
+    MIDI_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    MIDI_event_filter filter;
+    memset(&filter, 0, sizeof(filter));
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--threads"))
+        {
+            if (++i == argc) usage(argv[0]);
+            int n = atoi(argv[i]);
+            if (n < 1) usage(argv[0]);
+            opts.nthreads  = (unsigned)n;
+            jopts.nthreads = (unsigned)n;
+        }
+        else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--stream"))
+            stream = 1;
+        else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compact"))
+            jopts.style = JSON_COMPACT;
+        else if (!strcmp(argv[i], "-n") || !strcmp(argv[i], "--ndjson"))
+            jopts.style = JSON_NDJSON;
+        else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--timeline"))
+            jopts.timeline = 1;
+        else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--notes"))
+            jopts.notes = 1;
+        else if (!strcmp(argv[i], "--notes-bin"))
+            notes_bin = 1;
+        else if (!strcmp(argv[i], "--columns"))
+        {
+            if (++i == argc) usage(argv[0]);
+            if (!strcmp(argv[i], "csv"))        columns = 1;
+            else if (!strcmp(argv[i], "arrow")) columns = 2;
+            else usage(argv[0]);
+        }
+        else if (!strcmp(argv[i], "--snapshot"))
+            snapshot = 1;
+        else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--midi"))
+            smf = 1;
+        else if (!strcmp(argv[i], "--cache"))
+        {
+            if (++i == argc) usage(argv[0]);
+            cache_dir = argv[i];
+        }
+        else if (!strcmp(argv[i], "--cache-size"))
+        {
+            if (++i == argc) usage(argv[0]);
+            int mb = atoi(argv[i]);
+            if (mb < 1) usage(argv[0]);
+            cache_size = (uint64_t) mb << 20;
+        }
+        else if (!strcmp(argv[i], "--sustain"))
+            jopts.sustain = 1;
+        else if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--info"))
+            info = 1;
+        else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--follow"))
+            follow = 1;
+        else if (!strcmp(argv[i], "--skip"))
+        {
+            if (++i == argc || !parse_skip_list(argv[i], &filter)) usage(argv[0]);
+            opts.filter = &filter;
+        }
+        else if (!strcmp(argv[i], "--stats"))
+            want_stats = 1;
+        else if (!strcmp(argv[i], "--stats=json"))
+            want_stats = stats_json = 1;
+        else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--batch"))
+        {
+            if (++i == argc) usage(argv[0]);
+            batch = argv[i];
+        }
+        else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--out-dir"))
+        {
+            if (++i == argc) usage(argv[0]);
+            out_dir = argv[i];
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+            usage(argv[0]);
+        else if (!input)  input  = argv[i];
+        else if (!output) output = argv[i];
+        else usage(argv[0]);
+    }
+    if (want_stats)
+    {
+        opts.stats  = &stats;
+        jopts.stats = &stats;
+    }
+
+    // the stream converters only write JSON and never build a MIDI_file
+    // to cache, filter or write out in another format
+    if (stream && (cache_dir || opts.filter || notes_bin || snapshot || smf || columns))
+        usage(argv[0]);
+
+    MIDI_cache cache;
+    if (cache_dir)
+    {
+        if (!MIDI_cache_open(&cache, cache_dir, cache_size))
+        {
+            printf("Error: Could not open cache directory '%s'\n", cache_dir);
+            return 1;
+        }
+        opts.cache = &cache;
+    }
+
+    if (batch)
+    {
+        if (input || stream || want_stats || opts.filter || follow) usage(argv[0]);
+        int rc = convert_batch(batch, out_dir, opts.nthreads, &jopts, opts.cache);
+        if (opts.cache) MIDI_cache_close(&cache);
+        return rc;
+    }
+    if (info)
+    {
+        if (!input || output) usage(argv[0]);
+        if (opts.cache) MIDI_cache_close(&cache);
+        return print_info(input);
+    }
+    if (!input || !output) usage(argv[0]);
+
+    if (!strcmp(input, "-"))
+    {
+        if (!stream || jopts.style != JSON_NDJSON || follow || jopts.timeline || jopts.notes)
+            usage(argv[0]);
+        int rc = convert_pipe(output, &jopts, stats_json);
+        MIDI_stats_free(&stats);
+        return rc;
+    }
+
+    if (access(input, R_OK) != 0)
+    {
+        printf("Error: Could not open MIDI file '%s'\n", input);
         exit(1);
     }
 
-    printf("Successfully parsed MIDI file:\n");
-    printf("  Format: %u\n", midi.mthd.fmt);
-    printf("  Tracks: %u\n", midi.mthd.ntracks);
-    if (midi.mthd.fmt <= 1)
-        printf("  Ticks per beat: %u\n", midi.mthd.timediv.ticks_per_beat);
+    // a snapshot is used in place, its payloads stay in the mapping
+    MIDI_snapshot snap;
+    int from_snap = !follow && open_MIDI_snapshot(input, &snap);
+
+    MIDI_file midi;
+    if (follow)
+    {
+        if (stream || opts.filter || opts.cache) usage(argv[0]);
+        if (!follow_MIDI_path(input, &midi))
+        {
+            printf("Error: Failed to parse MIDI file\n");
+            exit(1);
+        }
+
+        printf("Successfully followed MIDI file:\n");
+        print_header(&midi.mthd);
+    }
+    else if (from_snap)
+    {
+        if (!MIDI_snapshot_to_file(&snap, &midi, NULL))
+        {
+            printf("Error: Failed to load snapshot\n");
+            exit(1);
+        }
+
+        printf("Successfully loaded snapshot:\n");
+        print_header(&midi.mthd);
+        printf("  Events: %llu, payload bytes: %llu\n",
+               (unsigned long long) snap.header->nevents,
+               (unsigned long long) snap.header->blob_size);
+    }
+    else if (is_JSON_file(input))
+    {
+        int status;
+        midi = get_MIDI_JSON_path(input, &status);
+        if (status != 0)
+        {
+            printf("Error: Failed to read JSON file\n");
+            exit(1);
+        }
+
+        printf("Successfully read JSON file:\n");
+        print_header(&midi.mthd);
+    }
     else
-        printf("  SMPTE: %d, Ticks per frame: %u\n", 
-               midi.mthd.timediv.frames_per_sec.smpte,
-               midi.mthd.timediv.frames_per_sec.ticks);
+    {
+        if (stream)
+        {
+            int rc = convert_stream(input, output, &jopts, stats_json);
+            MIDI_stats_free(&stats);
+            return rc;
+        }
 
-    if (!write_MIDI_to_JSON_file(&midi, argv[2]))
+        int status;
+        midi = get_MIDI_path_opts(input, &opts, &status);
+
+        if (status != 0)
+        {
+            printf("Error: Failed to parse MIDI file\n");
+            exit(1);
+        }
+
+        printf("Successfully parsed MIDI file:\n");
+        print_header(&midi.mthd);
+        printf("  Payloads: %zu (%zu bytes) in %zu allocations\n",
+               midi.arena.nallocs, midi.arena.bytes, midi.arena.nblocks);
+        if (opts.cache) print_cache_stats(opts.cache);
+    }
+
+    // whatever the input was, it's loaded and the cache has done its part
+    if (opts.cache) MIDI_cache_close(&cache);
+
+    if (snapshot)
+    {
+        int ok = write_MIDI_snapshot_file(&midi, output);
+        free_MIDI_file(&midi);
+        if (from_snap) close_MIDI_snapshot(&snap);
+        if (!ok)
+        {
+            printf("Error: Failed to write snapshot\n");
+            exit(1);
+        }
+
+        printf("Successfully generated snapshot: %s\n", output);
+        return finish_stats(&stats, want_stats, stats_json);
+    }
+
+    if (columns)
+    {
+        int ok = write_columns(&midi, output, columns == 2);
+        free_MIDI_file(&midi);
+        if (from_snap) close_MIDI_snapshot(&snap);
+        if (!ok)
+        {
+            printf("Error: Failed to write tables\n");
+            exit(1);
+        }
+
+        printf("Successfully generated tables: %s.*\n", output);
+        return finish_stats(&stats, want_stats, stats_json);
+    }
+
+    if (smf)
+    {
+        int ok = write_MIDI_file_path(&midi, output);
+        free_MIDI_file(&midi);
+        if (from_snap) close_MIDI_snapshot(&snap);
+        if (!ok)
+        {
+            printf("Error: Failed to write MIDI file\n");
+            exit(1);
+        }
+
+        printf("Successfully generated MIDI file: %s\n", output);
+        return finish_stats(&stats, want_stats, stats_json);
+    }
+
+    if (notes_bin)
+    {
+        if (!write_notes_binary(&midi, output, jopts.sustain))
+        {
+            printf("Error: Failed to write notes file\n");
+            free_MIDI_file(&midi);
+            exit(1);
+        }
+
+        printf("Successfully generated notes file: %s\n", output);
+        free_MIDI_file(&midi);
+        if (from_snap) close_MIDI_snapshot(&snap);
+        return finish_stats(&stats, want_stats, stats_json);
+    }
+
+    if (!write_MIDI_to_JSON_file_opts(&midi, output, &jopts))
     {
         printf("Error: Failed to write JSON file\n");
         free_MIDI_file(&midi);
         exit(1);
     }
 
-    printf("Successfully generated JSON file: %s\n", argv[2]);
-
+    printf("Successfully generated JSON file: %s\n", output);
     free_MIDI_file(&midi);
-    return 0;
+    if (from_snap) close_MIDI_snapshot(&snap);
+    return finish_stats(&stats, want_stats, stats_json);
 }
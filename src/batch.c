@@ -0,0 +1,395 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "thread_pool.h"
+
+// ---------------------------------------------------
+
+static int push_path(MIDI_path_list *list, const char *path, size_t name)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        MIDI_path *items = (MIDI_path*) realloc(list->items, sizeof(MIDI_path) * cap);
+        if (!items) return 0;
+        list->items = items;
+        list->cap   = cap;
+    }
+
+    size_t n = strlen(path);
+    char *copy = (char*) malloc(n + 1);
+    if (!copy) return 0;
+    memcpy(copy, path, n + 1);
+
+    list->items[list->count].path = copy;
+    list->items[list->count].name = name;
+    list->count++;
+    return 1;
+}
+
+static int has_MIDI_extension(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    if (!dot) return 0;
+
+    char ext[8];
+    size_t n = strlen(dot + 1);
+    if (n == 0 || n >= sizeof(ext)) return 0;
+    for (size_t i = 0; i <= n; ++i)
+    {
+        char c = dot[1 + i];
+        ext[i] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    return !strcmp(ext, "mid") || !strcmp(ext, "midi") || !strcmp(ext, "smf");
+}
+
+// root is the length of the top directory, output names start after it
+static int walk_dir(const char *dir, size_t root, MIDI_path_list *list)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        fprintf(stderr, "Warning: Could not open directory '%s'\n", dir);
+        return 1;
+    }
+
+    int fine = 1;
+    size_t dlen = strlen(dir);
+    struct dirent *ent;
+    while (fine && (ent = readdir(d)) != NULL)
+    {
+        const char *name = ent->d_name;
+        if (name[0] == '.') continue;
+
+        size_t nlen = strlen(name);
+        char *path = (char*) malloc(dlen + nlen + 2);
+        if (!path) { fine = 0; break; }
+        memcpy(path, dir, dlen);
+        path[dlen] = '/';
+        memcpy(path + dlen + 1, name, nlen + 1);
+
+        // symlinked directories are skipped, they could loop back up the
+        // tree. symlinked files are followed
+        struct stat st;
+        int found = lstat(path, &st) == 0;
+        if (found && S_ISLNK(st.st_mode))
+            found = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+        if (found)
+        {
+            if (S_ISDIR(st.st_mode))
+                fine = walk_dir(path, root, list);
+            else if (S_ISREG(st.st_mode) && has_MIDI_extension(name))
+                fine = push_path(list, path, root);
+        }
+        free(path);
+    }
+
+    closedir(d);
+    return fine;
+}
+
+// lines of any length, getline grows the buffer as needed
+static int read_path_lines(FILE *fp, MIDI_path_list *list)
+{
+    char   *line = NULL;
+    size_t  cap  = 0;
+    ssize_t got;
+    int     fine = 1;
+    while (fine && (got = getline(&line, &cap, fp)) >= 0)
+    {
+        size_t n = (size_t) got;
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+            line[--n] = '\0';
+        if (n == 0 || line[0] == '#') continue;
+
+        const char *slash = strrchr(line, '/');
+        size_t name = slash ? (size_t)(slash - line) + 1 : 0;
+        fine = push_path(list, line, name);
+    }
+    free(line);
+    return fine && !ferror(fp);
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(((const MIDI_path*) a)->path, ((const MIDI_path*) b)->path);
+}
+
+int collect_MIDI_paths(const char *src, MIDI_path_list *list)
+{
+    if (!src || !list) return 0;
+    memset(list, 0, sizeof(MIDI_path_list));
+
+    int fine;
+    struct stat st;
+    if (!strcmp(src, "-"))
+    {
+        fine = read_path_lines(stdin, list);
+    }
+    else if (stat(src, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        size_t root = strlen(src);
+        while (root > 1 && src[root - 1] == '/') --root;
+        fine = walk_dir(src, root + 1, list);
+    }
+    else
+    {
+        FILE *fp = fopen(src, "r");
+        if (!fp) return 0;
+        fine = read_path_lines(fp, list);
+        fclose(fp);
+    }
+
+    if (!fine)
+    {
+        free_MIDI_path_list(list);
+        return 0;
+    }
+
+    qsort(list->items, list->count, sizeof(MIDI_path), compare_paths);
+    return 1;
+}
+
+void free_MIDI_path_list(MIDI_path_list *list)
+{
+    if (!list) return;
+
+    for (size_t i = 0; i < list->count; ++i) free(list->items[i].path);
+    free(list->items);
+    memset(list, 0, sizeof(MIDI_path_list));
+}
+
+// ---------------------------------------------------
+
+// everything a worker keeps between files
+typedef struct
+{
+    MIDI_arena       arena;
+    Out_buffer       out;
+    MIDI_batch_stats stats;
+    char            *name;
+    size_t           name_cap;
+} Batch_worker;
+
+typedef struct
+{
+    const MIDI_path_list  *list;
+    const MIDI_batch_opts *opts;
+    Batch_worker          *workers;
+    const uint8_t         *clash;     // per file, its output name is taken twice
+} Batch_job;
+
+// out_dir/<name without extension>.json, subdirectories turn into '_'.
+// the result lives in *buf, grown as needed
+static const char *output_name(char **buf, size_t *cap, const char *dir,
+                               const char *name, JSON_style style)
+{
+    const char *ext = style == JSON_NDJSON ? ".ndjson" : ".json";
+    const char *dot = strrchr(name, '.');
+    size_t nlen = dot && !strchr(dot, '/') ? (size_t)(dot - name) : strlen(name);
+    size_t dlen = strlen(dir);
+    size_t need = dlen + 1 + nlen + strlen(ext) + 1;
+
+    if (need > *cap)
+    {
+        char *tmp = (char*) realloc(*buf, need);
+        if (!tmp) return NULL;
+        *buf = tmp;
+        *cap = need;
+    }
+
+    char *p = *buf;
+    memcpy(p, dir, dlen);
+    p += dlen;
+    *p++ = '/';
+    for (size_t i = 0; i < nlen; ++i)
+        *p++ = name[i] == '/' ? '_' : name[i];
+    strcpy(p, ext);
+    return *buf;
+}
+
+typedef struct
+{
+    char  *name;
+    size_t file;
+} Batch_output;
+
+static int compare_outputs(const void *a, const void *b)
+{
+    return strcmp(((const Batch_output*) a)->name, ((const Batch_output*) b)->name);
+}
+
+// a/x.mid and b/x.mid, a/x.mid and a_x.mid, or x.mid and x.midi all end up
+// with the same output name. every file sharing a name is flagged, so none
+// of them silently overwrites another. NULL when out of memory
+static uint8_t *find_output_clashes(const MIDI_path_list *list, const MIDI_batch_opts *opts)
+{
+    uint8_t      *clash = (uint8_t*) calloc(list->count ? list->count : 1, 1);
+    Batch_output *outs  = (Batch_output*) calloc(list->count ? list->count : 1, sizeof(Batch_output));
+    int fine = clash && outs;
+
+    for (size_t i = 0; i < list->count && fine; ++i)
+    {
+        size_t cap = 0;
+        outs[i].file = i;
+        fine = output_name(&outs[i].name, &cap, opts->out_dir,
+                           list->items[i].path + list->items[i].name,
+                           opts->json.style) != NULL;
+    }
+
+    if (fine)
+    {
+        qsort(outs, list->count, sizeof(Batch_output), compare_outputs);
+        for (size_t i = 1; i < list->count; ++i)
+            if (!strcmp(outs[i - 1].name, outs[i].name))
+                clash[outs[i - 1].file] = clash[outs[i].file] = 1;
+    }
+
+    if (outs)
+        for (size_t i = 0; i < list->count; ++i) free(outs[i].name);
+    free(outs);
+    if (!fine)
+    {
+        free(clash);
+        return NULL;
+    }
+    return clash;
+}
+
+static int write_whole_file(const char *path, const char *data, size_t len)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) return 0;
+
+    int ok = fwrite(data, 1, len, fp) == len;
+    if (fclose(fp) != 0) ok = 0;
+    return ok;
+}
+
+static void batch_task(size_t task, unsigned worker, void *ctx)
+{
+    Batch_job       *job  = (Batch_job*) ctx;
+    Batch_worker    *w    = &job->workers[worker];
+    const MIDI_path *item = &job->list->items[task];
+    const char      *path = item->path;
+
+    w->stats.files++;
+
+    if (job->clash && job->clash[task])
+    {
+        fprintf(stderr, "Error: Output name of '%s' is shared with another file\n", path);
+        w->stats.failed++;
+        return;
+    }
+
+    MIDI_map map;
+    if (!open_MIDI_map(path, &map))
+    {
+        fprintf(stderr, "Error: Could not open MIDI file '%s'\n", path);
+        w->stats.failed++;
+        return;
+    }
+
+    // the worker's arena takes the payloads, it's emptied after every file
+    MIDI_parse_opts popts;
+    memset(&popts, 0, sizeof(popts));
+    popts.arena = &w->arena;
+    popts.cache = job->opts->cache;
+
+    int status;
+    MIDI_file midi = get_MIDI_buffer_opts(map.buf, map.len, &popts, &status);
+    if (status != 0)
+    {
+        fprintf(stderr, "Error: Failed to parse MIDI file '%s'\n", path);
+        w->stats.failed++;
+        close_MIDI_map(&map);
+        arena_reset(&w->arena);
+        return;
+    }
+
+    w->out.len   = 0;
+    w->out.error = 0;
+    int ok = write_MIDI_to_JSON_buffer(&midi, &w->out, &job->opts->json);
+
+    if (ok && job->opts->out_dir)
+    {
+        const char *name = output_name(&w->name, &w->name_cap, job->opts->out_dir,
+                                       path + item->name,
+                                       job->opts->json.style);
+        ok = name && write_whole_file(name, w->out.data, w->out.len);
+    }
+
+    if (ok)
+    {
+        w->stats.bytes += map.len;
+        for (uint16_t i = 0; i < midi.mthd.ntracks; ++i)
+            w->stats.events += midi.mtrk[i].count;
+    }
+    else
+    {
+        fprintf(stderr, "Error: Failed to write JSON for '%s'\n", path);
+        w->stats.failed++;
+    }
+
+    free_MIDI_file(&midi);
+    close_MIDI_map(&map);
+    arena_reset(&w->arena);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int run_MIDI_batch(const MIDI_path_list *list, const MIDI_batch_opts *opts,
+                   MIDI_batch_stats *stats)
+{
+    if (!list || !opts || !stats) return 0;
+    memset(stats, 0, sizeof(MIDI_batch_stats));
+
+    unsigned nthreads = opts->nthreads > 1 ? opts->nthreads : 1;
+    Batch_worker *workers = (Batch_worker*) calloc(nthreads, sizeof(Batch_worker));
+    if (!workers) return 0;
+
+    int fine = 1;
+    for (unsigned i = 0; i < nthreads && fine; ++i)
+        fine = out_init_mem(&workers[i].out, OUT_BUFFER_SIZE);
+
+    uint8_t *clash = NULL;
+    if (fine && opts->out_dir)
+    {
+        clash = find_output_clashes(list, opts);
+        fine  = clash != NULL;
+    }
+
+    if (fine)
+    {
+        Batch_job job = { list, opts, workers, clash };
+        double start = now_seconds();
+        parallel_for(list->count, nthreads, batch_task, &job);
+        stats->seconds = now_seconds() - start;
+    }
+
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        stats->files  += workers[i].stats.files;
+        stats->failed += workers[i].stats.failed;
+        stats->bytes  += workers[i].stats.bytes;
+        stats->events += workers[i].stats.events;
+        arena_free(&workers[i].arena);
+        out_free(&workers[i].out);
+        free(workers[i].name);
+    }
+    free(workers);
+    free(clash);
+    return fine;
+}
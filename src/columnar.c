@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "columnar.h"
+#include "out_buffer.h"
+#include "timeline.h"
+
+// Arrow IPC constants, see Schema.fbs and Message.fbs in the Arrow format
+#define ARROW_MAGIC           "ARROW1"
+#define ARROW_V5              4
+#define ARROW_HEADER_SCHEMA   1
+#define ARROW_HEADER_BATCH    3
+#define ARROW_TYPE_INT        2
+#define ARROW_TYPE_BINARY     4
+
+#define FB_MAX_FIELDS 8
+
+static const uint8_t col_width[] = { 1, 2, 4, 8, 4 };
+
+// ---------------------------------------------------
+
+static void put_le(uint8_t *dst, uint64_t v, int n)
+{
+    for (int i = 0; i < n; ++i) dst[i] = (uint8_t)(v >> (8 * i));
+}
+
+static int host_is_little_endian(void)
+{
+    const uint16_t one = 1;
+    return *(const uint8_t*) &one == 1;
+}
+
+// rows must be set first, every column gets at least one slot so an
+// empty table still has arrays to point at
+static int add_column(MIDI_table *t, const char *name, MIDI_column_type type)
+{
+    MIDI_column *c = &t->cols[t->ncols++];
+    c->name = name;
+    c->type = type;
+
+    size_t n = type == MIDI_COL_BINARY || t->rows == 0 ? t->rows + 1 : t->rows;
+    c->values = calloc(n, col_width[type]);
+    return c->values != NULL;
+}
+
+static void free_table(MIDI_table *t)
+{
+    for (unsigned i = 0; i < t->ncols; ++i)
+    {
+        free(t->cols[i].values);
+        free(t->cols[i].bytes);
+    }
+    memset(t, 0, sizeof(MIDI_table));
+}
+
+void free_MIDI_tables(MIDI_tables *tables)
+{
+    if (!tables) return;
+    free_table(&tables->channel);
+    free_table(&tables->meta);
+    free_table(&tables->tempo);
+}
+
+static int is_tempo(const MTrk_event *ev)
+{
+    return ev->kind == META && ev->ev.meta_ev.type == 0x51 &&
+           ev->ev.meta_ev.len >= 3 && ev->ev.meta_ev.data;
+}
+
+// absolute times of the tempo rows, format 2 tracks each keep their own
+static int tempo_usecs(const MIDI_file *midi, MIDI_table *tempo)
+{
+    const uint16_t *track = (const uint16_t*) tempo->cols[0].values;
+    const uint64_t *tick  = (const uint64_t*) tempo->cols[1].values;
+    uint64_t       *usec  = (uint64_t*) tempo->cols[2].values;
+
+    size_t i = 0;
+    while (i < tempo->rows)
+    {
+        size_t end = i + 1;
+        if (midi->mthd.fmt == 2)
+            while (end < tempo->rows && track[end] == track[i]) end++;
+        else
+            end = tempo->rows;
+
+        MIDI_tempo_map map;
+        if (!MIDI_tempo_map_init(&map, midi, track[i])) return 0;
+        MIDI_tempo_map_usecs(&map, tick + i, usec + i, end - i);
+        MIDI_tempo_map_free(&map);
+        i = end;
+    }
+    return 1;
+}
+
+int MIDI_tables_from_file(const MIDI_file *midi, MIDI_tables *out)
+{
+    if (!out) return 0;
+    memset(out, 0, sizeof(MIDI_tables));
+    if (!midi || !midi->mtrk) return 0;
+
+    // sized exactly first, so every column is a single allocation
+    size_t   nch = 0, nmeta = 0, ntempo = 0;
+    uint64_t meta_bytes = 0;
+    for (uint16_t i = 0; i < midi->mthd.ntracks; ++i)
+    {
+        const MTrk *mtrk = &midi->mtrk[i];
+        for (size_t j = 0; j < mtrk->count; ++j)
+        {
+            const MTrk_event *ev = &mtrk->events[j];
+            if (ev->kind == CH) nch++;
+            else if (ev->kind == META)
+            {
+                nmeta++;
+                if (ev->ev.meta_ev.data) meta_bytes += ev->ev.meta_ev.len;
+                if (is_tempo(ev)) ntempo++;
+            }
+        }
+    }
+    // Arrow binary offsets are int32
+    if (meta_bytes > INT32_MAX) return 0;
+
+    MIDI_table *ch = &out->channel, *meta = &out->meta, *tempo = &out->tempo;
+    ch->name    = "channel";
+    ch->rows    = nch;
+    meta->name  = "meta";
+    meta->rows  = nmeta;
+    tempo->name = "tempo";
+    tempo->rows = ntempo;
+
+    int ok = add_column(ch, "track", MIDI_COL_U16) && add_column(ch, "tick", MIDI_COL_U64) &&
+             add_column(ch, "channel", MIDI_COL_U8) && add_column(ch, "type", MIDI_COL_U8) &&
+             add_column(ch, "param1", MIDI_COL_U8) && add_column(ch, "param2", MIDI_COL_U8) &&
+             add_column(meta, "track", MIDI_COL_U16) && add_column(meta, "tick", MIDI_COL_U64) &&
+             add_column(meta, "type", MIDI_COL_U8) && add_column(meta, "length", MIDI_COL_U32) &&
+             add_column(meta, "data", MIDI_COL_BINARY) &&
+             add_column(tempo, "track", MIDI_COL_U16) && add_column(tempo, "tick", MIDI_COL_U64) &&
+             add_column(tempo, "usec", MIDI_COL_U64) && add_column(tempo, "tempo", MIDI_COL_U32);
+    if (ok)
+    {
+        meta->cols[4].nbytes = (size_t) meta_bytes;
+        meta->cols[4].bytes  = (uint8_t*) malloc(meta_bytes ? (size_t) meta_bytes : 1);
+        ok = meta->cols[4].bytes != NULL;
+    }
+    if (!ok)
+    {
+        free_MIDI_tables(out);
+        return 0;
+    }
+
+    uint16_t *ch_track = (uint16_t*) ch->cols[0].values;
+    uint64_t *ch_tick  = (uint64_t*) ch->cols[1].values;
+    uint8_t  *ch_chan  = (uint8_t*)  ch->cols[2].values;
+    uint8_t  *ch_type  = (uint8_t*)  ch->cols[3].values;
+    uint8_t  *ch_p1    = (uint8_t*)  ch->cols[4].values;
+    uint8_t  *ch_p2    = (uint8_t*)  ch->cols[5].values;
+    uint16_t *mt_track = (uint16_t*) meta->cols[0].values;
+    uint64_t *mt_tick  = (uint64_t*) meta->cols[1].values;
+    uint8_t  *mt_type  = (uint8_t*)  meta->cols[2].values;
+    uint32_t *mt_len   = (uint32_t*) meta->cols[3].values;
+    int32_t  *mt_off   = (int32_t*)  meta->cols[4].values;
+    uint8_t  *mt_data  = meta->cols[4].bytes;
+    uint16_t *tp_track = (uint16_t*) tempo->cols[0].values;
+    uint64_t *tp_tick  = (uint64_t*) tempo->cols[1].values;
+    uint32_t *tp_tempo = (uint32_t*) tempo->cols[3].values;
+
+    size_t c = 0, m = 0, t = 0;
+    int32_t used = 0;
+    for (uint16_t i = 0; i < midi->mthd.ntracks; ++i)
+    {
+        const MTrk *mtrk = &midi->mtrk[i];
+        uint64_t tick = 0;
+        for (size_t j = 0; j < mtrk->count; ++j)
+        {
+            const MTrk_event *ev = &mtrk->events[j];
+            tick += ev->delta_time;
+
+            if (ev->kind == CH)
+            {
+                const Channel_event *ce = &ev->ev.channel_ev;
+                ch_track[c] = i;
+                ch_tick[c]  = tick;
+                ch_chan[c]  = ce->channel;
+                ch_type[c]  = ce->type;
+                ch_p1[c]    = ce->param1;
+                ch_p2[c]    = ce->param2;
+                c++;
+            }
+            else if (ev->kind == META)
+            {
+                const Meta_event *me = &ev->ev.meta_ev;
+                mt_track[m] = i;
+                mt_tick[m]  = tick;
+                mt_type[m]  = me->type;
+                mt_len[m]   = me->len;
+                if (me->data)
+                {
+                    memcpy(mt_data + used, me->data, me->len);
+                    used += (int32_t) me->len;
+                }
+                mt_off[++m] = used;
+
+                if (is_tempo(ev))
+                {
+                    const uint8_t *p = (const uint8_t*) me->data;
+                    tp_track[t] = i;
+                    tp_tick[t]  = tick;
+                    tp_tempo[t] = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+                    t++;
+                }
+            }
+        }
+    }
+
+    if (!tempo_usecs(midi, tempo))
+    {
+        free_MIDI_tables(out);
+        return 0;
+    }
+    return 1;
+}
+
+// ---------------------------------------------------
+
+int write_MIDI_table_csv(const MIDI_table *table, FILE *fp)
+{
+    if (!table || !fp) return 0;
+
+    Out_buffer out;
+    if (!out_init_file(&out, fp)) return 0;
+
+    for (unsigned k = 0; k < table->ncols; ++k)
+    {
+        if (k) out_char(&out, ',');
+        out_str(&out, table->cols[k].name);
+    }
+    out_char(&out, '\n');
+
+    for (size_t r = 0; r < table->rows && !out.error; ++r)
+    {
+        for (unsigned k = 0; k < table->ncols; ++k)
+        {
+            const MIDI_column *c = &table->cols[k];
+            if (k) out_char(&out, ',');
+            switch (c->type)
+            {
+            case MIDI_COL_U8:  out_u32(&out, ((const uint8_t*)  c->values)[r]); break;
+            case MIDI_COL_U16: out_u32(&out, ((const uint16_t*) c->values)[r]); break;
+            case MIDI_COL_U32: out_u32(&out, ((const uint32_t*) c->values)[r]); break;
+            case MIDI_COL_U64: out_u64(&out, ((const uint64_t*) c->values)[r]); break;
+            case MIDI_COL_BINARY:
+            {
+                const int32_t *off = (const int32_t*) c->values;
+                for (int32_t b = off[r]; b < off[r + 1]; ++b) out_hex2(&out, c->bytes[b]);
+                break;
+            }
+            }
+        }
+        out_char(&out, '\n');
+    }
+
+    int result = out_flush(&out);
+    out_free(&out);
+    return result;
+}
+
+// ---------------------------------------------------
+
+// just enough of a flatbuffers builder for Arrow's metadata. like the
+// reference builder it fills the buffer back to front, so children are
+// built before the tables that point at them, and positions are counted
+// from the end
+typedef struct
+{
+    uint8_t *buf;
+    size_t   cap;
+    size_t   size;
+    size_t   minalign;
+    int      error;
+} Fb;
+
+typedef struct
+{
+    size_t   start;
+    size_t   slot[FB_MAX_FIELDS];   // where each field went, 0 for absent
+    unsigned n;
+} Fb_table;
+
+// room for n more bytes in front of what's there
+static uint8_t *fb_grow(Fb *fb, size_t n)
+{
+    if (fb->error) return NULL;
+    if (fb->cap - fb->size < n)
+    {
+        size_t cap = fb->cap ? fb->cap * 2 : 1024;
+        while (cap - fb->size < n) cap *= 2;
+
+        uint8_t *buf = (uint8_t*) malloc(cap);
+        if (!buf)
+        {
+            fb->error = 1;
+            return NULL;
+        }
+        if (fb->size) memcpy(buf + cap - fb->size, fb->buf + fb->cap - fb->size, fb->size);
+        free(fb->buf);
+        fb->buf = buf;
+        fb->cap = cap;
+    }
+    fb->size += n;
+    return fb->buf + fb->cap - fb->size;
+}
+
+static void fb_put(Fb *fb, uint64_t v, size_t n)
+{
+    uint8_t *p = fb_grow(fb, n);
+    if (p) put_le(p, v, (int) n);
+}
+
+// pads so that once `extra` more bytes are in, the size is a multiple of align
+static void fb_prep(Fb *fb, size_t align, size_t extra)
+{
+    if (align > fb->minalign) fb->minalign = align;
+    size_t pad = (align - ((fb->size + extra) & (align - 1))) & (align - 1);
+    uint8_t *p = fb_grow(fb, pad);
+    if (p) memset(p, 0, pad);
+}
+
+static void fb_scalar(Fb *fb, uint64_t v, size_t n)
+{
+    fb_prep(fb, n, 0);
+    fb_put(fb, v, n);
+}
+
+static void fb_uoffset(Fb *fb, size_t target)
+{
+    fb_prep(fb, 4, 0);
+    fb_put(fb, fb->size + 4 - target, 4);
+}
+
+static size_t fb_string(Fb *fb, const char *s)
+{
+    size_t len = strlen(s);
+    fb_prep(fb, 4, len + 1);
+    uint8_t *p = fb_grow(fb, len + 1);
+    if (p)
+    {
+        memcpy(p, s, len);
+        p[len] = 0;
+    }
+    fb_put(fb, len, 4);
+    return fb->size;
+}
+
+static size_t fb_offset_vector(Fb *fb, const size_t *targets, size_t n)
+{
+    fb_prep(fb, 4, 4 * n);
+    for (size_t i = n; i-- > 0;) fb_uoffset(fb, targets[i]);
+    fb_put(fb, n, 4);
+    return fb->size;
+}
+
+// structs already laid out little-endian, 8 byte aligned
+static size_t fb_struct_vector(Fb *fb, const uint8_t *data, size_t n, size_t size)
+{
+    fb_prep(fb, 4, n * size);
+    fb_prep(fb, 8, n * size);
+    uint8_t *p = fb_grow(fb, n * size);
+    if (p && n) memcpy(p, data, n * size);
+    fb_put(fb, n, 4);
+    return fb->size;
+}
+
+static void fb_table_start(Fb *fb, Fb_table *t)
+{
+    memset(t, 0, sizeof(Fb_table));
+    t->start = fb->size;
+}
+
+static void fb_field(Fb *fb, Fb_table *t, unsigned id, uint64_t v, size_t n)
+{
+    fb_scalar(fb, v, n);
+    t->slot[id] = fb->size;
+    if (id >= t->n) t->n = id + 1;
+}
+
+static void fb_field_offset(Fb *fb, Fb_table *t, unsigned id, size_t target)
+{
+    fb_uoffset(fb, target);
+    t->slot[id] = fb->size;
+    if (id >= t->n) t->n = id + 1;
+}
+
+// the vtable goes right in front of its table
+static size_t fb_table_end(Fb *fb, Fb_table *t)
+{
+    fb_scalar(fb, 0, 4);
+    size_t table = fb->size;
+
+    for (unsigned i = t->n; i-- > 0;)
+        fb_put(fb, t->slot[i] ? table - t->slot[i] : 0, 2);
+    fb_put(fb, table - t->start, 2);
+    fb_put(fb, 4 + 2 * t->n, 2);
+
+    if (!fb->error) put_le(fb->buf + fb->cap - table, fb->size - table, 4);
+    return table;
+}
+
+static void fb_finish(Fb *fb, size_t root)
+{
+    fb_prep(fb, fb->minalign, 4);
+    fb_uoffset(fb, root);
+}
+
+// starts the next flatbuffer in the same memory
+static void fb_reset(Fb *fb)
+{
+    fb->size     = 0;
+    fb->minalign = 1;
+}
+
+static const uint8_t *fb_data(const Fb *fb)
+{
+    return fb->buf + fb->cap - fb->size;
+}
+
+// ---------------------------------------------------
+
+static size_t pad8(size_t n)
+{
+    return (n + 7) & ~(size_t) 7;
+}
+
+static int write_zeros(FILE *fp, size_t n)
+{
+    static const uint8_t zeros[8];
+    return n == 0 || fwrite(zeros, 1, n, fp) == n;
+}
+
+static size_t arrow_schema(Fb *fb, const MIDI_table *table)
+{
+    size_t fields[MIDI_TABLE_MAX_COLUMNS];
+    for (unsigned k = 0; k < table->ncols; ++k)
+    {
+        const MIDI_column *c = &table->cols[k];
+        size_t name     = fb_string(fb, c->name);
+        size_t children = fb_offset_vector(fb, NULL, 0);
+
+        // Int { bitWidth, is_signed = false } or an empty Binary
+        Fb_table type;
+        fb_table_start(fb, &type);
+        if (c->type != MIDI_COL_BINARY) fb_field(fb, &type, 0, 8u * col_width[c->type], 4);
+        size_t type_off = fb_table_end(fb, &type);
+
+        Fb_table field;
+        fb_table_start(fb, &field);
+        fb_field_offset(fb, &field, 0, name);
+        fb_field_offset(fb, &field, 3, type_off);
+        fb_field_offset(fb, &field, 5, children);
+        fb_field(fb, &field, 1, 0, 1);
+        fb_field(fb, &field, 2, c->type == MIDI_COL_BINARY ? ARROW_TYPE_BINARY : ARROW_TYPE_INT, 1);
+        fields[k] = fb_table_end(fb, &field);
+    }
+    size_t vec = fb_offset_vector(fb, fields, table->ncols);
+
+    Fb_table schema;
+    fb_table_start(fb, &schema);
+    fb_field_offset(fb, &schema, 1, vec);
+    return fb_table_end(fb, &schema);
+}
+
+// an encapsulated message: continuation marker, metadata length, the
+// flatbuffer padded to 8 bytes. *len gets all of that, the body follows
+static int arrow_message(FILE *fp, Fb *fb, uint8_t header_type, size_t header,
+                         uint64_t body_len, uint64_t *len)
+{
+    Fb_table msg;
+    fb_table_start(fb, &msg);
+    fb_field(fb, &msg, 3, body_len, 8);
+    fb_field_offset(fb, &msg, 2, header);
+    fb_field(fb, &msg, 0, ARROW_V5, 2);
+    fb_field(fb, &msg, 1, header_type, 1);
+    fb_finish(fb, fb_table_end(fb, &msg));
+    if (fb->error) return 0;
+
+    uint8_t prefix[8];
+    size_t  padded = pad8(fb->size);
+    put_le(prefix, 0xFFFFFFFFu, 4);
+    put_le(prefix + 4, padded, 4);
+    if (fwrite(prefix, 1, 8, fp) != 8 ||
+        fwrite(fb_data(fb), 1, fb->size, fp) != fb->size ||
+        !write_zeros(fp, padded - fb->size))
+        return 0;
+
+    *len = 8 + padded;
+    return 1;
+}
+
+// validity buffers are empty, nothing is ever null
+static size_t arrow_buffers(const MIDI_table *table, uint8_t *out, size_t *body_len)
+{
+    size_t n = 0, at = 0;
+    for (unsigned k = 0; k < table->ncols; ++k)
+    {
+        const MIDI_column *c = &table->cols[k];
+        size_t lens[3] = { 0, 0, 0 }, nbufs = 2;
+        if (c->type == MIDI_COL_BINARY)
+        {
+            lens[1] = (table->rows + 1) * 4;
+            lens[2] = c->nbytes;
+            nbufs = 3;
+        }
+        else lens[1] = table->rows * col_width[c->type];
+
+        for (size_t b = 0; b < nbufs; ++b)
+        {
+            put_le(out + 16 * n, at, 8);
+            put_le(out + 16 * n + 8, lens[b], 8);
+            at += pad8(lens[b]);
+            n++;
+        }
+    }
+    *body_len = at;
+    return n;
+}
+
+static int write_column(FILE *fp, const void *data, size_t len)
+{
+    if (len && fwrite(data, 1, len, fp) != len) return 0;
+    return write_zeros(fp, pad8(len) - len);
+}
+
+static int write_arrow(const MIDI_table *table, FILE *fp, Fb *fb)
+{
+    if (fwrite(ARROW_MAGIC "\0\0", 1, 8, fp) != 8) return 0;
+    uint64_t pos = 8, len;
+
+    // the schema message
+    fb_reset(fb);
+    size_t schema = arrow_schema(fb, table);
+    if (!arrow_message(fp, fb, ARROW_HEADER_SCHEMA, schema, 0, &len)) return 0;
+    pos += len;
+
+    // the record batch, its metadata first
+    uint8_t nodes[16 * MIDI_TABLE_MAX_COLUMNS];
+    uint8_t buffers[16 * 3 * MIDI_TABLE_MAX_COLUMNS];
+    for (unsigned k = 0; k < table->ncols; ++k)
+    {
+        put_le(nodes + 16 * k, table->rows, 8);
+        put_le(nodes + 16 * k + 8, 0, 8);
+    }
+    size_t body_len;
+    size_t nbuffers = arrow_buffers(table, buffers, &body_len);
+
+    fb_reset(fb);
+    size_t nodes_off   = fb_struct_vector(fb, nodes, table->ncols, 16);
+    size_t buffers_off = fb_struct_vector(fb, buffers, nbuffers, 16);
+    Fb_table batch;
+    fb_table_start(fb, &batch);
+    fb_field(fb, &batch, 0, table->rows, 8);
+    fb_field_offset(fb, &batch, 1, nodes_off);
+    fb_field_offset(fb, &batch, 2, buffers_off);
+    size_t batch_off = fb_table_end(fb, &batch);
+
+    uint64_t batch_pos = pos, batch_meta;
+    if (!arrow_message(fp, fb, ARROW_HEADER_BATCH, batch_off, body_len, &batch_meta)) return 0;
+    pos += batch_meta;
+
+    // then every column in one piece
+    for (unsigned k = 0; k < table->ncols; ++k)
+    {
+        const MIDI_column *c = &table->cols[k];
+        if (c->type == MIDI_COL_BINARY)
+        {
+            if (!write_column(fp, c->values, (table->rows + 1) * 4) ||
+                !write_column(fp, c->bytes, c->nbytes))
+                return 0;
+        }
+        else if (!write_column(fp, c->values, table->rows * col_width[c->type]))
+            return 0;
+    }
+    pos += body_len;
+
+    // end of stream marker, then the footer pointing back at the batch
+    uint8_t eos[8];
+    put_le(eos, 0xFFFFFFFFu, 4);
+    put_le(eos + 4, 0, 4);
+    if (fwrite(eos, 1, 8, fp) != 8) return 0;
+
+    uint8_t block[24];
+    put_le(block, batch_pos, 8);
+    put_le(block + 8, batch_meta, 4);
+    put_le(block + 12, 0, 4);
+    put_le(block + 16, body_len, 8);
+
+    fb_reset(fb);
+    size_t blocks = fb_struct_vector(fb, block, 1, 24);
+    size_t dicts  = fb_struct_vector(fb, NULL, 0, 24);
+    schema = arrow_schema(fb, table);
+    Fb_table footer;
+    fb_table_start(fb, &footer);
+    fb_field_offset(fb, &footer, 1, schema);
+    fb_field_offset(fb, &footer, 2, dicts);
+    fb_field_offset(fb, &footer, 3, blocks);
+    fb_field(fb, &footer, 0, ARROW_V5, 2);
+    fb_finish(fb, fb_table_end(fb, &footer));
+    if (fb->error) return 0;
+
+    uint8_t tail[4];
+    put_le(tail, fb->size, 4);
+    return fwrite(fb_data(fb), 1, fb->size, fp) == fb->size &&
+           fwrite(tail, 1, 4, fp) == 4 &&
+           fwrite(ARROW_MAGIC, 1, 6, fp) == 6;
+}
+
+int write_MIDI_table_arrow(const MIDI_table *table, FILE *fp)
+{
+    // columns are written straight from memory, which is only Arrow's
+    // byte order on little-endian hosts
+    if (!table || !fp || !host_is_little_endian()) return 0;
+
+    Fb fb;
+    memset(&fb, 0, sizeof(Fb));
+    fb.minalign = 1;
+    int ok = write_arrow(table, fp, &fb);
+    free(fb.buf);
+    return ok;
+}
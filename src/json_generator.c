@@ -1,34 +1,94 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "../include/json_generator.h"
+#include "../include/out_buffer.h"
+#include "../include/thread_pool.h"
+#include "../include/timeline.h"
+#include "../include/notes.h"
+#include "../include/midi_push.h"
+
+#define JSON_IOV_MAX           64
+#define JSON_TRACKS_PER_THREAD 4
+#define JSON_READ_CHUNK        (1 << 16)
+
+// indentation of the pretty layout, one literal per nesting level
+#define IND0 ""
+#define IND1 "  "
+#define IND2 "    "
+#define IND3 "      "
+#define IND4 "        "
+#define IND5 "          "
+
+typedef struct
+{
+    Out_buffer *out;
+    int         pretty;
+} JSON_writer;
 
-static void write_hex_bytes(FILE *fp, const uint8_t *data, size_t len)
+// both variants are literals, so either way the length is a constant
+#define NL(w, ind) \
+    do { if ((w)->pretty) out_lit((w)->out, "\n" ind); } while (0)
+#define KEY(w, ind, k) \
+    do { if ((w)->pretty) out_lit((w)->out, "\n" ind "\"" k "\": "); \
+         else             out_lit((w)->out, "\"" k "\":"); } while (0)
+
+static void write_hex_bytes(Out_buffer *out, const uint8_t *data, size_t len)
 {
-    fprintf(fp, "\"");
-    for (size_t i = 0; i < len; ++i)
+    out_char(out, '"');
+    if (len > 0)
     {
-        fprintf(fp, "%02X", data[i]);
-        if (i < len - 1) fprintf(fp, " ");
+        // "XX" per byte plus a space between each pair
+        char *p = out_reserve(out, len * 3 - 1);
+        if (!p) return;
+        for (size_t i = 0; i < len; ++i)
+        {
+            *p++ = out_hex_digits[data[i] >> 4];
+            *p++ = out_hex_digits[data[i] & 0xF];
+            if (i < len - 1) *p++ = ' ';
+        }
+        out->len += len * 3 - 1;
     }
-    fprintf(fp, "\"");
+    out_char(out, '"');
 }
 
-static void write_text_data(FILE *fp, const uint8_t *data, size_t len)
+static void write_text_data(Out_buffer *out, const uint8_t *data, size_t len)
 {
-    fprintf(fp, "\"");
-    for (size_t i = 0; i < len; ++i)
+    out_char(out, '"');
+    size_t i = 0;
+    while (i < len)
     {
-        uint8_t c = data[i];
-        if (c == '"') fprintf(fp, "\\\"");
-        else if (c == '\\') fprintf(fp, "\\\\");
-        else if (c == '\n') fprintf(fp, "\\n");
-        else if (c == '\r') fprintf(fp, "\\r");
-        else if (c == '\t') fprintf(fp, "\\t");
-        else if (c >= 32 && c <= 126) fprintf(fp, "%c", c);
-        else fprintf(fp, "\\u%04X", c);
+        // copy the run of characters that need no escaping in one go
+        size_t run = i;
+        while (run < len && data[run] >= 32 && data[run] <= 126 &&
+               data[run] != '"' && data[run] != '\\')
+            ++run;
+        if (run > i)
+        {
+            out_write(out, data + i, run - i);
+            i = run;
+            if (i == len) break;
+        }
+
+        uint8_t c = data[i++];
+        if (c == '"') out_lit(out, "\\\"");
+        else if (c == '\\') out_lit(out, "\\\\");
+        else if (c == '\n') out_lit(out, "\\n");
+        else if (c == '\r') out_lit(out, "\\r");
+        else if (c == '\t') out_lit(out, "\\t");
+        else
+        {
+            out_lit(out, "\\u00");
+            out_hex2(out, c);
+        }
     }
-    fprintf(fp, "\"");
+    out_char(out, '"');
 }
 
 static const char* get_channel_event_name(uint8_t type)
@@ -71,62 +131,99 @@ static const char* get_meta_event_name(uint8_t type)
     }
 }
 
-static void write_channel_event(FILE *fp, const Channel_event *ch)
+static void write_channel_event(JSON_writer *w, const Channel_event *ch)
 {
-    fprintf(fp, "{\n");
-    fprintf(fp, "        \"type\": \"channel\",\n");
-    fprintf(fp, "        \"name\": \"%s\",\n", get_channel_event_name(ch->type));
-    fprintf(fp, "        \"channel\": %u,\n", ch->channel);
-    fprintf(fp, "        \"message_type\": \"0x%X\",\n", ch->type);
-    
+    Out_buffer *out = w->out;
+
+    out_char(out, '{');
+    KEY(w, IND4, "type");
+    out_lit(out, "\"channel\",");
+    KEY(w, IND4, "name");
+    out_char(out, '"');
+    out_str(out, get_channel_event_name(ch->type));
+    out_lit(out, "\",");
+    KEY(w, IND4, "channel");
+    out_u32(out, ch->channel);
+    out_char(out, ',');
+    KEY(w, IND4, "message_type");
+    out_lit(out, "\"0x");
+    out_hex(out, ch->type);
+    out_lit(out, "\",");
+
     switch (ch->type)
     {
     case 0x8:
     case 0x9:
-        fprintf(fp, "        \"note\": %u,\n", ch->param1);
-        fprintf(fp, "        \"velocity\": %u\n", ch->param2);
+        KEY(w, IND4, "note");
+        out_u32(out, ch->param1);
+        out_char(out, ',');
+        KEY(w, IND4, "velocity");
+        out_u32(out, ch->param2);
         break;
     case 0xA:
-        fprintf(fp, "        \"note\": %u,\n", ch->param1);
-        fprintf(fp, "        \"pressure\": %u\n", ch->param2);
+        KEY(w, IND4, "note");
+        out_u32(out, ch->param1);
+        out_char(out, ',');
+        KEY(w, IND4, "pressure");
+        out_u32(out, ch->param2);
         break;
     case 0xB:
-        fprintf(fp, "        \"controller\": %u,\n", ch->param1);
-        fprintf(fp, "        \"value\": %u\n", ch->param2);
+        KEY(w, IND4, "controller");
+        out_u32(out, ch->param1);
+        out_char(out, ',');
+        KEY(w, IND4, "value");
+        out_u32(out, ch->param2);
         break;
     case 0xC:
-        fprintf(fp, "        \"program\": %u\n", ch->param1);
+        KEY(w, IND4, "program");
+        out_u32(out, ch->param1);
         break;
     case 0xD:
-        fprintf(fp, "        \"pressure\": %u\n", ch->param1);
+        KEY(w, IND4, "pressure");
+        out_u32(out, ch->param1);
         break;
     case 0xE:
-        fprintf(fp, "        \"lsb\": %u,\n", ch->param1);
-        fprintf(fp, "        \"msb\": %u\n", ch->param2);
+        KEY(w, IND4, "lsb");
+        out_u32(out, ch->param1);
+        out_char(out, ',');
+        KEY(w, IND4, "msb");
+        out_u32(out, ch->param2);
         break;
     }
-    fprintf(fp, "      }");
+    NL(w, IND3);
+    out_char(out, '}');
 }
 
-static void write_meta_event(FILE *fp, const Meta_event *meta)
+static void write_meta_event(JSON_writer *w, const Meta_event *meta)
 {
-    fprintf(fp, "{\n");
-    fprintf(fp, "        \"type\": \"meta\",\n");
-    fprintf(fp, "        \"name\": \"%s\",\n", get_meta_event_name(meta->type));
-    fprintf(fp, "        \"meta_type\": \"0x%02X\",\n", meta->type);
-    fprintf(fp, "        \"length\": %u", meta->len);
-    
+    Out_buffer *out = w->out;
+
+    out_char(out, '{');
+    KEY(w, IND4, "type");
+    out_lit(out, "\"meta\",");
+    KEY(w, IND4, "name");
+    out_char(out, '"');
+    out_str(out, get_meta_event_name(meta->type));
+    out_lit(out, "\",");
+    KEY(w, IND4, "meta_type");
+    out_lit(out, "\"0x");
+    out_hex2(out, meta->type);
+    out_lit(out, "\",");
+    KEY(w, IND4, "length");
+    out_u32(out, meta->len);
+
     if (meta->data)
     {
         uint8_t *data = (uint8_t*)meta->data;
-        fprintf(fp, ",\n");
-        
+        out_char(out, ',');
+
         switch (meta->type)
         {
         case 0x00:
-            fprintf(fp, "        \"sequence_number\": %u\n", (data[0] << 8) | data[1]);
+            KEY(w, IND4, "sequence_number");
+            out_u32(out, (data[0] << 8) | data[1]);
             break;
-            
+
         case 0x01:
         case 0x02:
         case 0x03:
@@ -135,188 +232,895 @@ static void write_meta_event(FILE *fp, const Meta_event *meta)
         case 0x06:
         case 0x07:
         case 0x09:
-            fprintf(fp, "        \"text\": ");
-            write_text_data(fp, data, meta->len);
-            fprintf(fp, "\n");
+            KEY(w, IND4, "text");
+            write_text_data(out, data, meta->len);
             break;
-            
+
         case 0x20:
-            fprintf(fp, "        \"channel\": %u\n", data[0]);
+            KEY(w, IND4, "channel");
+            out_u32(out, data[0]);
             break;
 
         case 0x21:
-            fprintf(fp, "        \"port\": %u\n", data[0]);
+            KEY(w, IND4, "port");
+            out_u32(out, data[0]);
             break;
-            
+
         case 0x2F:
             break;
-            
+
         case 0x51:
             {
+                // tempo events are rare, the float can keep using snprintf
                 uint32_t tempo = (data[0] << 16) | (data[1] << 8) | data[2];
-                fprintf(fp, "        \"microseconds_per_quarter_note\": %u,\n", tempo);
-                fprintf(fp, "        \"bpm\": %.2f\n", 60000000.0 / tempo);
+                char bpm[64];
+                int n = snprintf(bpm, sizeof(bpm), "%.2f", 60000000.0 / tempo);
+                KEY(w, IND4, "microseconds_per_quarter_note");
+                out_u32(out, tempo);
+                out_char(out, ',');
+                KEY(w, IND4, "bpm");
+                out_write(out, bpm, (size_t)n);
             }
             break;
-            
+
         case 0x54:
             {
                 uint8_t hour = data[0] & 0x1F;
                 uint8_t rr = (data[0] >> 5) & 0x03;
                 const char* rate_names[] = {"24 fps", "25 fps", "30 fps (drop frame)", "30 fps"};
-                fprintf(fp, "        \"hours\": %u,\n", hour);
-                fprintf(fp, "        \"minutes\": %u,\n", data[1]);
-                fprintf(fp, "        \"seconds\": %u,\n", data[2]);
-                fprintf(fp, "        \"frames\": %u,\n", data[3]);
-                fprintf(fp, "        \"fractional_frames\": %u,\n", data[4]);
-                fprintf(fp, "        \"frame_rate\": \"%s\"\n", rate_names[rr]);
+                KEY(w, IND4, "hours");
+                out_u32(out, hour);
+                out_char(out, ',');
+                KEY(w, IND4, "minutes");
+                out_u32(out, data[1]);
+                out_char(out, ',');
+                KEY(w, IND4, "seconds");
+                out_u32(out, data[2]);
+                out_char(out, ',');
+                KEY(w, IND4, "frames");
+                out_u32(out, data[3]);
+                out_char(out, ',');
+                KEY(w, IND4, "fractional_frames");
+                out_u32(out, data[4]);
+                out_char(out, ',');
+                KEY(w, IND4, "frame_rate");
+                out_char(out, '"');
+                out_str(out, rate_names[rr]);
+                out_char(out, '"');
             }
             break;
-            
+
         case 0x58:
-            fprintf(fp, "        \"numerator\": %u,\n", data[0]);
-            fprintf(fp, "        \"denominator\": %u,\n", 1 << data[1]);
-            fprintf(fp, "        \"clocks_per_metronome_click\": %u,\n", data[2]);
-            fprintf(fp, "        \"32nd_notes_per_24_clocks\": %u\n", data[3]);
+            KEY(w, IND4, "numerator");
+            out_u32(out, data[0]);
+            out_char(out, ',');
+            KEY(w, IND4, "denominator");
+            out_u32(out, (uint32_t)(1 << data[1]));
+            out_char(out, ',');
+            KEY(w, IND4, "clocks_per_metronome_click");
+            out_u32(out, data[2]);
+            out_char(out, ',');
+            KEY(w, IND4, "32nd_notes_per_24_clocks");
+            out_u32(out, data[3]);
             break;
-            
+
         case 0x59:
             {
                 int8_t key = *(int8_t*)data;
                 uint8_t scale = data[1];
-                fprintf(fp, "        \"key\": %d,\n", key);
-                fprintf(fp, "        \"scale\": \"%s\"\n", scale ? "minor" : "major");
+                KEY(w, IND4, "key");
+                out_i32(out, key);
+                out_char(out, ',');
+                KEY(w, IND4, "scale");
+                out_char(out, '"');
+                out_str(out, scale ? "minor" : "major");
+                out_char(out, '"');
             }
             break;
-            
+
         case 0x7F:
         default:
-            fprintf(fp, "        \"data\": ");
-            write_hex_bytes(fp, data, meta->len);
-            fprintf(fp, "\n");
+            KEY(w, IND4, "data");
+            write_hex_bytes(out, data, meta->len);
             break;
         }
     }
-    else
-    {
-        fprintf(fp, "\n");
-    }
-    
-    fprintf(fp, "      }");
+
+    NL(w, IND3);
+    out_char(out, '}');
 }
 
-static void write_sysex_event(FILE *fp, const Sysex_event *sysex)
+static void write_sysex_event(JSON_writer *w, const Sysex_event *sysex)
 {
-    fprintf(fp, "{\n");
-    fprintf(fp, "        \"type\": \"sysex\",\n");
-    fprintf(fp, "        \"length\": %u,\n", sysex->len);
-    fprintf(fp, "        \"data\": ");
+    Out_buffer *out = w->out;
+
+    out_char(out, '{');
+    KEY(w, IND4, "type");
+    out_lit(out, "\"sysex\",");
+    if (sysex->type == 0xF7)
+    {
+        // escape packets only, so they read back as what they were
+        KEY(w, IND4, "status");
+        out_lit(out, "\"0xF7\",");
+    }
+    KEY(w, IND4, "length");
+    out_u32(out, sysex->len);
+    out_char(out, ',');
+    KEY(w, IND4, "data");
     if (sysex->data && sysex->len > 0)
     {
-        write_hex_bytes(fp, (uint8_t*)sysex->data, sysex->len);
+        write_hex_bytes(out, (uint8_t*)sysex->data, sysex->len);
     }
     else
     {
-        fprintf(fp, "\"\"");
+        out_lit(out, "\"\"");
     }
-    fprintf(fp, "\n      }");
+    NL(w, IND3);
+    out_char(out, '}');
 }
 
-static void write_mthd(FILE *fp, const MThd *mthd)
+static void write_event(JSON_writer *w, const MTrk_event *event)
 {
-    fprintf(fp, "  \"header\": {\n");
-    fprintf(fp, "    \"format\": %u,\n", mthd->fmt);
-    fprintf(fp, "    \"tracks\": %u,\n", mthd->ntracks);
-    
-    if (mthd->fmt == 0 || mthd->fmt == 1)
+    switch (event->kind)
     {
-        fprintf(fp, "    \"time_division\": {\n");
-        fprintf(fp, "      \"type\": \"ticks_per_beat\",\n");
-        fprintf(fp, "      \"ticks_per_beat\": %u\n", mthd->timediv.ticks_per_beat);
-        fprintf(fp, "    }\n");
+    case CH:
+        write_channel_event(w, &event->ev.channel_ev);
+        break;
+    case META:
+        write_meta_event(w, &event->ev.meta_ev);
+        break;
+    case SYS:
+        write_sysex_event(w, &event->ev.sysex_ev);
+        break;
+    }
+}
+
+static void write_mthd(JSON_writer *w, const MThd *mthd)
+{
+    Out_buffer *out = w->out;
+
+    KEY(w, IND1, "header");
+    out_char(out, '{');
+    KEY(w, IND2, "format");
+    out_u32(out, mthd->fmt);
+    out_char(out, ',');
+    KEY(w, IND2, "tracks");
+    out_u32(out, mthd->ntracks);
+    out_char(out, ',');
+    KEY(w, IND2, "time_division");
+    out_char(out, '{');
+
+    // the top bit of the division word picks the layout, not the format
+    if (!(mthd->division & 0x8000))
+    {
+        KEY(w, IND3, "type");
+        out_lit(out, "\"ticks_per_beat\",");
+        KEY(w, IND3, "ticks_per_beat");
+        out_u32(out, mthd->timediv.ticks_per_beat);
     }
     else
     {
-        fprintf(fp, "    \"time_division\": {\n");
-        fprintf(fp, "      \"type\": \"frames_per_second\",\n");
-        fprintf(fp, "      \"smpte_format\": %d,\n", mthd->timediv.frames_per_sec.smpte);
-        fprintf(fp, "      \"ticks_per_frame\": %u\n", mthd->timediv.frames_per_sec.ticks);
-        fprintf(fp, "    }\n");
+        KEY(w, IND3, "type");
+        out_lit(out, "\"frames_per_second\",");
+        KEY(w, IND3, "smpte_format");
+        out_i32(out, mthd->timediv.frames_per_sec.smpte);
+        out_char(out, ',');
+        KEY(w, IND3, "ticks_per_frame");
+        out_u32(out, mthd->timediv.frames_per_sec.ticks);
     }
-    
-    fprintf(fp, "  }");
+
+    NL(w, IND2);
+    out_char(out, '}');
+    NL(w, IND1);
+    out_char(out, '}');
+}
+
+static void write_mtrk_head(JSON_writer *w, uint16_t track_num, uint32_t size, size_t count)
+{
+    Out_buffer *out = w->out;
+
+    NL(w, IND2);
+    out_char(out, '{');
+    KEY(w, IND3, "track_number");
+    out_u32(out, track_num);
+    out_char(out, ',');
+    KEY(w, IND3, "size");
+    out_u32(out, size);
+    out_char(out, ',');
+    KEY(w, IND3, "event_count");
+    out_u64(out, count);
+    out_char(out, ',');
+    KEY(w, IND3, "events");
+    out_char(out, '[');
+}
+
+static void write_mtrk_event(JSON_writer *w, const MTrk_event *event, int last)
+{
+    Out_buffer *out = w->out;
+
+    NL(w, IND4);
+    out_char(out, '{');
+    KEY(w, IND5, "delta_time");
+    out_u32(out, event->delta_time);
+    out_char(out, ',');
+    KEY(w, IND5, "event");
+
+    write_event(w, event);
+
+    NL(w, IND4);
+    out_char(out, '}');
+    if (!last) out_char(out, ',');
+}
+
+static void write_mtrk_tail(JSON_writer *w, int last)
+{
+    NL(w, IND3);
+    out_char(w->out, ']');
+    NL(w, IND2);
+    out_char(w->out, '}');
+    if (!last) out_char(w->out, ',');
 }
 
-static void write_mtrk(FILE *fp, const MTrk *mtrk, uint16_t track_num)
+static void write_mtrk(JSON_writer *w, const MTrk *mtrk, uint16_t track_num, int last)
 {
-    fprintf(fp, "    {\n");
-    fprintf(fp, "      \"track_number\": %u,\n", track_num);
-    fprintf(fp, "      \"size\": %u,\n", mtrk->size);
-    fprintf(fp, "      \"event_count\": %zu,\n", mtrk->count);
-    fprintf(fp, "      \"events\": [\n");
-    
+    write_mtrk_head(w, track_num, mtrk->size, mtrk->count);
+
     for (size_t i = 0; i < mtrk->count; ++i)
+        write_mtrk_event(w, &mtrk->events[i], i == mtrk->count - 1);
+
+    write_mtrk_tail(w, last);
+}
+
+static void write_document_head(JSON_writer *w, const MThd *mthd)
+{
+    out_char(w->out, '{');
+    write_mthd(w, mthd);
+    out_char(w->out, ',');
+    KEY(w, IND1, "tracks");
+    out_char(w->out, '[');
+}
+
+static void write_document_tail(JSON_writer *w)
+{
+    NL(w, IND1);
+    out_char(w->out, ']');
+    NL(w, IND0);
+    out_lit(w->out, "}\n");
+}
+
+// ndjson: the header on the first line, then one object per event
+static void write_ndjson_header(JSON_writer *w, const MThd *mthd)
+{
+    out_char(w->out, '{');
+    write_mthd(w, mthd);
+    out_lit(w->out, "}\n");
+}
+
+static void write_ndjson_event(JSON_writer *w, uint16_t track, uint64_t tick,
+                               const MTrk_event *event)
+{
+    Out_buffer *out = w->out;
+
+    out_lit(out, "{\"track\":");
+    out_u32(out, track);
+    out_lit(out, ",\"tick\":");
+    out_u64(out, tick);
+    out_lit(out, ",\"delta_time\":");
+    out_u32(out, event->delta_time);
+    out_lit(out, ",\"event\":");
+    write_event(w, event);
+    out_lit(out, "}\n");
+}
+
+// one track in the current style, commas and all, so that rendered
+// tracks only have to be concatenated in order
+static void write_track(JSON_writer *w, JSON_style style, const MIDI_file *midi, uint16_t i)
+{
+    const MTrk *mtrk = &midi->mtrk[i];
+
+    if (style == JSON_NDJSON)
     {
-        const MTrk_event *event = &mtrk->events[i];
-        
-        fprintf(fp, "        {\n");
-        fprintf(fp, "          \"delta_time\": %u,\n", event->delta_time);
-        fprintf(fp, "          \"event\": ");
-        
-        switch (event->kind)
+        uint64_t tick = 0;
+        for (size_t j = 0; j < mtrk->count; ++j)
         {
-        case CH:
-            write_channel_event(fp, &event->ev.channel_ev);
-            break;
-        case META:
-            write_meta_event(fp, &event->ev.meta_ev);
-            break;
-        case SYS:
-            write_sysex_event(fp, &event->ev.sysex_ev);
-            break;
+            tick += mtrk->events[j].delta_time;
+            write_ndjson_event(w, i, tick, &mtrk->events[j]);
         }
-        
-        fprintf(fp, "\n        }");
-        if (i < mtrk->count - 1) fprintf(fp, ",");
-        fprintf(fp, "\n");
     }
-    
-    fprintf(fp, "      ]\n");
-    fprintf(fp, "    }");
+    else
+    {
+        write_mtrk(w, mtrk, i, i == midi->mthd.ntracks - 1);
+    }
 }
 
-int write_MIDI_to_JSON(const MIDI_file *midi, FILE *fp)
+static void write_document(JSON_writer *w, JSON_style style, const MIDI_file *midi)
 {
-    if (!midi || !fp) return 0;
-    
-    fprintf(fp, "{\n");
-    
-    write_mthd(fp, &midi->mthd);
-    
-    fprintf(fp, ",\n  \"tracks\": [\n");
-    
+    if (style == JSON_NDJSON) write_ndjson_header(w, &midi->mthd);
+    else                      write_document_head(w, &midi->mthd);
+
     for (uint16_t i = 0; i < midi->mthd.ntracks; ++i)
+        write_track(w, style, midi, i);
+
+    if (style != JSON_NDJSON) write_document_tail(w);
+}
+
+// timeline: the header, then every event of every track in time order
+static void write_timeline_event(JSON_writer *w, JSON_style style,
+                                 const MIDI_timeline_event *te, int first)
+{
+    Out_buffer *out = w->out;
+
+    if (style == JSON_NDJSON)
     {
-        write_mtrk(fp, &midi->mtrk[i], i);
-        if (i < midi->mthd.ntracks - 1) fprintf(fp, ",");
-        fprintf(fp, "\n");
+        out_lit(out, "{\"track\":");
+        out_u32(out, te->track);
+        out_lit(out, ",\"tick\":");
+        out_u64(out, te->tick);
+        out_lit(out, ",\"time_us\":");
+        out_u64(out, te->usec);
+        out_lit(out, ",\"delta_time\":");
+        out_u32(out, te->event->delta_time);
+        out_lit(out, ",\"event\":");
+        write_event(w, te->event);
+        out_lit(out, "}\n");
+        return;
     }
-    
-    fprintf(fp, "  ]\n");
-    fprintf(fp, "}\n");
-    
+
+    if (!first) out_char(out, ',');
+    NL(w, IND2);
+    out_char(out, '{');
+    KEY(w, IND3, "track");
+    out_u32(out, te->track);
+    out_char(out, ',');
+    KEY(w, IND3, "tick");
+    out_u64(out, te->tick);
+    out_char(out, ',');
+    KEY(w, IND3, "time_us");
+    out_u64(out, te->usec);
+    out_char(out, ',');
+    KEY(w, IND3, "delta_time");
+    out_u32(out, te->event->delta_time);
+    out_char(out, ',');
+    KEY(w, IND3, "event");
+    write_event(w, te->event);
+    NL(w, IND2);
+    out_char(out, '}');
+}
+
+static int write_timeline_document(JSON_writer *w, JSON_style style, const MIDI_file *midi)
+{
+    MIDI_timeline tl;
+    if (!MIDI_timeline_init(&tl, midi)) return 0;
+
+    if (style == JSON_NDJSON)
+    {
+        write_ndjson_header(w, &midi->mthd);
+    }
+    else
+    {
+        out_char(w->out, '{');
+        write_mthd(w, &midi->mthd);
+        out_char(w->out, ',');
+        KEY(w, IND1, "timeline");
+        out_char(w->out, '[');
+    }
+
+    MIDI_timeline_event te;
+    int first = 1;
+    while (MIDI_timeline_next(&tl, &te))
+    {
+        write_timeline_event(w, style, &te, first);
+        first = 0;
+    }
+
+    if (style != JSON_NDJSON) write_document_tail(w);
+
+    MIDI_timeline_free(&tl);
     return 1;
 }
 
-int write_MIDI_to_JSON_file(const MIDI_file *midi, const char *filename)
+// notes: the header, then every paired span sorted by start
+static void write_note(JSON_writer *w, JSON_style style, const MIDI_note *n, int first)
+{
+    Out_buffer *out = w->out;
+
+    if (style != JSON_NDJSON && !first) out_char(out, ',');
+    NL(w, IND2);
+    out_char(out, '{');
+    KEY(w, IND3, "track");
+    out_u32(out, n->track);
+    out_char(out, ',');
+    KEY(w, IND3, "channel");
+    out_u32(out, n->channel);
+    out_char(out, ',');
+    KEY(w, IND3, "key");
+    out_u32(out, n->key);
+    out_char(out, ',');
+    KEY(w, IND3, "start");
+    out_u64(out, n->start);
+    out_char(out, ',');
+    KEY(w, IND3, "duration");
+    out_u64(out, n->duration);
+    out_char(out, ',');
+    KEY(w, IND3, "velocity");
+    out_u32(out, n->velocity);
+    out_char(out, ',');
+    KEY(w, IND3, "off_velocity");
+    out_u32(out, n->off_velocity);
+    NL(w, IND2);
+    out_char(out, '}');
+    if (style == JSON_NDJSON) out_char(out, '\n');
+}
+
+static int write_notes_document(JSON_writer *w, JSON_style style, const MIDI_file *midi,
+                                int sustain)
+{
+    MIDI_note_list notes = { NULL, 0, 0 };
+    if (!MIDI_notes_from_file(midi, sustain, &notes))
+    {
+        free_MIDI_note_list(&notes);
+        return 0;
+    }
+
+    if (style == JSON_NDJSON)
+    {
+        write_ndjson_header(w, &midi->mthd);
+    }
+    else
+    {
+        out_char(w->out, '{');
+        write_mthd(w, &midi->mthd);
+        out_char(w->out, ',');
+        KEY(w, IND1, "notes");
+        out_char(w->out, '[');
+    }
+
+    for (size_t i = 0; i < notes.count; ++i)
+        write_note(w, style, &notes.items[i], i == 0);
+
+    if (style != JSON_NDJSON) write_document_tail(w);
+
+    free_MIDI_note_list(&notes);
+    return 1;
+}
+
+typedef struct
+{
+    const MIDI_file *midi;
+    JSON_style       style;
+    uint16_t         first;   // first track of the current window
+    Out_buffer      *bufs;    // one per track of the window
+    MIDI_stats      *stats;
+} Render_job;
+
+static void render_track_task(size_t i, unsigned worker, void *ctx)
+{
+    Render_job *job = (Render_job*) ctx;
+    (void)worker;
+
+    Out_buffer *out = &job->bufs[i];
+    out->len = 0;
+
+#ifdef MIDI_STATS
+    // the caller flushed before starting, anything left is from earlier work
+    if (job->stats) MIDI_stat_flush(NULL);
+#endif
+
+    JSON_writer w = { out, job->style == JSON_PRETTY };
+    write_track(&w, job->style, job->midi, (uint16_t)(job->first + i));
+
+#ifdef MIDI_STATS
+    if (job->stats) MIDI_stat_flush(job->stats);
+#endif
+}
+
+// hands the rendered tracks to the kernel in one writev where possible
+static int write_buffers(FILE *fp, Out_buffer *bufs, size_t n)
+{
+    int fd = fileno(fp);
+    if (fd < 0)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (fwrite(bufs[i].data, 1, bufs[i].len, fp) != bufs[i].len) return 0;
+            MIDI_STAT_ADD(bytes_written, bufs[i].len);
+        }
+        return 1;
+    }
+
+    struct iovec iov[JSON_IOV_MAX];
+    size_t i = 0;
+    while (i < n)
+    {
+        int cnt = 0;
+        for (; i < n && cnt < JSON_IOV_MAX; ++i)
+        {
+            if (bufs[i].len == 0) continue;
+            iov[cnt].iov_base = bufs[i].data;
+            iov[cnt].iov_len  = bufs[i].len;
+            cnt++;
+        }
+
+        struct iovec *v = iov;
+        while (cnt > 0)
+        {
+            ssize_t wr = writev(fd, v, cnt);
+            if (wr < 0)
+            {
+                if (errno == EINTR) continue;
+                return 0;
+            }
+
+            // partial write, skip what made it and go again
+            size_t done = (size_t)wr;
+            MIDI_STAT_ADD(bytes_written, done);
+            while (cnt > 0 && done >= v->iov_len)
+            {
+                done -= v->iov_len;
+                v++;
+                cnt--;
+            }
+            if (cnt > 0)
+            {
+                v->iov_base = (char*)v->iov_base + done;
+                v->iov_len -= done;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static int write_tracks_parallel(JSON_writer *w, JSON_style style, const MIDI_file *midi,
+                                 FILE *fp, unsigned nthreads, MIDI_stats *stats)
+{
+    uint16_t ntracks = midi->mthd.ntracks;
+
+    // tracks are rendered a window at a time to bound memory use
+    size_t window = (size_t)nthreads * JSON_TRACKS_PER_THREAD;
+    if (window > ntracks) window = ntracks;
+
+    Out_buffer *bufs = (Out_buffer*) calloc(window, sizeof(Out_buffer));
+    if (!bufs) return 0;
+    MIDI_STAT_ALLOC(window * sizeof(Out_buffer));
+
+    int ok = 1;
+    for (size_t i = 0; i < window && ok; ++i)
+        ok = out_init_mem(&bufs[i], 0);
+
+    // whatever the head wrote has to reach the file first
+    if (ok) ok = out_flush(w->out);
+
+    Render_job job = { midi, style, 0, bufs, stats };
+    for (size_t first = 0; first < ntracks && ok; first += window)
+    {
+        size_t n = ntracks - first < window ? ntracks - first : window;
+
+        job.first = (uint16_t)first;
+#ifdef MIDI_STATS
+        if (stats) MIDI_stat_flush(stats);
+#endif
+        parallel_for(n, nthreads, render_track_task, &job);
+
+        for (size_t i = 0; i < n; ++i)
+            if (bufs[i].error) ok = 0;
+        if (ok) ok = write_buffers(fp, bufs, n);
+    }
+
+    for (size_t i = 0; i < window; ++i)
+        out_free(&bufs[i]);
+    free(bufs);
+    return ok;
+}
+
+static int render_JSON(const MIDI_file *midi, FILE *fp, const JSON_writer_opts *opts)
+{
+    JSON_style style = opts ? opts->style : JSON_PRETTY;
+    unsigned nthreads = opts ? opts->nthreads : 1;
+
+    Out_buffer out;
+    if (!out_init_file(&out, fp)) return 0;
+    JSON_writer w = { &out, style == JSON_PRETTY };
+
+    int ok = 1;
+    if (opts && opts->notes)
+    {
+        ok = write_notes_document(&w, style, midi, opts->sustain);
+    }
+    else if (opts && opts->timeline)
+    {
+        // the merge is one sequence, there's nothing to split across threads
+        ok = write_timeline_document(&w, style, midi);
+    }
+    else if (nthreads > 1 && midi->mthd.ntracks > 1)
+    {
+        if (style == JSON_NDJSON) write_ndjson_header(&w, &midi->mthd);
+        else                      write_document_head(&w, &midi->mthd);
+
+        ok = write_tracks_parallel(&w, style, midi, fp, nthreads, opts->stats);
+
+        if (style != JSON_NDJSON) write_document_tail(&w);
+    }
+    else
+    {
+        write_document(&w, style, midi);
+    }
+
+    int result = out_flush(&out) && ok;
+    out_free(&out);
+    return result;
+}
+
+int write_MIDI_to_JSON_opts(const MIDI_file *midi, FILE *fp, const JSON_writer_opts *opts)
+{
+    if (!midi || !fp) return 0;
+
+#ifdef MIDI_STATS
+    MIDI_stats *stats = opts ? opts->stats : NULL;
+    if (!stats) return render_JSON(midi, fp, opts);
+
+    MIDI_stat_flush(NULL);
+    uint64_t t0 = MIDI_stat_now();
+    int result = render_JSON(midi, fp, opts);
+    stats->json_ns += MIDI_stat_now() - t0;
+    MIDI_stat_flush(stats);
+    return result;
+#else
+    return render_JSON(midi, fp, opts);
+#endif
+}
+
+int write_MIDI_to_JSON_buffer(const MIDI_file *midi, Out_buffer *out,
+                              const JSON_writer_opts *opts)
+{
+    if (!midi || !out) return 0;
+
+    JSON_style style = opts ? opts->style : JSON_PRETTY;
+    JSON_writer w = { out, style == JSON_PRETTY };
+
+    if (opts && opts->notes)
+    {
+        if (!write_notes_document(&w, style, midi, opts->sustain)) return 0;
+    }
+    else if (opts && opts->timeline)
+    {
+        if (!write_timeline_document(&w, style, midi)) return 0;
+    }
+    else
+    {
+        write_document(&w, style, midi);
+    }
+    return !out->error;
+}
+
+int write_MIDI_to_JSON(const MIDI_file *midi, FILE *fp)
+{
+    return write_MIDI_to_JSON_opts(midi, fp, NULL);
+}
+
+int write_MIDI_to_JSON_file_opts(const MIDI_file *midi, const char *filename,
+                                 const JSON_writer_opts *opts)
 {
     if (!midi || !filename) return 0;
-    
+
     FILE *fp = fopen(filename, "w");
     if (!fp) return 0;
-    
-    int result = write_MIDI_to_JSON(midi, fp);
-    fclose(fp);
-    
+
+    int result = write_MIDI_to_JSON_opts(midi, fp, opts);
+    if (fclose(fp) != 0) result = 0;
+
+    return result;
+}
+
+int write_MIDI_to_JSON_file(const MIDI_file *midi, const char *filename)
+{
+    return write_MIDI_to_JSON_file_opts(midi, filename, NULL);
+}
+
+static int render_buffer_JSON(const uint8_t *buf, size_t len, FILE *fp,
+                              const JSON_writer_opts *opts)
+{
+    // merging and pairing need every track at once, so parse the whole file first
+    if (opts && (opts->timeline || opts->notes))
+    {
+        // the caller times the whole thing, the parse included
+        JSON_writer_opts inner = *opts;
+        inner.stats = NULL;
+
+        int status;
+        MIDI_file midi = get_MIDI_buffer(buf, len, &status);
+        if (status != 0) return 0;
+        int result = write_MIDI_to_JSON_opts(&midi, fp, &inner);
+        free_MIDI_file(&midi);
+        return result;
+    }
+
+    JSON_style style = opts ? opts->style : JSON_PRETTY;
+
+    MThd mthd;
+    MIDI_cursor cur = { buf, len, 0 };
+    if (!check_for_MThd(&mthd, &cur)) return 0;
+
+    MTrk_chunk *chunks = (MTrk_chunk*) malloc(sizeof(MTrk_chunk) * mthd.ntracks);
+    size_t     *counts = (size_t*) calloc(mthd.ntracks, sizeof(size_t));
+    MIDI_STAT_ALLOC((sizeof(MTrk_chunk) + sizeof(size_t)) * mthd.ntracks);
+    if (!chunks || !counts || !scan_MTrk_chunks(&cur, mthd.ntracks, chunks))
+    {
+        free(chunks);
+        free(counts);
+        return 0;
+    }
+
+    // first pass validates and counts, so nothing is written for a
+    // broken file and every event_count is known up front
+    MTrk_reader rd;
+    MTrk_event  event;
+    int code;
+#ifdef MIDI_STATS
+    // the second pass decodes every event again, count it once
+    MIDI_stat_counts before = MIDI_stat_tally;
+#endif
+    for (uint16_t i = 0; i < mthd.ntracks; ++i)
+    {
+        MTrk_reader_init(&rd, buf + chunks[i].offset, chunks[i].avail, chunks[i].size);
+        while ((code = MTrk_reader_next(&rd, &event)) > 0) counts[i]++;
+        if (code < 0)
+        {
+            free(chunks);
+            free(counts);
+            return 0;
+        }
+    }
+
+#ifdef MIDI_STATS
+    MIDI_stat_tally = before;
+#endif
+
+    Out_buffer out;
+    if (!out_init_file(&out, fp))
+    {
+        free(chunks);
+        free(counts);
+        return 0;
+    }
+    JSON_writer w = { &out, style == JSON_PRETTY };
+
+    if (style == JSON_NDJSON) write_ndjson_header(&w, &mthd);
+    else                      write_document_head(&w, &mthd);
+
+    for (uint16_t i = 0; i < mthd.ntracks; ++i)
+    {
+        if (style != JSON_NDJSON) write_mtrk_head(&w, i, chunks[i].size, counts[i]);
+
+        size_t n = 0;
+        MTrk_reader_init(&rd, buf + chunks[i].offset, chunks[i].avail, chunks[i].size);
+        while (MTrk_reader_next(&rd, &event) > 0)
+        {
+            ++n;
+            if (style == JSON_NDJSON) write_ndjson_event(&w, i, rd.tick, &event);
+            else                      write_mtrk_event(&w, &event, n == counts[i]);
+        }
+        MIDI_STAT_ADD(bytes_read, rd.cur.pos);
+
+        if (style != JSON_NDJSON) write_mtrk_tail(&w, i == mthd.ntracks - 1);
+    }
+
+    if (style != JSON_NDJSON) write_document_tail(&w);
+
+    int result = out_flush(&out);
+    out_free(&out);
+    free(chunks);
+    free(counts);
+    return result;
+}
+
+int write_MIDI_buffer_to_JSON_opts(const uint8_t *buf, size_t len, FILE *fp,
+                                   const JSON_writer_opts *opts)
+{
+    if (!buf || !fp) return 0;
+
+#ifdef MIDI_STATS
+    MIDI_stats *stats = opts ? opts->stats : NULL;
+    if (!stats) return render_buffer_JSON(buf, len, fp, opts);
+
+    MIDI_stat_flush(NULL);
+    uint64_t t0 = MIDI_stat_now();
+    int result = render_buffer_JSON(buf, len, fp, opts);
+    stats->json_ns += MIDI_stat_now() - t0;
+    MIDI_stat_flush(stats);
+    return result;
+#else
+    return render_buffer_JSON(buf, len, fp, opts);
+#endif
+}
+
+int write_MIDI_buffer_to_JSON(const uint8_t *buf, size_t len, FILE *fp)
+{
+    return write_MIDI_buffer_to_JSON_opts(buf, len, fp, NULL);
+}
+
+typedef struct
+{
+    JSON_writer       w;
+    const MIDI_push  *ps;
+    int               head_done;
+} Push_sink;
+
+static int write_pushed_event(const MIDI_stream_event *sev, void *user)
+{
+    Push_sink *sink = (Push_sink*) user;
+    if (!sink->head_done)
+    {
+        write_ndjson_header(&sink->w, &sink->ps->mthd);
+        sink->head_done = 1;
+    }
+    write_ndjson_event(&sink->w, sev->track, sev->tick, &sev->event);
+    return !sink->w.out->error;
+}
+
+static int render_stream_NDJSON(FILE *in, FILE *fp)
+{
+    Out_buffer out;
+    if (!out_init_file(&out, fp)) return 0;
+
+    MIDI_push ps;
+    Push_sink sink = { { &out, 0 }, &ps, 0 };
+    MIDI_push_init(&ps, write_pushed_event, &sink);
+
+    // read() hands over whatever the pipe has, fread would wait for a
+    // full buffer before any of it could be parsed
+    uint8_t buf[JSON_READ_CHUNK];
+    int     fd = fileno(in), ok = 1;
+    for (;;)
+    {
+        ssize_t n = read(fd, buf, sizeof buf);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            if (n < 0) ok = 0;
+            break;
+        }
+        if (!MIDI_push_feed(&ps, buf, (size_t) n))
+        {
+            ok = 0;
+            break;
+        }
+
+        // whatever this batch produced goes out now, a reader on the other
+        // end of a pipe shouldn't wait for the buffer to fill up
+        if (out.len && !out_flush(&out))
+        {
+            ok = 0;
+            break;
+        }
+    }
+    if (!MIDI_push_finish(&ps)) ok = 0;
+
+    // a file without a single event still gets its header line
+    if (ok && !sink.head_done) write_ndjson_header(&sink.w, &ps.mthd);
+
+    MIDI_push_free(&ps);
+    ok = out_flush(&out) && ok;
+    out_free(&out);
+    return ok;
+}
+
+int write_MIDI_stream_to_NDJSON(FILE *in, FILE *fp, const JSON_writer_opts *opts)
+{
+    if (!in || !fp) return 0;
+
+#ifdef MIDI_STATS
+    MIDI_stats *stats = opts ? opts->stats : NULL;
+    if (!stats) return render_stream_NDJSON(in, fp);
+
+    MIDI_stat_flush(NULL);
+    uint64_t t0 = MIDI_stat_now();
+    int result = render_stream_NDJSON(in, fp);
+    stats->json_ns += MIDI_stat_now() - t0;
+    MIDI_stat_flush(stats);
     return result;
+#else
+    (void) opts;
+    return render_stream_NDJSON(in, fp);
+#endif
 }
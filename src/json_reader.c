@@ -0,0 +1,892 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "json_reader.h"
+
+typedef struct
+{
+    const char *p;
+    const char *end;
+    MIDI_arena *arena;
+} JSON_cursor;
+
+// every field an event object can have, one bit each in Event_fields.seen
+enum
+{
+    F_CHANNEL, F_MESSAGE_TYPE, F_NOTE, F_VELOCITY, F_PRESSURE, F_CONTROLLER,
+    F_VALUE, F_PROGRAM, F_LSB, F_MSB, F_META_TYPE, F_LENGTH, F_SEQUENCE,
+    F_PORT, F_TEMPO, F_HOURS, F_MINUTES, F_SECONDS, F_FRAMES, F_FRACTIONAL,
+    F_FRAME_RATE, F_NUMERATOR, F_DENOMINATOR, F_CLOCKS, F_32ND, F_KEY,
+    F_SCALE, F_STATUS, F_PAYLOAD, F_COUNT
+};
+
+typedef struct
+{
+    int       kind;           // -1 until "type" is seen
+    uint32_t  seen;
+    int64_t   v[F_COUNT];
+    uint8_t  *payload;        // "text" or "data", already in the arena
+    uint32_t  payload_len;
+} Event_fields;
+
+#define KEY_IS(k, n, lit) ((n) == sizeof(lit) - 1 && !memcmp((k), (lit), sizeof(lit) - 1))
+
+// ---------------------------------------------------
+
+static inline void skip_ws(JSON_cursor *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\n' || *c->p == '\r' || *c->p == '\t'))
+        c->p++;
+}
+
+static inline int peek(JSON_cursor *c)
+{
+    skip_ws(c);
+    return c->p < c->end ? (unsigned char) *c->p : -1;
+}
+
+static inline int expect(JSON_cursor *c, char ch)
+{
+    if (peek(c) != (unsigned char) ch) return 0;
+    c->p++;
+    return 1;
+}
+
+// the body of a string, escapes left as they are. *escaped is set if
+// there are any
+static int read_raw_string(JSON_cursor *c, const char **s, size_t *n, int *escaped)
+{
+    if (!expect(c, '"')) return 0;
+
+    const char *start = c->p, *q = c->p;
+    int esc = 0;
+    for (;;)
+    {
+        // most strings have no escapes, jump straight to the quote
+        const char *quote = (const char*) memchr(q, '"', (size_t)(c->end - q));
+        if (!quote) return 0;
+        const char *bs = (const char*) memchr(q, '\\', (size_t)(quote - q));
+        if (!bs)
+        {
+            q = quote;
+            break;
+        }
+        esc = 1;
+        q = bs + 2;
+        if (q > c->end) return 0;
+    }
+
+    *s = start;
+    *n = (size_t)(q - start);
+    if (escaped) *escaped = esc;
+    c->p = q + 1;
+    return 1;
+}
+
+static int read_key(JSON_cursor *c, const char **k, size_t *n)
+{
+    return read_raw_string(c, k, n, NULL) && expect(c, ':');
+}
+
+static int read_int(JSON_cursor *c, int64_t *v)
+{
+    skip_ws(c);
+    int neg = 0;
+    if (c->p < c->end && *c->p == '-')
+    {
+        neg = 1;
+        c->p++;
+    }
+
+    const char *start = c->p;
+    uint64_t x = 0;
+    while (c->p < c->end && (unsigned)(*c->p - '0') < 10)
+    {
+        x = x * 10 + (uint64_t)(*c->p - '0');
+        if (x > (uint64_t) INT64_MAX / 10) return 0;
+        c->p++;
+    }
+    if (c->p == start) return 0;
+
+    *v = neg ? -(int64_t) x : (int64_t) x;
+    return 1;
+}
+
+// anything at all, for keys the reader doesn't need
+static int skip_value(JSON_cursor *c)
+{
+    int ch = peek(c);
+    if (ch == '"')
+    {
+        const char *s; size_t n;
+        return read_raw_string(c, &s, &n, NULL);
+    }
+    if (ch == '{' || ch == '[')
+    {
+        int depth = 0;
+        while (c->p < c->end)
+        {
+            char b = *c->p;
+            if (b == '"')
+            {
+                const char *s; size_t n;
+                if (!read_raw_string(c, &s, &n, NULL)) return 0;
+                continue;
+            }
+            c->p++;
+            if (b == '{' || b == '[') depth++;
+            else if ((b == '}' || b == ']') && --depth == 0) return 1;
+        }
+        return 0;
+    }
+
+    // numbers, true, false, null
+    const char *start = c->p;
+    while (c->p < c->end && *c->p != ',' && *c->p != '}' && *c->p != ']' &&
+           *c->p != ' ' && *c->p != '\n' && *c->p != '\r' && *c->p != '\t')
+        c->p++;
+    return c->p > start;
+}
+
+// the separator after a member or element, returns 1 for ',', 2 for close
+static int next_member(JSON_cursor *c, char close)
+{
+    int ch = peek(c);
+    c->p++;
+    if (ch == ',') return 1;
+    if (ch == (unsigned char) close) return 2;
+    return 0;
+}
+
+// ---------------------------------------------------
+
+static inline int hex_digit(unsigned char ch)
+{
+    if ((unsigned)(ch - '0') < 10) return ch - '0';
+    ch |= 0x20;
+    if ((unsigned)(ch - 'a') < 6) return ch - 'a' + 10;
+    return -1;
+}
+
+// "0x51" style fields, any number of digits
+static int read_hex_field(JSON_cursor *c, int64_t *v)
+{
+    const char *s; size_t n;
+    if (!read_raw_string(c, &s, &n, NULL)) return 0;
+    if (n < 3 || n > 10 || s[0] != '0' || (s[1] | 0x20) != 'x') return 0;
+
+    int64_t x = 0;
+    for (size_t i = 2; i < n; ++i)
+    {
+        int d = hex_digit((unsigned char) s[i]);
+        if (d < 0) return 0;
+        x = x << 4 | d;
+    }
+    *v = x;
+    return 1;
+}
+
+// "XX XX XX", decoded straight into the arena
+static int read_hex_payload(JSON_cursor *c, Event_fields *f)
+{
+    const char *s; size_t n;
+    if (!read_raw_string(c, &s, &n, NULL)) return 0;
+
+    size_t len = n ? (n + 1) / 3 : 0;
+    if (n && n != len * 3 - 1) return 0;
+    if (len > UINT32_MAX) return 0;
+
+    uint8_t *dst = (uint8_t*) arena_alloc(c->arena, len);
+    if (!dst) return 0;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        const unsigned char *h = (const unsigned char*) s + i * 3;
+        int hi = hex_digit(h[0]), lo = hex_digit(h[1]);
+        if (hi < 0 || lo < 0) return 0;
+        if (i + 1 < len && h[2] != ' ') return 0;
+        dst[i] = (uint8_t)(hi << 4 | lo);
+    }
+
+    f->payload     = dst;
+    f->payload_len = (uint32_t) len;
+    return 1;
+}
+
+// one escape starting at s[0] == '\\', the byte goes to *out. returns the
+// length of the escape or 0. \u escapes only name bytes, the writer
+// never uses them for anything above 0xFF
+static size_t unescape(const char *s, const char *end, uint8_t *out)
+{
+    if (end - s < 2) return 0;
+    switch (s[1])
+    {
+    case '"':  *out = '"';  return 2;
+    case '\\': *out = '\\'; return 2;
+    case '/':  *out = '/';  return 2;
+    case 'n':  *out = '\n'; return 2;
+    case 'r':  *out = '\r'; return 2;
+    case 't':  *out = '\t'; return 2;
+    case 'b':  *out = '\b'; return 2;
+    case 'f':  *out = '\f'; return 2;
+    case 'u':
+    {
+        if (end - s < 6) return 0;
+        int v = 0;
+        for (int i = 2; i < 6; ++i)
+        {
+            int d = hex_digit((unsigned char) s[i]);
+            if (d < 0) return 0;
+            v = v << 4 | d;
+        }
+        if (v > 0xFF) return 0;
+        *out = (uint8_t) v;
+        return 6;
+    }
+    default:
+        return 0;
+    }
+}
+
+static int read_text_payload(JSON_cursor *c, Event_fields *f)
+{
+    const char *s; size_t n; int escaped;
+    if (!read_raw_string(c, &s, &n, &escaped)) return 0;
+
+    // without escapes the bytes are the text, with them count first
+    size_t len = n;
+    if (escaped)
+    {
+        len = 0;
+        for (size_t i = 0; i < n; ++len)
+        {
+            uint8_t b;
+            size_t  k = s[i] == '\\' ? unescape(s + i, s + n, &b) : 1;
+            if (!k) return 0;
+            i += k;
+        }
+    }
+    if (len > UINT32_MAX) return 0;
+
+    uint8_t *dst = (uint8_t*) arena_alloc(c->arena, len);
+    if (!dst) return 0;
+
+    if (!escaped) memcpy(dst, s, n);
+    else
+    {
+        size_t o = 0;
+        for (size_t i = 0; i < n; ++o)
+        {
+            if (s[i] == '\\') i += unescape(s + i, s + n, &dst[o]);
+            else dst[o] = (uint8_t) s[i++];
+        }
+    }
+
+    f->payload     = dst;
+    f->payload_len = (uint32_t) len;
+    return 1;
+}
+
+// ---------------------------------------------------
+
+// a string that has to be one of names, *index is its position
+static int read_named(JSON_cursor *c, const char *const *names, int count, int64_t *index)
+{
+    const char *s; size_t n;
+    if (!read_raw_string(c, &s, &n, NULL)) return 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (strlen(names[i]) == n && !memcmp(s, names[i], n))
+        {
+            *index = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const char *const kind_names[]  = { "channel", "meta", "sysex" };
+static const char *const rate_names[]  = { "24 fps", "25 fps", "30 fps (drop frame)", "30 fps" };
+static const char *const scale_names[] = { "major", "minor" };
+
+// numeric fields by key, -1 for the ones handled on their own
+static int numeric_field(const char *k, size_t n)
+{
+    if (KEY_IS(k, n, "channel"))    return F_CHANNEL;
+    if (KEY_IS(k, n, "note"))       return F_NOTE;
+    if (KEY_IS(k, n, "velocity"))   return F_VELOCITY;
+    if (KEY_IS(k, n, "controller")) return F_CONTROLLER;
+    if (KEY_IS(k, n, "value"))      return F_VALUE;
+    if (KEY_IS(k, n, "length"))     return F_LENGTH;
+    if (KEY_IS(k, n, "pressure"))   return F_PRESSURE;
+    if (KEY_IS(k, n, "program"))    return F_PROGRAM;
+    if (KEY_IS(k, n, "lsb"))        return F_LSB;
+    if (KEY_IS(k, n, "msb"))        return F_MSB;
+    if (KEY_IS(k, n, "microseconds_per_quarter_note")) return F_TEMPO;
+    if (KEY_IS(k, n, "numerator"))  return F_NUMERATOR;
+    if (KEY_IS(k, n, "denominator")) return F_DENOMINATOR;
+    if (KEY_IS(k, n, "clocks_per_metronome_click")) return F_CLOCKS;
+    if (KEY_IS(k, n, "32nd_notes_per_24_clocks"))   return F_32ND;
+    if (KEY_IS(k, n, "key"))        return F_KEY;
+    if (KEY_IS(k, n, "sequence_number")) return F_SEQUENCE;
+    if (KEY_IS(k, n, "port"))       return F_PORT;
+    if (KEY_IS(k, n, "hours"))      return F_HOURS;
+    if (KEY_IS(k, n, "minutes"))    return F_MINUTES;
+    if (KEY_IS(k, n, "seconds"))    return F_SECONDS;
+    if (KEY_IS(k, n, "frames"))     return F_FRAMES;
+    if (KEY_IS(k, n, "fractional_frames")) return F_FRACTIONAL;
+    return -1;
+}
+
+static int read_event_fields(JSON_cursor *c, Event_fields *f)
+{
+    f->kind = -1;
+    f->seen = 0;
+    f->payload = NULL;
+    f->payload_len = 0;
+
+    if (!expect(c, '{')) return 0;
+    if (peek(c) == '}')
+    {
+        c->p++;
+        return 1;
+    }
+
+    int sep;
+    do
+    {
+        const char *k; size_t n;
+        if (!read_key(c, &k, &n)) return 0;
+
+        int ok, field = numeric_field(k, n);
+        if (field >= 0)
+            ok = read_int(c, &f->v[field]);
+        else if (KEY_IS(k, n, "type"))
+        {
+            int64_t kind;
+            ok = read_named(c, kind_names, 3, &kind);
+            f->kind = (int) kind;
+        }
+        else if (KEY_IS(k, n, "message_type"))
+            ok = read_hex_field(c, &f->v[field = F_MESSAGE_TYPE]);
+        else if (KEY_IS(k, n, "meta_type"))
+            ok = read_hex_field(c, &f->v[field = F_META_TYPE]);
+        else if (KEY_IS(k, n, "status"))
+            ok = read_hex_field(c, &f->v[field = F_STATUS]);
+        else if (KEY_IS(k, n, "text"))
+            ok = read_text_payload(c, f), field = F_PAYLOAD;
+        else if (KEY_IS(k, n, "data"))
+            ok = read_hex_payload(c, f), field = F_PAYLOAD;
+        else if (KEY_IS(k, n, "frame_rate"))
+            ok = read_named(c, rate_names, 4, &f->v[field = F_FRAME_RATE]);
+        else if (KEY_IS(k, n, "scale"))
+            ok = read_named(c, scale_names, 2, &f->v[field = F_SCALE]);
+        else
+            ok = skip_value(c);   // name, bpm
+
+        if (field >= 0) f->seen |= 1u << field;
+
+        if (!ok) return 0;
+        sep = next_member(c, '}');
+    } while (sep == 1);
+
+    return sep == 2;
+}
+
+// ---------------------------------------------------
+
+#define HAS(f, field)  (((f)->seen >> (field)) & 1u)
+#define BYTE(f, field) ((f)->v[field] >= 0 && (f)->v[field] <= 0xFF)
+#define DATA7(f, field) (HAS(f, field) && (f)->v[field] >= 0 && (f)->v[field] <= 0x7F)
+
+static int build_channel(const Event_fields *f, MTrk_event *ev)
+{
+    if (!HAS(f, F_MESSAGE_TYPE) || !HAS(f, F_CHANNEL)) return 0;
+    int64_t type = f->v[F_MESSAGE_TYPE], channel = f->v[F_CHANNEL];
+    if (type < 0x8 || type > 0xE || channel < 0 || channel > 0x0F) return 0;
+
+    // which keys carry the two parameters, by message type
+    static const int params[7][2] = {
+        { F_NOTE, F_VELOCITY }, { F_NOTE, F_VELOCITY }, { F_NOTE, F_PRESSURE },
+        { F_CONTROLLER, F_VALUE }, { F_PROGRAM, -1 }, { F_PRESSURE, -1 },
+        { F_LSB, F_MSB }
+    };
+    int p1 = params[type - 8][0], p2 = params[type - 8][1];
+    if (!DATA7(f, p1) || (p2 >= 0 && !DATA7(f, p2))) return 0;
+
+    ev->kind = CH;
+    ev->ev.channel_ev.type    = (uint8_t) type;
+    ev->ev.channel_ev.channel = (uint8_t) channel;
+    ev->ev.channel_ev.param1  = (uint8_t) f->v[p1];
+    ev->ev.channel_ev.param2  = p2 >= 0 ? (uint8_t) f->v[p2] : 0;
+    return 1;
+}
+
+// the writer spells most meta payloads out as fields, put the bytes back
+static int rebuild_meta_payload(const Event_fields *f, uint8_t type, uint8_t *d)
+{
+    switch (type)
+    {
+    case 0x00:
+        if (!HAS(f, F_SEQUENCE) || f->v[F_SEQUENCE] < 0 || f->v[F_SEQUENCE] > 0xFFFF) return 0;
+        d[0] = (uint8_t)(f->v[F_SEQUENCE] >> 8);
+        d[1] = (uint8_t) f->v[F_SEQUENCE];
+        return 2;
+
+    case 0x20:
+    case 0x21:
+    {
+        int field = type == 0x20 ? F_CHANNEL : F_PORT;
+        if (!HAS(f, field) || !BYTE(f, field)) return 0;
+        d[0] = (uint8_t) f->v[field];
+        return 1;
+    }
+
+    case 0x51:
+        if (!HAS(f, F_TEMPO) || f->v[F_TEMPO] < 0 || f->v[F_TEMPO] > 0xFFFFFF) return 0;
+        d[0] = (uint8_t)(f->v[F_TEMPO] >> 16);
+        d[1] = (uint8_t)(f->v[F_TEMPO] >> 8);
+        d[2] = (uint8_t) f->v[F_TEMPO];
+        return 3;
+
+    case 0x54:
+        if (!HAS(f, F_HOURS) || !HAS(f, F_MINUTES) || !HAS(f, F_SECONDS) ||
+            !HAS(f, F_FRAMES) || !HAS(f, F_FRACTIONAL) || !HAS(f, F_FRAME_RATE)) return 0;
+        if (f->v[F_HOURS] < 0 || f->v[F_HOURS] > 0x1F || !BYTE(f, F_MINUTES) ||
+            !BYTE(f, F_SECONDS) || !BYTE(f, F_FRAMES) || !BYTE(f, F_FRACTIONAL)) return 0;
+        d[0] = (uint8_t)(f->v[F_FRAME_RATE] << 5 | f->v[F_HOURS]);
+        d[1] = (uint8_t) f->v[F_MINUTES];
+        d[2] = (uint8_t) f->v[F_SECONDS];
+        d[3] = (uint8_t) f->v[F_FRAMES];
+        d[4] = (uint8_t) f->v[F_FRACTIONAL];
+        return 5;
+
+    case 0x58:
+    {
+        if (!HAS(f, F_NUMERATOR) || !HAS(f, F_DENOMINATOR) ||
+            !HAS(f, F_CLOCKS) || !HAS(f, F_32ND)) return 0;
+        if (!BYTE(f, F_NUMERATOR) || !BYTE(f, F_CLOCKS) || !BYTE(f, F_32ND)) return 0;
+
+        // written as a power of two, the byte is its exponent
+        int64_t den = f->v[F_DENOMINATOR];
+        uint8_t exp = 0;
+        while (exp < 31 && ((int64_t) 1 << exp) < den) exp++;
+        if (den < 1 || ((int64_t) 1 << exp) != den) return 0;
+
+        d[0] = (uint8_t) f->v[F_NUMERATOR];
+        d[1] = exp;
+        d[2] = (uint8_t) f->v[F_CLOCKS];
+        d[3] = (uint8_t) f->v[F_32ND];
+        return 4;
+    }
+
+    case 0x59:
+        if (!HAS(f, F_KEY) || !HAS(f, F_SCALE)) return 0;
+        if (f->v[F_KEY] < -128 || f->v[F_KEY] > 127) return 0;
+        d[0] = (uint8_t)(int8_t) f->v[F_KEY];
+        d[1] = (uint8_t) f->v[F_SCALE];
+        return 2;
+
+    default:
+        return 0;
+    }
+}
+
+static int build_meta(JSON_cursor *c, const Event_fields *f, MTrk_event *ev)
+{
+    if (!HAS(f, F_META_TYPE) || !HAS(f, F_LENGTH)) return 0;
+    if (!BYTE(f, F_META_TYPE) || f->v[F_LENGTH] < 0 || f->v[F_LENGTH] > 0x0FFFFFFF) return 0;
+
+    uint8_t  type = (uint8_t) f->v[F_META_TYPE];
+    uint32_t len  = (uint32_t) f->v[F_LENGTH];
+    uint8_t *data = NULL;
+
+    if (HAS(f, F_PAYLOAD))
+    {
+        if (f->payload_len != len) return 0;
+        data = f->payload;
+    }
+    else if (type != 0x2F)
+    {
+        uint8_t tmp[8];
+        if ((uint32_t) rebuild_meta_payload(f, type, tmp) != len) return 0;
+        data = (uint8_t*) arena_alloc(c->arena, len);
+        if (!data) return 0;
+        memcpy(data, tmp, len);
+    }
+
+    // the same checks the SMF parser makes, End of Track has no data
+    int fine = check_MTrk_meta_payload(type, len, data);
+    if (!fine || (fine == 2) != (data == NULL)) return 0;
+
+    ev->kind = META;
+    ev->ev.meta_ev.type = type;
+    ev->ev.meta_ev.len  = len;
+    ev->ev.meta_ev.data = data;
+    return 1;
+}
+
+static int build_sysex(const Event_fields *f, MTrk_event *ev)
+{
+    if (!HAS(f, F_LENGTH) || !HAS(f, F_PAYLOAD)) return 0;
+    if (f->v[F_LENGTH] != (int64_t) f->payload_len || f->payload_len > 0x0FFFFFFF) return 0;
+
+    // only escape packets say so, everything else started with F0
+    int64_t status = HAS(f, F_STATUS) ? f->v[F_STATUS] : 0xF0;
+    if (status != 0xF0 && status != 0xF7) return 0;
+
+    ev->kind = SYS;
+    ev->ev.sysex_ev.type = (uint8_t) status;
+    ev->ev.sysex_ev.len  = f->payload_len;
+    ev->ev.sysex_ev.data = f->payload;
+    return 1;
+}
+
+static int read_event(JSON_cursor *c, MTrk_event *ev)
+{
+    Event_fields f;
+    if (!read_event_fields(c, &f)) return 0;
+
+    switch (f.kind)
+    {
+    case 0:  return build_channel(&f, ev);
+    case 1:  return build_meta(c, &f, ev);
+    case 2:  return build_sysex(&f, ev);
+    default: return 0;
+    }
+}
+
+// ---------------------------------------------------
+
+static int track_reserve(MTrk *mtrk, size_t n)
+{
+    if (n <= mtrk->cap) return 1;
+
+    size_t cap = mtrk->cap ? mtrk->cap : 64;
+    while (cap < n)
+    {
+        if (cap > SIZE_MAX / 2) return 0;
+        cap *= 2;
+    }
+    if (cap > SIZE_MAX / sizeof(MTrk_event)) return 0;
+
+    MTrk_event *ev = (MTrk_event*) realloc(mtrk->events, cap * sizeof *ev);
+    if (!ev) return 0;
+
+    mtrk->events = ev;
+    mtrk->cap    = cap;
+    return 1;
+}
+
+// {"delta_time": n, "event": {...}}, NDJSON lines add track and tick.
+// *track is left alone unless the object names one
+static int read_track_event(JSON_cursor *c, MTrk_event *ev, int64_t *track)
+{
+    if (!expect(c, '{')) return 0;
+
+    int have_delta = 0, have_event = 0, sep;
+    do
+    {
+        const char *k; size_t n;
+        if (!read_key(c, &k, &n)) return 0;
+
+        int ok;
+        if (KEY_IS(k, n, "delta_time"))
+        {
+            int64_t d;
+            ok = read_int(c, &d) && d >= 0 && d <= 0x0FFFFFFF;
+            ev->delta_time = (uint32_t) d;
+            have_delta = 1;
+        }
+        else if (KEY_IS(k, n, "event"))
+        {
+            ok = read_event(c, ev);
+            have_event = 1;
+        }
+        else if (KEY_IS(k, n, "track"))
+            ok = read_int(c, track);
+        else
+            ok = skip_value(c);   // tick
+
+        if (!ok) return 0;
+        sep = next_member(c, '}');
+    } while (sep == 1);
+
+    return sep == 2 && have_delta && have_event;
+}
+
+static int read_events(JSON_cursor *c, MTrk *mtrk)
+{
+    if (!expect(c, '[')) return 0;
+    if (peek(c) == ']')
+    {
+        c->p++;
+        return 1;
+    }
+
+    int sep;
+    do
+    {
+        if (!track_reserve(mtrk, mtrk->count + 1)) return 0;
+
+        int64_t track = 0;
+        if (!read_track_event(c, &mtrk->events[mtrk->count], &track)) return 0;
+        mtrk->count++;
+        sep = next_member(c, ']');
+    } while (sep == 1);
+
+    return sep == 2;
+}
+
+static int read_track(JSON_cursor *c, MTrk *mtrk)
+{
+    if (!expect(c, '{')) return 0;
+
+    int sep;
+    do
+    {
+        const char *k; size_t n;
+        if (!read_key(c, &k, &n)) return 0;
+
+        int ok;
+        int64_t v;
+        if (KEY_IS(k, n, "events"))
+            ok = read_events(c, mtrk);
+        else if (KEY_IS(k, n, "size"))
+        {
+            ok = read_int(c, &v) && v >= 0 && v <= UINT32_MAX;
+            mtrk->size = (uint32_t) v;
+        }
+        else if (KEY_IS(k, n, "event_count"))
+        {
+            // sizes the array exactly when it comes before the events
+            ok = read_int(c, &v) && v >= 0 &&
+                 (mtrk->count || track_reserve(mtrk, (size_t) v));
+        }
+        else
+            ok = skip_value(c);   // track_number
+
+        if (!ok) return 0;
+        sep = next_member(c, '}');
+    } while (sep == 1);
+
+    return sep == 2;
+}
+
+// ---------------------------------------------------
+
+static int read_time_division(JSON_cursor *c, MThd *mthd)
+{
+    if (!expect(c, '{')) return 0;
+
+    int64_t type = -1, tpb = -1, smpte = 0, tpf = -1;
+    static const char *const div_names[] = { "ticks_per_beat", "frames_per_second" };
+
+    int sep;
+    do
+    {
+        const char *k; size_t n;
+        if (!read_key(c, &k, &n)) return 0;
+
+        int ok;
+        if      (KEY_IS(k, n, "type"))            ok = read_named(c, div_names, 2, &type);
+        else if (KEY_IS(k, n, "ticks_per_beat"))  ok = read_int(c, &tpb);
+        else if (KEY_IS(k, n, "smpte_format"))    ok = read_int(c, &smpte);
+        else if (KEY_IS(k, n, "ticks_per_frame")) ok = read_int(c, &tpf);
+        else                                      ok = skip_value(c);
+
+        if (!ok) return 0;
+        sep = next_member(c, '}');
+    } while (sep == 1);
+    if (sep != 2) return 0;
+
+    // the same fields check_for_MThd fills in from the raw word
+    if (type == 0 && tpb >= 0 && tpb <= 0x7FFF)
+    {
+        mthd->division = (uint16_t) tpb;
+        mthd->timediv.ticks_per_beat = (uint16_t) tpb;
+        return 1;
+    }
+    if (type == 1 && smpte >= -128 && smpte < 0 && tpf >= 0 && tpf <= 0xFF)
+    {
+        mthd->division = (uint16_t)((uint8_t)(int8_t) smpte << 8 | tpf);
+        mthd->timediv.frames_per_sec.smpte = (int8_t) smpte;
+        mthd->timediv.frames_per_sec.ticks = (uint8_t) tpf;
+        return 1;
+    }
+    return 0;
+}
+
+static int read_header(JSON_cursor *c, MThd *mthd)
+{
+    if (!expect(c, '{')) return 0;
+
+    int64_t fmt = -1, ntracks = -1;
+    int have_div = 0, sep;
+    do
+    {
+        const char *k; size_t n;
+        if (!read_key(c, &k, &n)) return 0;
+
+        int ok;
+        if      (KEY_IS(k, n, "format")) ok = read_int(c, &fmt);
+        else if (KEY_IS(k, n, "tracks")) ok = read_int(c, &ntracks);
+        else if (KEY_IS(k, n, "time_division"))
+            ok = read_time_division(c, mthd), have_div = 1;
+        else
+            ok = skip_value(c);
+
+        if (!ok) return 0;
+        sep = next_member(c, '}');
+    } while (sep == 1);
+
+    // the limits check_for_MThd puts on a real header
+    if (sep != 2 || !have_div) return 0;
+    if (fmt < 0 || fmt > 2 || ntracks < 1 || ntracks > 0xFFFF) return 0;
+    if (fmt == 0 && ntracks != 1) return 0;
+
+    mthd->fmt     = (uint16_t) fmt;
+    mthd->ntracks = (uint16_t) ntracks;
+    return 1;
+}
+
+typedef struct
+{
+    int    have_header;
+    int    have_tracks;
+    size_t ntracks;    // tracks read
+    size_t slots;      // entries of midi->mtrk, all zeroed up front
+} Document;
+
+// {"header": {...}, "tracks": [...]}, or only the header for NDJSON
+static int read_document(JSON_cursor *c, MIDI_file *midi, Document *doc)
+{
+    if (!expect(c, '{')) return 0;
+
+    int sep;
+    do
+    {
+        const char *k; size_t n;
+        if (!read_key(c, &k, &n)) return 0;
+
+        int ok = 1;
+        if (KEY_IS(k, n, "header"))
+        {
+            ok = read_header(c, &midi->mthd);
+            doc->have_header = 1;
+        }
+        else if (KEY_IS(k, n, "tracks"))
+        {
+            doc->have_tracks = 1;
+            if (!expect(c, '[')) return 0;
+            if (peek(c) == ']') c->p++;
+            else
+            {
+                int tsep;
+                do
+                {
+                    if (doc->ntracks == doc->slots)
+                    {
+                        size_t cap = doc->slots ? doc->slots * 2 : 16;
+                        if (cap > 0xFFFF + 1) return 0;
+                        MTrk *t = (MTrk*) realloc(midi->mtrk, cap * sizeof(MTrk));
+                        if (!t) return 0;
+                        memset(t + doc->slots, 0, (cap - doc->slots) * sizeof(MTrk));
+                        midi->mtrk = t;
+                        doc->slots = cap;
+                    }
+                    if (!read_track(c, &midi->mtrk[doc->ntracks++])) return 0;
+                    tsep = next_member(c, ']');
+                } while (tsep == 1);
+                ok = tsep == 2;
+            }
+        }
+        else
+            ok = skip_value(c);
+
+        if (!ok) return 0;
+        sep = next_member(c, '}');
+    } while (sep == 1);
+
+    return sep == 2;
+}
+
+// one event per line after the header, each names its own track
+static int read_ndjson_events(JSON_cursor *c, MIDI_file *midi, Document *doc)
+{
+    uint16_t ntracks = midi->mthd.ntracks;
+    midi->mtrk = (MTrk*) calloc(ntracks, sizeof(MTrk));
+    if (!midi->mtrk) return 0;
+    doc->slots = ntracks;
+
+    while (peek(c) == '{')
+    {
+        MTrk_event ev;
+        int64_t track = -1;
+        if (!read_track_event(c, &ev, &track)) return 0;
+        if (track < 0 || track >= ntracks) return 0;
+
+        MTrk *mtrk = &midi->mtrk[track];
+        if (!track_reserve(mtrk, mtrk->count + 1)) return 0;
+        mtrk->events[mtrk->count++] = ev;
+    }
+    return 1;
+}
+
+MIDI_file get_MIDI_JSON_buffer(const char *buf, size_t len, int *status)
+{
+    MIDI_file midi;
+    memset(&midi, 0, sizeof(MIDI_file));
+
+    JSON_cursor c = { buf, buf + len, &midi.arena };
+    Document doc = { 0, 0, 0, 0 };
+
+    if (!buf || !read_document(&c, &midi, &doc) || !doc.have_header) goto fail;
+
+    if (!doc.have_tracks)
+    {
+        // a header alone is the first line of NDJSON
+        if (!read_ndjson_events(&c, &midi, &doc)) goto fail;
+    }
+    else if (doc.ntracks != midi.mthd.ntracks)
+        goto fail;
+
+    if (peek(&c) != -1) goto fail;
+
+    *status = 0;
+    return midi;
+
+fail:
+    // the header's track count can't be trusted here, free every slot
+    for (size_t i = 0; i < doc.slots; ++i)
+        free_MTrk(&midi.mtrk[i]);
+    free(midi.mtrk);
+    arena_free(&midi.arena);
+    memset(&midi, 0, sizeof(MIDI_file));
+    *status = -1;
+    return midi;
+}
+
+MIDI_file get_MIDI_JSON_path(const char *path, int *status)
+{
+    MIDI_map map;
+    if (!open_MIDI_map(path, &map))
+    {
+        MIDI_file midi;
+        memset(&midi, 0, sizeof(MIDI_file));
+        *status = -1;
+        return midi;
+    }
+
+    MIDI_file midi = get_MIDI_JSON_buffer((const char*) map.buf, map.len, status);
+    close_MIDI_map(&map);
+    return midi;
+}
+
+int MIDI_JSON_sniff(const uint8_t *buf, size_t len)
+{
+    JSON_cursor c = { (const char*) buf, (const char*) buf + len, NULL };
+    return buf && peek(&c) == '{';
+}
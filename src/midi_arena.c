@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_arena.h"
+#include "midi_stats.h"
+
+static MIDI_arena_block *arena_new_block(MIDI_arena *arena, size_t cap)
+{
+    if (cap > SIZE_MAX - sizeof(MIDI_arena_block)) return NULL;
+
+    MIDI_arena_block *block = (MIDI_arena_block*) malloc(sizeof(MIDI_arena_block) + cap);
+    if (!block) return NULL;
+    MIDI_STAT_ALLOC(sizeof(MIDI_arena_block) + cap);
+
+    block->next = NULL;
+    block->used = 0;
+    block->cap  = cap;
+    arena->nblocks++;
+    return block;
+}
+
+void *arena_alloc(MIDI_arena *arena, size_t n)
+{
+    if (!arena) return NULL;
+
+    MIDI_arena_block *head = arena->head;
+    if (!head || head->cap - head->used < n)
+    {
+        // blocks double in size, anything too big for that gets its own
+        size_t cap = head ? head->cap * 2 : MIDI_ARENA_MIN_BLOCK;
+        if (cap > MIDI_ARENA_MAX_BLOCK) cap = MIDI_ARENA_MAX_BLOCK;
+
+        if (n > cap / 2 && head)
+        {
+            MIDI_arena_block *big = arena_new_block(arena, n);
+            if (!big) return NULL;
+
+            // keep filling the current block afterwards
+            big->next  = head->next;
+            head->next = big;
+            big->used  = n;
+
+            arena->nallocs++;
+            arena->bytes += n;
+            return big->data;
+        }
+
+        if (cap < n) cap = n;
+        MIDI_arena_block *block = arena_new_block(arena, cap);
+        if (!block) return NULL;
+
+        block->next = head;
+        arena->head = head = block;
+    }
+
+    void *p = head->data + head->used;
+    head->used += n;
+
+    arena->nallocs++;
+    arena->bytes += n;
+    return p;
+}
+
+void arena_splice(MIDI_arena *dst, MIDI_arena *src)
+{
+    if (!dst || !src || !src->head) return;
+
+    if (!dst->head)
+    {
+        dst->head = src->head;
+    }
+    else
+    {
+        // keep dst's head in front, it is the one with room left
+        MIDI_arena_block *tail = src->head;
+        while (tail->next) tail = tail->next;
+        tail->next = dst->head->next;
+        dst->head->next = src->head;
+    }
+
+    dst->nallocs += src->nallocs;
+    dst->nblocks += src->nblocks;
+    dst->bytes   += src->bytes;
+    memset(src, 0, sizeof(MIDI_arena));
+}
+
+void arena_reset(MIDI_arena *arena)
+{
+    if (!arena || !arena->head) return;
+
+    // keep only the biggest block, that's what the next round will need
+    MIDI_arena_block *keep = arena->head;
+    for (MIDI_arena_block *b = arena->head->next; b; b = b->next)
+        if (b->cap > keep->cap) keep = b;
+
+    MIDI_arena_block *block = arena->head;
+    while (block)
+    {
+        MIDI_arena_block *next = block->next;
+        if (block != keep) free(block);
+        block = next;
+    }
+
+    keep->next = NULL;
+    keep->used = 0;
+    arena->head    = keep;
+    arena->nblocks = 1;
+    arena->nallocs = 0;
+    arena->bytes   = 0;
+}
+
+void arena_free(MIDI_arena *arena)
+{
+    if (!arena) return;
+
+    MIDI_arena_block *block = arena->head;
+    while (block)
+    {
+        MIDI_arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(MIDI_arena));
+}
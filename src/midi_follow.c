@@ -0,0 +1,159 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "midi_follow.h"
+
+// new bytes are read and parsed this much at a time, so a long backlog
+// doesn't have to sit in memory all at once
+#define FOLLOW_SLICE (1 << 20)
+
+// ---------------------------------------------------
+
+int MIDI_follow_open(MIDI_follow *fw, const char *path)
+{
+    if (!fw || !path) return 0;
+    memset(fw, 0, sizeof(MIDI_follow));
+
+    fw->fd = open(path, O_RDONLY);
+    if (fw->fd < 0) return 0;
+    fw->state = FOLLOW_MTHD;
+    return 1;
+}
+
+void MIDI_follow_close(MIDI_follow *fw)
+{
+    if (!fw) return;
+
+    if (fw->fd >= 0) close(fw->fd);
+    free(fw->buf);
+    free_MIDI_file(&fw->midi);
+    memset(fw, 0, sizeof(MIDI_follow));
+    fw->fd = -1;
+}
+
+int MIDI_follow_done(const MIDI_follow *fw)
+{
+    return fw && fw->state == FOLLOW_DONE;
+}
+
+MIDI_file MIDI_follow_take(MIDI_follow *fw)
+{
+    MIDI_file midi = fw->midi;
+    memset(&fw->midi, 0, sizeof(MIDI_file));
+    MIDI_follow_close(fw);
+    return midi;
+}
+
+// ---------------------------------------------------
+
+// appends up to n bytes from the file, fewer when it has fewer
+static int read_more(MIDI_follow *fw, size_t n, size_t *got)
+{
+    if (fw->cap - fw->len < n)
+    {
+        size_t cap = fw->len + n;
+        uint8_t *buf = (uint8_t*) realloc(fw->buf, cap);
+        if (!buf) return 0;
+        fw->buf = buf;
+        fw->cap = cap;
+    }
+
+    *got = 0;
+    while (*got < n)
+    {
+        ssize_t r = pread(fw->fd, fw->buf + fw->len, n - *got, (off_t) fw->offset);
+        if (r < 0) return 0;
+        if (r == 0) break;
+        fw->len    += (size_t) r;
+        fw->offset += (uint64_t) r;
+        *got       += (size_t) r;
+    }
+    return 1;
+}
+
+// consumes every complete header and event in the buffer
+static int parse_buffered(MIDI_follow *fw, size_t *added)
+{
+    MIDI_file *midi = &fw->midi;
+    size_t pos = 0;
+
+    for (;;)
+    {
+        size_t left = fw->len - pos;
+        if (fw->state == FOLLOW_MTHD)
+        {
+            if (left < 14) break;
+
+            MIDI_cursor cur = { fw->buf + pos, left, 0 };
+            if (!check_for_MThd(&midi->mthd, &cur)) return 0;
+            midi->mtrk = (MTrk*) calloc(midi->mthd.ntracks, sizeof(MTrk));
+            if (!midi->mtrk) return 0;
+
+            pos += cur.pos;
+            fw->state = FOLLOW_CHUNK;
+        }
+        else if (fw->state == FOLLOW_CHUNK)
+        {
+            if (fw->track == midi->mthd.ntracks)
+            {
+                fw->state = FOLLOW_DONE;
+                break;
+            }
+            if (left < 8) break;
+            if (memcmp(fw->buf + pos, "MTrk", 4) != 0) return 0;
+
+            // the declared size may be a placeholder, size counts what
+            // was actually parsed
+            MTrk_reader_init(&fw->rd, NULL, 0, 0);
+            midi->mtrk[fw->track].size = 0;
+            pos += 8;
+            fw->state = FOLLOW_EVENTS;
+        }
+        else if (fw->state == FOLLOW_EVENTS)
+        {
+            MTrk  *mtrk  = &midi->mtrk[fw->track];
+            size_t count = mtrk->count, used;
+            if (!MTrk_append_events(mtrk, &fw->rd, fw->buf + pos, left,
+                                    &midi->arena, &used))
+                return 0;
+
+            pos        += used;
+            mtrk->size += (uint32_t) used;
+            *added     += mtrk->count - count;
+            if (!fw->rd.done) break;
+
+            fw->track++;
+            fw->state = FOLLOW_CHUNK;
+        }
+        else break;
+    }
+
+    // what's left is one partial header or event, kept for the next read
+    memmove(fw->buf, fw->buf + pos, fw->len - pos);
+    fw->len -= pos;
+    return 1;
+}
+
+int MIDI_follow_update(MIDI_follow *fw, size_t *added)
+{
+    if (!fw || fw->fd < 0 || !added) return 0;
+    *added = 0;
+    if (fw->state == FOLLOW_DONE) return 1;
+
+    struct stat st;
+    if (fstat(fw->fd, &st) != 0) return 0;
+    if ((uint64_t) st.st_size < fw->offset) return 0;
+
+    for (;;)
+    {
+        size_t got;
+        if (!read_more(fw, FOLLOW_SLICE, &got)) return 0;
+        if (!parse_buffered(fw, added)) return 0;
+        if (got < FOLLOW_SLICE || fw->state == FOLLOW_DONE) break;
+    }
+    return 1;
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include "midi_lazy.h"
+
+// ---------------------------------------------------
+
+static int lazy_init(MIDI_lazy *lz, size_t budget)
+{
+    MIDI_cursor cur = { lz->map.buf, lz->map.len, 0 };
+    if (!check_for_MThd(&lz->mthd, &cur)) return 0;
+
+    uint16_t ntracks = lz->mthd.ntracks;
+    lz->budget   = budget;
+    lz->chunks   = (MTrk_chunk*) calloc(ntracks, sizeof(MTrk_chunk));
+    lz->mtrk     = (MTrk*) calloc(ntracks, sizeof(MTrk));
+    lz->decoded  = (uint8_t*) calloc(ntracks, 1);
+    lz->last_use = (uint64_t*) calloc(ntracks, sizeof(uint64_t));
+    if (!lz->chunks || !lz->mtrk || !lz->decoded || !lz->last_use) return 0;
+
+    if (!scan_MTrk_chunks(&cur, ntracks, lz->chunks)) return 0;
+
+    for (uint16_t i = 0; i < ntracks; ++i)
+        lz->mtrk[i].size = lz->chunks[i].size;
+    return 1;
+}
+
+int MIDI_lazy_open_buffer(MIDI_lazy *lz, const uint8_t *buf, size_t len, size_t budget)
+{
+    if (!lz || !buf) return 0;
+    memset(lz, 0, sizeof(MIDI_lazy));
+
+    lz->map.buf = buf;
+    lz->map.len = len;
+    if (!lazy_init(lz, budget))
+    {
+        MIDI_lazy_close(lz);
+        return 0;
+    }
+    return 1;
+}
+
+int MIDI_lazy_open_path(MIDI_lazy *lz, const char *path, size_t budget)
+{
+    if (!lz || !path) return 0;
+    memset(lz, 0, sizeof(MIDI_lazy));
+
+    if (!open_MIDI_map(path, &lz->map)) return 0;
+    lz->owns_map = 1;
+    if (!lazy_init(lz, budget))
+    {
+        MIDI_lazy_close(lz);
+        return 0;
+    }
+    return 1;
+}
+
+void MIDI_lazy_close(MIDI_lazy *lz)
+{
+    if (!lz) return;
+
+    if (lz->mtrk)
+    {
+        for (uint16_t i = 0; i < lz->mthd.ntracks; ++i)
+            free_MTrk(&lz->mtrk[i]);
+    }
+    free(lz->mtrk);
+    free(lz->chunks);
+    free(lz->decoded);
+    free(lz->last_use);
+    if (lz->owns_map) close_MIDI_map(&lz->map);
+    memset(lz, 0, sizeof(MIDI_lazy));
+}
+
+// ---------------------------------------------------
+
+void MIDI_lazy_evict(MIDI_lazy *lz, uint16_t track)
+{
+    if (!lz || !lz->mtrk || track >= lz->mthd.ntracks) return;
+
+    if (!lz->decoded[track]) return;
+
+    MTrk *mtrk = &lz->mtrk[track];
+    lz->bytes -= mtrk->cap * sizeof(MTrk_event);
+    free_MTrk(mtrk);
+    lz->decoded[track] = 0;
+}
+
+// drops the least recently used tracks other than keep until the
+// decoded events fit, keep itself stays even if it's over on its own
+static void enforce_budget(MIDI_lazy *lz, uint16_t keep)
+{
+    while (lz->budget && lz->bytes > lz->budget)
+    {
+        int      victim = -1;
+        uint64_t oldest = UINT64_MAX;
+        for (uint16_t i = 0; i < lz->mthd.ntracks; ++i)
+        {
+            if (i == keep || !lz->decoded[i]) continue;
+            if (lz->last_use[i] < oldest)
+            {
+                oldest = lz->last_use[i];
+                victim = i;
+            }
+        }
+        if (victim < 0) return;
+        MIDI_lazy_evict(lz, (uint16_t) victim);
+    }
+}
+
+const MTrk *MIDI_lazy_track(MIDI_lazy *lz, uint16_t track)
+{
+    if (!lz || !lz->mtrk || track >= lz->mthd.ntracks) return NULL;
+
+    MTrk *mtrk = &lz->mtrk[track];
+    lz->last_use[track] = ++lz->clock;
+    if (lz->decoded[track]) return mtrk;
+
+    const MTrk_chunk *chunk = &lz->chunks[track];
+    MIDI_cursor sub = { lz->map.buf + chunk->offset, chunk->avail, 0 };
+    if (!parse_MTrk_events(mtrk, &sub, NULL))
+    {
+        free_MTrk(mtrk);
+        return NULL;
+    }
+
+    // growth slack would only count against the budget
+    if (mtrk->count > 0 && mtrk->count < mtrk->cap)
+    {
+        MTrk_event *events = (MTrk_event*) realloc(mtrk->events, sizeof(MTrk_event) * mtrk->count);
+        if (events)
+        {
+            mtrk->events = events;
+            mtrk->cap    = mtrk->count;
+        }
+    }
+
+    lz->decoded[track] = 1;
+    lz->bytes += mtrk->cap * sizeof(MTrk_event);
+    enforce_budget(lz, track);
+    return mtrk;
+}
+
+int MIDI_lazy_stream_track(const MIDI_lazy *lz, uint16_t track,
+                           MIDI_event_cb cb, void *user)
+{
+    if (!lz || !lz->chunks || !cb || track >= lz->mthd.ntracks) return 0;
+
+    const MTrk_chunk *chunk = &lz->chunks[track];
+    MTrk_reader rd;
+    MTrk_reader_init(&rd, lz->map.buf + chunk->offset, chunk->avail, chunk->size);
+
+    MIDI_stream_event sev;
+    sev.track = track;
+    sev.index = 0;
+
+    int code;
+    while ((code = MTrk_reader_next(&rd, &sev.event)) > 0)
+    {
+        sev.tick = rd.tick;
+        // a callback that stops early is how callers peek, not a failure
+        if (!cb(&sev, user)) return 1;
+        sev.index++;
+    }
+    return code == 0;
+}
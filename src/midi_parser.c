@@ -1,35 +1,37 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "midi_parser.h"
+#include "thread_pool.h"
+#include "parse_cache.h"
+#include "vlq.h"
 
 
+// payloads belong to the file's arena, only the event array is ours
 void free_MTrk(MTrk *mtrk)
 {
     if (mtrk)
     {
-        for (size_t i = 0; i < mtrk->count; ++i)
-        {
-            if (mtrk->events[i].kind == META)
-            {
-                void *data = mtrk->events[i].ev.meta_ev.data;
-                if (data) free(data);
-            }
-            else if (mtrk->events[i].kind == SYS)
-            {
-                void *data = mtrk->events[i].ev.sysex_ev.data;
-                if (data) free(data);
-            }
-        }
         if (mtrk->events) free(mtrk->events);
+        mtrk->events = NULL;
+        mtrk->count  = 0;
+        mtrk->cap    = 0;
     }
 }
 
 void free_MIDI_file(MIDI_file *midi)
 {
-    if (midi && midi->mtrk)
+    if (!midi) return;
+
+    if (midi->mtrk)
     {
         for (uint16_t i = 0; i < midi->mthd.ntracks; ++i)
         {
@@ -38,32 +40,67 @@ void free_MIDI_file(MIDI_file *midi)
         free(midi->mtrk);
         midi->mtrk = NULL;
     }
+    arena_free(&midi->arena);
+}
+
+// ---------------------------------------------------
+
+static inline int cursor_get(MIDI_cursor *cur, uint8_t *byte)
+{
+    if (cur->pos >= cur->len) return 0;
+    *byte = cur->buf[cur->pos++];
+    return 1;
+}
+
+static inline int cursor_read(MIDI_cursor *cur, void *dst, size_t n)
+{
+    if (cur->len - cur->pos < n) return 0;
+    memcpy(dst, cur->buf + cur->pos, n);
+    cur->pos += n;
+    return 1;
+}
+
+static inline const uint8_t *cursor_take(MIDI_cursor *cur, size_t n)
+{
+    if (cur->len - cur->pos < n) return NULL;
+    const uint8_t *p = cur->buf + cur->pos;
+    cur->pos += n;
+    return p;
 }
 
-int check_for_MThd(MThd *mthd, FILE *fp)
+static inline void cursor_skip(MIDI_cursor *cur, size_t n)
 {
-    if (!mthd || !fp) return 0;
+    // skipping past the end is not an error by itself, the next read fails
+    size_t left = cur->len - cur->pos;
+    cur->pos += n < left ? n : left;
+}
+
+static inline uint32_t read_u32_be(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] << 24 |
+           (uint32_t)buf[1] << 16 |
+           (uint32_t)buf[2] << 8  |
+           (uint32_t)buf[3];
+}
+
+int check_for_MThd(MThd *mthd, MIDI_cursor *cur)
+{
+    if (!mthd || !cur) return 0;
 
     // check for MThd string
     uint8_t buf[6];
-    if (fread(buf, 1, 4, fp) != 4) return 0;
+    if (!cursor_read(cur, buf, 4)) return 0;
 
-    uint32_t id = (uint32_t)buf[0] << 24 |
-                  (uint32_t)buf[1] << 16 |
-                  (uint32_t)buf[2] << 8  |
-                  (uint32_t)buf[3];
+    uint32_t id = read_u32_be(buf);
     if (id != MThd_string) return 0;
 
     // get chunk size (for MThd must be 6)
-    if (fread(buf, 1, 4, fp) != 4) return 0;
-    uint32_t size = (uint32_t)buf[0] << 24 |
-                    (uint32_t)buf[1] << 16 |
-                    (uint32_t)buf[2] << 8  |
-                    (uint32_t)buf[3];
+    if (!cursor_read(cur, buf, 4)) return 0;
+    uint32_t size = read_u32_be(buf);
     if (size != 0x00000006) return 0;
 
     // read actual content
-    if (fread(buf, 1, 6, fp) != 6) return 0;
+    if (!cursor_read(cur, buf, 6)) return 0;
     mthd->fmt     = (uint16_t)buf[0] << 8 | (uint16_t)buf[1];
     mthd->ntracks = (uint16_t)buf[2] << 8 | (uint16_t)buf[3];
 
@@ -71,6 +108,7 @@ int check_for_MThd(MThd *mthd, FILE *fp)
     if (mthd->fmt == 0 && mthd->ntracks != 1) return 0;
 
     uint16_t td   = (uint16_t)buf[4] << 8 | (uint16_t)buf[5];
+    mthd->division = td;
     if (td & 0x8000)
     {
         mthd->timediv.frames_per_sec.smpte = (int8_t)buf[4];
@@ -84,98 +122,69 @@ int check_for_MThd(MThd *mthd, FILE *fp)
     return 1;
 }
 
-static uint32_t get_VLQ(FILE *fp, int *status, uint32_t *bytes_read)
+static uint32_t get_VLQ(MIDI_cursor *cur, int *status, uint32_t *bytes_read)
 {
-    uint32_t vlq = 0, n = 0;
-    for (; n < 4; ++n)
+    uint32_t vlq = 0;
+    size_t n = MIDI_vlq_decode(cur->buf + cur->pos, cur->len - cur->pos, &vlq);
+    if (n == 0)
     {
-        int c = fgetc(fp);
-        if (c == EOF) { *status = -1; return vlq; }
-        vlq = (vlq << 7) | (uint32_t)(c & 0x7F);
-        if ((c & 0x80) == 0)
-        {
-            *bytes_read = n + 1;
-            *status = 0;
-            return vlq;
-        }
+        *status = -1;
+        return vlq;
     }
-    *status = -1;
+
+    cur->pos += n;
+    *bytes_read = (uint32_t) n;
+    *status = 0;
     return vlq;
 }
 
-int parse_MTrk_channel_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read)
+int parse_MTrk_channel_event(MTrk_event *ev, MIDI_cursor *cur, uint32_t *bytes_read)
 {
-    size_t idx = mtrk->count;
-    mtrk->events[idx].kind = CH;
+    ev->kind = CH;
 
-    uint8_t type    = mtrk->events[idx].ev.channel_ev.type;
-    // uint8_t channel = mtrk->events[idx].ev.channel_ev.channel;
+    uint8_t type    = ev->ev.channel_ev.type;
+    // uint8_t channel = ev->ev.channel_ev.channel;
 
+    uint8_t param[2];
     switch (type)
     {
     case 0x0C:
     case 0x0D:
-        uint8_t param;
-        if (fread(&param, 1, 1, fp) != 1) return 0;
-        if (param > 127) return 0;
-        mtrk->events[idx].ev.channel_ev.param1 = param;
+        if (!cursor_read(cur, param, 1)) return 0;
+        if (param[0] > 127) return 0;
+        ev->ev.channel_ev.param1 = param[0];
+        ev->ev.channel_ev.param2 = 0;
         *bytes_read = 1;
         break;
-        
+
     case 0x8:
     case 0x9:
     case 0xA:
     case 0xB:
     case 0xE:
-        uint8_t param1, param2;
-        if (fread(&param1, 1, 1, fp) != 1) return 0;
-        if (fread(&param2, 1, 1, fp) != 1) return 0;
-        if (param1 > 127 || param2 > 127)  return 0;
-        mtrk->events[idx].ev.channel_ev.param1 = param1;
-        mtrk->events[idx].ev.channel_ev.param2 = param2;
+        if (!cursor_read(cur, param, 2)) return 0;
+        if (param[0] > 127 || param[1] > 127) return 0;
+        ev->ev.channel_ev.param1 = param[0];
+        ev->ev.channel_ev.param2 = param[1];
         *bytes_read = 2;
         break;
-        
+
     default:
         return 0;
     }
-    
+
     return 1;
 }
 
-int parse_MTrk_meta_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read)
+// checks a meta payload against what the spec allows for its type,
+// returns 2 for End of Track, 1 for any other valid event, 0 otherwise
+int check_MTrk_meta_payload(uint8_t type, uint32_t len, const uint8_t *p)
 {
-    uint8_t type;
-    if (fread(&type, 1, 1, fp) != 1) return 0;
-
-    size_t idx = mtrk->count;
-    mtrk->events[idx].kind = META;
-    mtrk->events[idx].ev.meta_ev.type = type;
-    (*bytes_read)++;
-
-    int code; uint32_t len_bytes;
-    uint32_t len = get_VLQ(fp, &code, &len_bytes);
-    if (code < 0) return 0;
-    mtrk->events[idx].ev.meta_ev.len = len;
-    (*bytes_read) += len_bytes;
-
-    uint8_t buf[4];
-    printf("type -> %d\n", type);
     switch (type)
     {
     case 0x00:
-    {
         if (len != 2) return 0;
-        void *val = malloc(len);
-        if (!val) return 0;
-
-        if (fread(buf, 1, 2, fp) != 2) { free(val); return 0; }
-        *(uint8_t*)val       = buf[0];
-        *((uint8_t*)val + 1) = buf[1];
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += 2;
         break;
-    }
 
     case 0x01:
     case 0x02:
@@ -185,131 +194,65 @@ int parse_MTrk_meta_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read)
     case 0x06:
     case 0x07:
     case 0x09:
-    {
-        void *val = malloc(len);
-        if (!val) return 0;
-
-        if (fread(val, 1, len, fp) != len) { free(val); return 0; }
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += (uint32_t)len;
         break;
-    }
 
     case 0x20:
-    {
         if (len != 1) return 0;
-        void *val = malloc(1);
-        if (!val) return 0;
-
-        if (fread(val, 1, 1, fp) != 1) { free(val); return 0; }
-        if (*(uint8_t*)val > 15) { free(val); return 0; }
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read)++;
+        if (p[0] > 15) return 0;
         break;
-    }
 
     case 0x21:
-    {
         if (len != 1) return 0;
-        void *val = malloc(1);
-        if (!val) return 0;
-
-        if (fread(val, 1, 1, fp) != 1) { free(val); return 0; }
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read)++;
         break;
-    }
 
     case 0x2F:
-    {
         if (len != 0) return 0;
-        mtrk->events[idx].ev.meta_ev.data = NULL;
         return 2;
-    }
 
     case 0x51:
     {
         if (len != 3) return 0;
-        void *val = malloc(3);
-        if (!val) return 0;
-
-        if (fread(val, 1, 3, fp) != 3)  { free(val); return 0; }
-
-        uint8_t *p = val;
         uint32_t us_per_qn = (p[0] << 16) | (p[1] << 8) | p[2];
-        if (us_per_qn > 8355711u) { free(val); return 0; }
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += 3;
+        if (us_per_qn > 8355711u) return 0;
         break;
     }
 
     case 0x54:
     {
         if (len != 5) return 0;
-        void *val = malloc(5);
-        if (!val) return 0;
 
-        if (fread(val, 1, 5, fp) != 5) { free(val); return 0; }
-        
         // check the hour byte for correctness
         // the bit layout is 0rrhhhhh
-        uint8_t hour_byte = *(uint8_t*)val;
+        uint8_t hour_byte = p[0];
         uint8_t rr        = (hour_byte >> 5) & 0x03;
-        if ((hour_byte) & 0x80 || (hour_byte & 0x1F) > 23) { free(val); return 0; }
-        
+        if ((hour_byte) & 0x80 || (hour_byte & 0x1F) > 23) return 0;
+
         // check for fr byte correctness, based on rr
-        uint8_t fr = *((uint8_t*)val + 3);
+        uint8_t fr = p[3];
         if ((rr == 0 && fr > 23) ||
             (rr == 1 && fr > 24) ||
             (rr == 2 && fr > 29) ||
-            (rr == 3 && fr > 29)) { free(val); return 0; }
-        
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += 5;
+            (rr == 3 && fr > 29)) return 0;
         break;
     }
 
     case 0x58:
-    {
         if (len != 4) return 0;
-        void *val = malloc(4);
-        if (!val) return 0;
-
-        if (fread(val, 1, 4, fp) != 4) { free(val); return 0; }
-        if (*((uint8_t*)val+3) == 0)   { free(val); return 0; }
-        
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += 4;
+        // the denominator is 2^p[1], past 2^30 it doesn't fit a uint32
+        if (p[1] > 30 || p[3] == 0) return 0;
         break;
-    }
 
     case 0x59:
     {
         if (len != 2) return 0;
-        void *val = malloc(2);
-        if (!val) return 0;
-
-        if (fread(val, 1, 2, fp) != 2) { free(val); return 0; }
-        
-        int8_t key = *(int8_t*)val;
-        uint8_t scale = *((uint8_t*)val+1);
-        if (key < -7 || key > 7 || scale > 1) { free(val); return 0; }
-        
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += 2;
+        int8_t key = (int8_t)p[0];
+        uint8_t scale = p[1];
+        if (key < -7 || key > 7 || scale > 1) return 0;
         break;
     }
 
     case 0x7F:
-    {
-        void *val = malloc(len);
-        if (!val) return 0;
-
-        if (fread(val, 1, len, fp) != len) { free(val); return 0; }
-        mtrk->events[idx].ev.meta_ev.data = val;
-        (*bytes_read) += len;
         break;
-    }
 
     default:
         return 0;
@@ -318,29 +261,59 @@ int parse_MTrk_meta_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read)
     return 1;
 }
 
-int parse_MTrk_sysex_event(MTrk *mtrk, FILE *fp, uint32_t *bytes_read)
+int parse_MTrk_meta_event(MTrk_event *ev, MIDI_cursor *cur, uint32_t *bytes_read)
 {
-    size_t idx = mtrk->count;
-    mtrk->events[idx].kind = SYS;
+    uint8_t type;
+    if (!cursor_get(cur, &type)) return 0;
+
+    ev->kind = META;
+    ev->ev.meta_ev.type = type;
+    (*bytes_read)++;
 
     int code; uint32_t len_bytes;
-    uint32_t len = get_VLQ(fp, &code, &len_bytes);
+    uint32_t len = get_VLQ(cur, &code, &len_bytes);
     if (code < 0) return 0;
+    ev->ev.meta_ev.len = len;
+    (*bytes_read) += len_bytes;
 
-    void *val = malloc(len);
-    if (!val) return 0;
+    const uint8_t *p = cursor_take(cur, len);
+    if (!p) return 0;
+
+    int fine = check_MTrk_meta_payload(type, len, p);
+    if (!fine) return 0;
 
-    if (fread(val, 1, len, fp) != len) { free(val); return 0; }
-    mtrk->events[idx].ev.sysex_ev.len  = len;
-    mtrk->events[idx].ev.sysex_ev.data = val;
+    // the payload is left where it is, callers copy it if they keep it
+    ev->ev.meta_ev.data = fine == 2 ? NULL : (void*)p;
     (*bytes_read) += len;
-    
+
+    return fine;
+}
+
+int parse_MTrk_sysex_event(MTrk_event *ev, MIDI_cursor *cur, uint32_t *bytes_read)
+{
+    ev->kind = SYS;
+
+    int code; uint32_t len_bytes;
+    uint32_t len = get_VLQ(cur, &code, &len_bytes);
+    if (code < 0) return 0;
+
+    const uint8_t *p = cursor_take(cur, len);
+    if (!p) return 0;
+
+    ev->ev.sysex_ev.len  = len;
+    ev->ev.sysex_ev.data = (void*)p;
+    (*bytes_read) += len_bytes + len;
+
     return 1;
 }
 
+// exactly min_needed the first time, which is the event count when the
+// track was counted up front, doubling after that
 static int MTrk_grow(MTrk *mtrk, size_t min_needed)
 {
-    size_t cap = mtrk->cap ? mtrk->cap : 64;
+    if (min_needed <= mtrk->cap) return 1;
+
+    size_t cap = mtrk->cap ? mtrk->cap : min_needed;
     while (cap < min_needed)
     {
         if (cap > SIZE_MAX / 2) return 0;
@@ -350,6 +323,8 @@ static int MTrk_grow(MTrk *mtrk, size_t min_needed)
 
     MTrk_event *ev = (MTrk_event*) realloc(mtrk->events, cap * sizeof *ev);
     if (!ev) return 0;
+    MIDI_STAT_ADD(grows, 1);
+    MIDI_STAT_ALLOC(cap * sizeof *ev);
 
     mtrk->events = ev;
     mtrk->cap = cap;
@@ -362,134 +337,721 @@ static inline int mtrk_ensure_one(MTrk *mtrk)
     return MTrk_grow(mtrk, mtrk->count + 1);
 }
 
-int parse_MTrk_events(MTrk *mtrk, FILE *fp)
+const uint8_t MIDI_channel_data_len[16] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 1, 1, 2, 0
+};
+
+// moves *pos past the event whose status byte, or first data byte under
+// running status, is at data[*pos]. only lengths are decoded, 0 when the
+// event runs past end
+static inline int step_event(const uint8_t *data, size_t end, size_t *pos_io,
+                             uint8_t *running)
 {
-    uint32_t remaining_bytes = mtrk->size;
-    uint8_t running_status = 0;
-    while (remaining_bytes > 0)
+    size_t   pos = *pos_io, k;
+    uint32_t v;
+
+    uint8_t status = data[pos];
+    if (status == 0xFF || status == 0xF0 || status == 0xF7)
+    {
+        // meta events have their type byte before the length
+        pos += status == 0xFF ? 2 : 1;
+        if (pos > end) return 0;
+        if (!(k = MIDI_vlq_decode(data + pos, end - pos, &v))) return 0;
+        pos += k;
+        if (v > end - pos) return 0;
+        pos += v;
+    }
+    else
     {
+        if (status >= 0x80)
+        {
+            *running = status;
+            pos++;
+        }
+        size_t len = MIDI_channel_data_len[*running >> 4];
+        if (len == 0 || len > end - pos) return 0;
+        pos += len;
+    }
+
+    *pos_io = pos;
+    return 1;
+}
+
+// status is the event's own or the running one, meta_type only
+// matters when status is 0xFF. End Of Track is always kept, it takes
+// the delta of whatever was dropped before it and keeps the track's length
+static inline int filter_drops(const MIDI_event_filter *f, uint8_t status, uint8_t meta_type)
+{
+    if (status == 0xFF)
+        return meta_type != 0x2F &&
+               ((f->skip_kinds >> META & 1) || (f->skip_meta[meta_type >> 3] >> (meta_type & 7) & 1));
+    if (status == 0xF0 || status == 0xF7)
+        return f->skip_kinds >> SYS & 1;
+    return (f->skip_kinds >> CH & 1) || (f->skip_messages >> (status >> 4) & 1) ||
+           (f->skip_channels >> (status & 0x0F) & 1);
+}
+
+void MTrk_reader_init(MTrk_reader *rd, const uint8_t *data, size_t avail, uint32_t size)
+{
+    rd->cur.buf = data;
+    rd->cur.len = avail < size ? avail : size;
+    rd->cur.pos = 0;
+    rd->size    = size;
+    rd->running_status = 0;
+    rd->tick    = 0;
+    rd->done    = 0;
+    rd->filter  = NULL;
+}
+
+int MTrk_reader_next(MTrk_reader *rd, MTrk_event *ev)
+{
+    MIDI_cursor *cur = &rd->cur;
+    uint32_t delta;
+    uint8_t  evtype;
+
+    // delta times of filtered events, added to the next one returned
+    uint64_t carry = 0;
+    for (;;)
+    {
+        if (rd->done || cur->pos >= rd->size)
+        {
+            rd->done = 1;
+            return 0;
+        }
+
         // read the event delta time as a VLQ
         int code; uint32_t delta_bytes;
-        uint32_t delta = get_VLQ(fp, &code, &delta_bytes);
-        if (code < 0) return 0;
-
-        if (!mtrk_ensure_one(mtrk)) return 0;
-        size_t idx = mtrk->count;
+        delta = get_VLQ(cur, &code, &delta_bytes);
+        if (code < 0) return -1;
+
+        // a delta time must be followed by an event
+        if (cur->pos >= rd->size) return -1;
+
+        // read the event type and dispatch, running status
+        // leaves the byte in place as the first parameter
+        if (cur->pos >= cur->len) return -1;
+        evtype = cur->buf[cur->pos];
+        if (!rd->filter) break;
+
+        uint8_t status = evtype >= 0x80 ? evtype : rd->running_status;
+        uint8_t meta   = cur->pos + 1 < cur->len ? cur->buf[cur->pos + 1] : 0;
+        // an event whose delta no longer fits is kept to carry it
+        if (!filter_drops(rd->filter, status, meta) || carry + delta > UINT32_MAX) break;
+
+        size_t pos = cur->pos;
+        if (!step_event(cur->buf, cur->len, &pos, &rd->running_status)) return -1;
+        cur->pos = pos;
+        carry += delta;
+        MIDI_STAT_ADD(skipped, 1);
+    }
 
-        mtrk->events[idx].delta_time = delta;
-        remaining_bytes -= delta_bytes;
+    delta += (uint32_t) carry;
+    ev->delta_time = delta;
 
-        if (remaining_bytes == 0) return 0;
+    uint32_t bytes_read = 0;
+    if (evtype >= 0x80)
+    {
+        cur->pos++;
+        ev->ev.channel_ev.type    = evtype >> 4;
+        ev->ev.channel_ev.channel = evtype & 0x0F;
 
-        // read the event type and dispatch
-        uint8_t evtype;
-        if (fread(&evtype, 1, 1, fp) != 1) return 0;
+        if (evtype == 0xFF)
+        {
+            int fine = parse_MTrk_meta_event(ev, cur, &bytes_read);
+            if (!fine) return -1;
+            MIDI_STAT_ADD(events[MIDI_STAT_META], 1);
 
-        uint32_t bytes_read = 0;
-        if (evtype >= 0x80)
+            // if fine == 2, End Of Track occurred and the
+            // rest of the chunk is ignored
+            if (fine == 2) rd->done = 1;
+        }
+        else if (evtype == 0xF0 || evtype == 0xF7)
         {
-            mtrk->events[idx].ev.channel_ev.type    = evtype >> 4;
-            mtrk->events[idx].ev.channel_ev.channel = evtype & 0x0F;
-            remaining_bytes--;
-
-            if (evtype == 0xFF)
-            {
-                int fine = parse_MTrk_meta_event(mtrk, fp, &bytes_read) > 0;
-                if (!fine) return 0;
-                
-                if (bytes_read > remaining_bytes) return 0;
-                remaining_bytes -= bytes_read;
-
-                // if fine == 2, End Of Track occurred
-                if (fine == 2)
-                {
-                    if (remaining_bytes > 0) fseek(fp, (long)remaining_bytes, SEEK_CUR);
-                    mtrk->count++;
-                    return 1;
-                }
-            }
-            else if (evtype == 0xF0 || evtype == 0xF7)
-            {
-                if (!parse_MTrk_sysex_event(mtrk, fp, &bytes_read)) return 0;
-                if (bytes_read > remaining_bytes) return 0;
-                remaining_bytes -= bytes_read;
-            }
-            else
-            {
-                running_status = evtype;
-                if (!parse_MTrk_channel_event(mtrk, fp, &bytes_read)) return 0;
-                if (bytes_read > remaining_bytes) return 0;
-                remaining_bytes -= bytes_read;
-            }
+            if (!parse_MTrk_sysex_event(ev, cur, &bytes_read)) return -1;
+            ev->ev.sysex_ev.type = evtype;
+            MIDI_STAT_ADD(events[MIDI_STAT_SYSEX], 1);
         }
         else
         {
-            mtrk->events[idx].ev.channel_ev.type    = running_status >> 4;
-            mtrk->events[idx].ev.channel_ev.channel = running_status & 0x0F;
-            fseek(fp, -1L, SEEK_CUR);
-            if (!parse_MTrk_channel_event(mtrk, fp, &bytes_read)) return 0;
-            if (bytes_read > remaining_bytes) return 0;
-            remaining_bytes -= bytes_read;
+            rd->running_status = evtype;
+            if (!parse_MTrk_channel_event(ev, cur, &bytes_read)) return -1;
+            MIDI_STAT_ADD(events[(evtype >> 4) - 8], 1);
         }
+    }
+    else
+    {
+        ev->ev.channel_ev.type    = rd->running_status >> 4;
+        ev->ev.channel_ev.channel = rd->running_status & 0x0F;
+        if (!parse_MTrk_channel_event(ev, cur, &bytes_read)) return -1;
+        MIDI_STAT_ADD(events[(rd->running_status >> 4) - 8], 1);
+        MIDI_STAT_ADD(running_status, 1);
+    }
+
+    rd->tick += delta;
+    return 1;
+}
+
+int MTrk_count_events_filtered(const uint8_t *data, size_t avail, uint32_t size,
+                               const MIDI_event_filter *filter, size_t *count)
+{
+    size_t end = avail < size ? avail : size;
+    size_t pos = 0, n = 0;
+    uint8_t running = 0;
+
+    // the same walk as MTrk_reader_next, only lengths are decoded. the
+    // rare event kept to carry an overflowing delta is not counted, the
+    // parse grows the array for it
+    while (pos < size)
+    {
+        uint32_t v;
+        size_t k = MIDI_vlq_decode(data + pos, end - pos, &v);
+        if (!k) return 0;
+        pos += k;
+        if (pos >= end) return 0;
+
+        uint8_t status = data[pos];
+        uint8_t meta   = end - pos > 1 ? data[pos + 1] : 0;
+        if (!filter || !filter_drops(filter, status >= 0x80 ? status : running, meta)) n++;
+        if (!step_event(data, end, &pos, &running)) return 0;
+        if (status == 0xFF && meta == 0x2F) break;
+    }
+
+    *count = n;
+    return 1;
+}
+
+int MTrk_count_events(const uint8_t *data, size_t avail, uint32_t size, size_t *count)
+{
+    return MTrk_count_events_filtered(data, avail, size, NULL, count);
+}
+
+// moves a payload borrowed from the input buffer into the arena
+static int own_payload(MTrk_event *ev, MIDI_arena *arena)
+{
+    void   **data;
+    uint32_t len;
+
+    if (ev->kind == META)
+    {
+        data = &ev->ev.meta_ev.data;
+        len  = ev->ev.meta_ev.len;
+    }
+    else if (ev->kind == SYS)
+    {
+        data = &ev->ev.sysex_ev.data;
+        len  = ev->ev.sysex_ev.len;
+    }
+    else return 1;
+
+    if (!*data) return 1;
+
+    void *val = arena_alloc(arena, len);
+    if (!val) return 0;
+    memcpy(val, *data, len);
+    *data = val;
+
+    return 1;
+}
+
+int parse_MTrk_events_filtered(MTrk *mtrk, MIDI_cursor *cur, MIDI_arena *arena,
+                               const MIDI_event_filter *filter)
+{
+    const uint8_t *data  = cur->buf + cur->pos;
+    size_t         avail = cur->len - cur->pos;
+
+    // a malformed track fails in the reader below with the usual result
+    size_t total;
+    if (MTrk_count_events_filtered(data, avail, mtrk->size, filter, &total) &&
+        !MTrk_grow(mtrk, mtrk->count + total))
+        return 0;
+
+    MTrk_reader rd;
+    MTrk_reader_init(&rd, data, avail, mtrk->size);
+    rd.filter = filter;
+
+    int code;
+    for (;;)
+    {
+        // with the count known this is only used by the final read
+        MTrk_event  spare;
+        MTrk_event *ev = mtrk->count < mtrk->cap ? &mtrk->events[mtrk->count] : &spare;
+        code = MTrk_reader_next(&rd, ev);
+        if (code <= 0) break;
+
+        if (ev == &spare)
+        {
+            if (!mtrk_ensure_one(mtrk)) return 0;
+            mtrk->events[mtrk->count] = spare;
+            ev = &mtrk->events[mtrk->count];
+        }
+
+        if (arena && !own_payload(ev, arena)) return 0;
         mtrk->count++;
     }
 
+    MIDI_STAT_ADD(bytes_read, rd.cur.pos);
+    cursor_skip(cur, mtrk->size);
+    return code == 0;
+}
+
+int parse_MTrk_events(MTrk *mtrk, MIDI_cursor *cur, MIDI_arena *arena)
+{
+    return parse_MTrk_events_filtered(mtrk, cur, arena, NULL);
+}
+
+// bytes of the event at data[0], delta time included. 1 when it's all
+// there, 0 when data ends inside it, -1 when it can never be valid.
+// *running and *eot are only updated for a complete event
+static int event_extent(const uint8_t *data, size_t avail, uint8_t *running,
+                        size_t *len, int *eot)
+{
+    uint32_t v;
+    size_t pos = MIDI_vlq_decode(data, avail, &v);
+    if (!pos) return avail >= MIDI_VLQ_MAX_BYTES ? -1 : 0;
+    if (pos >= avail) return 0;
+
+    uint8_t status = data[pos], run = *running;
+    int     end_of_track = 0;
+    if (status == 0xFF || status == 0xF0 || status == 0xF7)
+    {
+        if (status == 0xFF)
+        {
+            if (avail - pos < 2) return 0;
+            end_of_track = data[pos + 1] == 0x2F;
+        }
+        pos += status == 0xFF ? 2 : 1;
+        size_t k = MIDI_vlq_decode(data + pos, avail - pos, &v);
+        if (!k) return avail - pos >= MIDI_VLQ_MAX_BYTES ? -1 : 0;
+        pos += k;
+        if (v > avail - pos) return 0;
+        pos += v;
+    }
+    else
+    {
+        if (status >= 0x80)
+        {
+            run = status;
+            pos++;
+        }
+        size_t n = MIDI_channel_data_len[run >> 4];
+        if (n == 0) return -1;
+        if (n > avail - pos) return 0;
+        pos += n;
+    }
+
+    *running = run;
+    *len     = pos;
+    *eot     = end_of_track;
     return 1;
 }
 
-int parse_MTrk(MTrk *mtrk, FILE *fp)
+int MTrk_append_events(MTrk *mtrk, MTrk_reader *rd, const uint8_t *data, size_t avail,
+                       MIDI_arena *arena, size_t *used)
 {
-    if (!mtrk || !fp) return 0;
+    *used = 0;
+    if (rd->done) return 1;
+
+    // lengths first, so the reader below never sees a cut off event and
+    // the array grows once for everything that arrived
+    size_t  end = 0, n = 0, len;
+    uint8_t running = rd->running_status;
+    int     eot = 0;
+    while (!eot && end < avail && end <= UINT32_MAX - (avail - end))
+    {
+        int code = event_extent(data + end, avail - end, &running, &len, &eot);
+        if (code < 0) return 0;
+        if (code == 0) break;
+        end += len;
+        n++;
+    }
+    if (n == 0) return 1;
+    if (!MTrk_grow(mtrk, mtrk->count + n)) return 0;
+
+    // the reader carries running status and tick from call to call
+    rd->cur.buf = data;
+    rd->cur.len = end;
+    rd->cur.pos = 0;
+    rd->size    = (uint32_t) end;
+
+    int code;
+    while ((code = MTrk_reader_next(rd, &mtrk->events[mtrk->count])) > 0)
+    {
+        if (arena && !own_payload(&mtrk->events[mtrk->count], arena)) return 0;
+        mtrk->count++;
+    }
+    if (code < 0) return 0;
+
+    // running out of window is not the end of the track
+    rd->done = eot;
+    MIDI_STAT_ADD(bytes_read, end);
+    *used = end;
+    return 1;
+}
+
+int parse_MTrk(MTrk *mtrk, MIDI_cursor *cur, MIDI_arena *arena)
+{
+    if (!mtrk || !cur) return 0;
 
     // check for MTrk id
     uint8_t buf[4];
-    if (fread(buf, 1, 4, fp) != 4) return 0;
-    uint32_t id = (uint32_t)buf[0] << 24 |
-                  (uint32_t)buf[1] << 16 |
-                  (uint32_t)buf[2] << 8  |
-                  (uint32_t)buf[3];
-    
+    if (!cursor_read(cur, buf, 4)) return 0;
+    uint32_t id = read_u32_be(buf);
+
     if (id != MTrk_string) return 0;
 
-    if (fread(buf, 1, 4, fp) != 4) return 0;
-    uint32_t size = (uint32_t)buf[0] << 24 |
-                    (uint32_t)buf[1] << 16 |
-                    (uint32_t)buf[2] << 8  |
-                    (uint32_t)buf[3];
+    if (!cursor_read(cur, buf, 4)) return 0;
+    uint32_t size = read_u32_be(buf);
 
     mtrk->size  = size;
     mtrk->count = 0;
-    return parse_MTrk_events(mtrk, fp);
+    return parse_MTrk_events(mtrk, cur, arena);
 }
 
-MIDI_file get_MIDI_file(FILE *fp, int *status)
+// ---------------------------------------------------
+
+typedef struct
+{
+    const uint8_t    *buf;
+    const MTrk_chunk *chunks;
+    MTrk             *mtrk;
+    int              *ok;
+    MIDI_arena       *owner;    // worker 0 allocates here directly
+    MIDI_arena       *arenas;   // one per other worker, no locking needed
+    MIDI_stats       *stats;
+    const MIDI_event_filter *filter;
+} Track_job;
+
+// every MTrk starts with its length, so all tracks can be located up
+// front and then decoded independently of each other
+int scan_MTrk_chunks(MIDI_cursor *cur, uint16_t ntracks, MTrk_chunk *chunks)
+{
+    for (uint16_t i = 0; i < ntracks; ++i)
+    {
+        uint8_t buf[8];
+        if (!cursor_read(cur, buf, 8)) return 0;
+        if (read_u32_be(buf) != MTrk_string) return 0;
+
+        uint32_t size = read_u32_be(buf + 4);
+        size_t   left = cur->len - cur->pos;
+
+        chunks[i].offset = cur->pos;
+        chunks[i].size   = size;
+        chunks[i].avail  = size < left ? size : left;
+        cursor_skip(cur, size);
+    }
+    return 1;
+}
+
+static void decode_track_task(size_t i, unsigned worker, void *ctx)
+{
+    Track_job *job = (Track_job*) ctx;
+
+    MIDI_cursor sub = { job->buf + job->chunks[i].offset, job->chunks[i].avail, 0 };
+    job->mtrk[i].size = job->chunks[i].size;
+    MIDI_arena *arena = worker == 0 ? job->owner : &job->arenas[worker];
+
+#ifdef MIDI_STATS
+    // the caller flushed before starting, anything left is from earlier work
+    MIDI_stat_flush(NULL);
+    uint64_t t0 = MIDI_stat_now();
+#endif
+
+    job->ok[i] = parse_MTrk_events_filtered(&job->mtrk[i], &sub, arena, job->filter);
+
+#ifdef MIDI_STATS
+    if (job->stats)
+    {
+        job->stats->track_ns[i] = MIDI_stat_now() - t0;
+        MIDI_stat_flush(job->stats);
+    }
+#endif
+}
+
+static MIDI_file parse_MIDI_buffer(const uint8_t *buf, size_t len,
+                                   const MIDI_parse_opts *opts, int *status)
 {
     MIDI_file midi;
     memset(&midi, 0, sizeof(MIDI_file));
 
-    if (!fp) goto fail;
-    if (!check_for_MThd(&midi.mthd, fp)) goto fail;
+    MIDI_cursor cur = { buf, len, 0 };
+    MTrk_chunk *chunks = NULL;
+    int        *ok     = NULL;
+    MIDI_arena *arenas = NULL;
+    MIDI_stats *stats  = opts ? opts->stats : NULL;
+    unsigned nthreads  = opts && opts->nthreads > 1 ? opts->nthreads : 1;
+
+    if (!buf) goto fail;
+    if (!check_for_MThd(&midi.mthd, &cur)) goto fail;
+
+    uint16_t ntracks = midi.mthd.ntracks;
+    chunks = (MTrk_chunk*) malloc(sizeof(MTrk_chunk) * ntracks);
+    ok     = (int*) calloc(ntracks, sizeof(int));
+    MIDI_STAT_ALLOC((sizeof(MTrk_chunk) + sizeof(int)) * ntracks);
+    if (!chunks || !ok) goto fail;
+    if (!scan_MTrk_chunks(&cur, ntracks, chunks)) goto fail;
 
-    midi.mtrk = (MTrk*) malloc(sizeof(MTrk) * midi.mthd.ntracks);
+    midi.mtrk = (MTrk*) calloc(ntracks, sizeof(MTrk));
     if (!midi.mtrk) goto fail;
 
-    for (uint16_t i = 0; i < midi.mthd.ntracks; ++i)
+    if (nthreads > ntracks) nthreads = ntracks;
+    arenas = (MIDI_arena*) calloc(nthreads, sizeof(MIDI_arena));
+    if (!arenas) goto fail;
+    MIDI_STAT_ALLOC(sizeof(MTrk) * ntracks + sizeof(MIDI_arena) * nthreads);
+
+#ifdef MIDI_STATS
+    if (stats && !MIDI_stat_tracks(stats, ntracks)) stats = NULL;
+    if (stats) MIDI_stat_flush(stats);
+#endif
+
+    MIDI_arena *owner = opts && opts->arena ? opts->arena : &midi.arena;
+    Track_job job = { buf, chunks, midi.mtrk, ok, owner, arenas, stats,
+                      opts ? opts->filter : NULL };
+
+    int fine = 1;
+    if (nthreads > 1)
     {
-        memset(&midi.mtrk[i], 0, sizeof(MTrk));
-        if (!parse_MTrk(&midi.mtrk[i], fp))
+        // each worker only touches its own slot, so the result does not
+        // depend on scheduling
+        parallel_for(ntracks, nthreads, decode_track_task, &job);
+        for (uint16_t i = 0; i < ntracks; ++i)
+            if (!ok[i]) fine = 0;
+    }
+    else
+    {
+        for (uint16_t i = 0; i < ntracks && fine; ++i)
         {
-            free_MTrk(&midi.mtrk[i]);
-            for (uint16_t j = 0; j < i; ++j)
-                free_MTrk(&midi.mtrk[j]);
-            free(midi.mtrk);
-            goto fail;
+            decode_track_task(i, 0, &job);
+            fine = ok[i];
         }
     }
 
+    for (unsigned w = 1; w < nthreads; ++w)
+        arena_splice(owner, &arenas[w]);
+
+    if (!fine)
+    {
+        free_MIDI_file(&midi);
+        goto fail;
+    }
+
+    free(chunks);
+    free(ok);
+    free(arenas);
     *status = 0;
     return midi;
 
 fail:
-    *status = -1; 
+    free(chunks);
+    free(ok);
+    free(arenas);
+    *status = -1;
     return midi;
-}
\ No newline at end of file
+}
+
+static MIDI_file load_MIDI_buffer(const uint8_t *buf, size_t len,
+                                  const MIDI_parse_opts *opts, int *status)
+{
+    if (!opts || !opts->cache || opts->filter || !buf) return parse_MIDI_buffer(buf, len, opts, status);
+
+    uint64_t key[2];
+    MIDI_cache_key(buf, len, key);
+
+    MIDI_file midi;
+    MIDI_arena *arena = opts->arena ? opts->arena : &midi.arena;
+    if (MIDI_cache_lookup(opts->cache, key, &midi, arena))
+    {
+        *status = 0;
+        return midi;
+    }
+
+    // a file that fails to store is still returned, the cache is only a shortcut
+    midi = parse_MIDI_buffer(buf, len, opts, status);
+    if (*status == 0) MIDI_cache_store(opts->cache, key, &midi);
+    return midi;
+}
+
+MIDI_file get_MIDI_buffer_opts(const uint8_t *buf, size_t len,
+                               const MIDI_parse_opts *opts, int *status)
+{
+#ifdef MIDI_STATS
+    MIDI_stats *stats = opts ? opts->stats : NULL;
+    if (!stats) return load_MIDI_buffer(buf, len, opts, status);
+
+    // a cache hit is timed too, it just has no tracks
+    MIDI_stat_flush(NULL);
+    uint64_t t0 = MIDI_stat_now();
+    MIDI_file midi = load_MIDI_buffer(buf, len, opts, status);
+    stats->parse_ns += MIDI_stat_now() - t0;
+    MIDI_stat_flush(stats);
+    return midi;
+#else
+    return load_MIDI_buffer(buf, len, opts, status);
+#endif
+}
+
+MIDI_file get_MIDI_buffer(const uint8_t *buf, size_t len, int *status)
+{
+    return get_MIDI_buffer_opts(buf, len, NULL, status);
+}
+
+// reads the rest of a stream into one heap buffer, works for pipes too
+static uint8_t *read_stream(FILE *fp, size_t *len_out)
+{
+    size_t cap = 1 << 16, len = 0;
+    uint8_t *buf = (uint8_t*) malloc(cap);
+    if (!buf) return NULL;
+
+    for (;;)
+    {
+        size_t n = fread(buf + len, 1, cap - len, fp);
+        len += n;
+        if (len < cap)
+        {
+            if (ferror(fp)) { free(buf); return NULL; }
+            break;
+        }
+
+        if (cap > SIZE_MAX / 2) { free(buf); return NULL; }
+        uint8_t *tmp = (uint8_t*) realloc(buf, cap * 2);
+        if (!tmp) { free(buf); return NULL; }
+        buf = tmp;
+        cap *= 2;
+    }
+
+    *len_out = len;
+    return buf;
+}
+
+int open_MIDI_map(const char *path, MIDI_map *map)
+{
+    if (!path || !map) return 0;
+    memset(map, 0, sizeof(MIDI_map));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        size_t len = (size_t)st.st_size;
+        void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            close(fd);
+            posix_madvise(addr, len, POSIX_MADV_SEQUENTIAL);
+            map->buf    = (const uint8_t*)addr;
+            map->len    = len;
+            map->mapped = 1;
+            return 1;
+        }
+    }
+
+    // not mappable (e.g. a pipe), fall back to reading it whole
+    FILE *fp = fdopen(fd, "rb");
+    if (!fp) { close(fd); return 0; }
+
+    size_t len;
+    uint8_t *buf = read_stream(fp, &len);
+    fclose(fp);
+    if (!buf) return 0;
+
+    map->buf = buf;
+    map->len = len;
+    return 1;
+}
+
+void close_MIDI_map(MIDI_map *map)
+{
+    if (!map || !map->buf) return;
+
+    if (map->mapped) munmap((void*)map->buf, map->len);
+    else             free((void*)map->buf);
+    memset(map, 0, sizeof(MIDI_map));
+}
+
+MIDI_file get_MIDI_path_opts(const char *path, const MIDI_parse_opts *opts, int *status)
+{
+    MIDI_file midi;
+    memset(&midi, 0, sizeof(MIDI_file));
+    *status = -1;
+
+    MIDI_map map;
+    if (!open_MIDI_map(path, &map)) return midi;
+
+    midi = get_MIDI_buffer_opts(map.buf, map.len, opts, status);
+    close_MIDI_map(&map);
+
+    return midi;
+}
+
+MIDI_file get_MIDI_path(const char *path, int *status)
+{
+    return get_MIDI_path_opts(path, NULL, status);
+}
+
+MIDI_file get_MIDI_file_opts(FILE *fp, const MIDI_parse_opts *opts, int *status)
+{
+    MIDI_file midi;
+    memset(&midi, 0, sizeof(MIDI_file));
+    *status = -1;
+
+    if (!fp) return midi;
+
+    size_t len;
+    uint8_t *buf = read_stream(fp, &len);
+    if (!buf) return midi;
+
+    midi = get_MIDI_buffer_opts(buf, len, opts, status);
+    free(buf);
+
+    return midi;
+}
+
+MIDI_file get_MIDI_file(FILE *fp, int *status)
+{
+    return get_MIDI_file_opts(fp, NULL, status);
+}
+
+// ---------------------------------------------------
+
+int stream_MIDI_buffer(const uint8_t *buf, size_t len, MThd *mthd,
+                       MIDI_event_cb cb, void *user)
+{
+    if (!buf || !cb) return 0;
+
+    MThd local;
+    if (!mthd) mthd = &local;
+
+    MIDI_cursor cur = { buf, len, 0 };
+    if (!check_for_MThd(mthd, &cur)) return 0;
+
+    for (uint16_t i = 0; i < mthd->ntracks; ++i)
+    {
+        MTrk_chunk chunk;
+        if (!scan_MTrk_chunks(&cur, 1, &chunk)) return 0;
+
+        MTrk_reader rd;
+        MTrk_reader_init(&rd, buf + chunk.offset, chunk.avail, chunk.size);
+
+        MIDI_stream_event sev;
+        sev.track = i;
+        sev.index = 0;
+
+        int code;
+        while ((code = MTrk_reader_next(&rd, &sev.event)) > 0)
+        {
+            sev.tick = rd.tick;
+            if (!cb(&sev, user)) return 0;
+            sev.index++;
+        }
+        if (code < 0) return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include "midi_push.h"
+
+// ---------------------------------------------------
+
+void MIDI_push_init(MIDI_push *ps, MIDI_event_cb cb, void *user)
+{
+    memset(ps, 0, sizeof(MIDI_push));
+    ps->state = PUSH_MTHD;
+    ps->cb    = cb;
+    ps->user  = user;
+}
+
+void MIDI_push_free(MIDI_push *ps)
+{
+    if (!ps) return;
+    free(ps->payload);
+    ps->payload     = NULL;
+    ps->payload_cap = 0;
+}
+
+int MIDI_push_finish(const MIDI_push *ps)
+{
+    return ps && ps->state == PUSH_DONE;
+}
+
+// ---------------------------------------------------
+
+static inline uint32_t read_u32_be(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] << 24 |
+           (uint32_t)buf[1] << 16 |
+           (uint32_t)buf[2] << 8  |
+           (uint32_t)buf[3];
+}
+
+static int fail(MIDI_push *ps)
+{
+    ps->state = PUSH_FAILED;
+    return 0;
+}
+
+// a track is over once its chunk is used up, like MTrk_reader_next
+static void end_track(MIDI_push *ps)
+{
+    ps->sev.track++;
+    ps->nhead = 0;
+    ps->state = ps->sev.track == ps->mthd.ntracks ? PUSH_DONE : PUSH_CHUNK;
+}
+
+static void next_event(MIDI_push *ps)
+{
+    ps->vlq       = 0;
+    ps->vlq_bytes = 0;
+    ps->state     = PUSH_DELTA;
+    if (ps->chunk_left == 0) end_track(ps);
+}
+
+// adds one byte to the VLQ being collected, 1 once it's complete
+static inline int vlq_step(MIDI_push *ps, uint8_t byte, int *bad)
+{
+    ps->vlq = ps->vlq << 7 | (byte & 0x7Fu);
+    if (++ps->vlq_bytes > 4) *bad = 1;
+    return byte < 0x80;
+}
+
+static int emit(MIDI_push *ps)
+{
+    MTrk_event *ev = &ps->sev.event;
+    ev->delta_time = ps->delta;
+    ps->sev.tick  += ps->delta;
+
+    int ok = ps->cb(&ps->sev, ps->user);
+    ps->sev.index++;
+    return ok;
+}
+
+static int emit_channel(MIDI_push *ps)
+{
+    MTrk_event *ev = &ps->sev.event;
+    uint8_t status = ps->running_status;
+    ev->kind = CH;
+    ev->ev.channel_ev.type    = status >> 4;
+    ev->ev.channel_ev.channel = status & 0x0F;
+    ev->ev.channel_ev.param1  = ps->data[0];
+    ev->ev.channel_ev.param2  = ps->ndata > 1 ? ps->data[1] : 0;
+    MIDI_STAT_ADD(events[(status >> 4) - 8], 1);
+
+    if (!emit(ps)) return fail(ps);
+    next_event(ps);
+    return 1;
+}
+
+// p holds the whole payload, either in the input or in ps->payload
+static int emit_payload(MIDI_push *ps, const uint8_t *p)
+{
+    MTrk_event *ev = &ps->sev.event;
+    uint32_t len = ps->payload_len;
+    int end_of_track = 0;
+
+    if (ps->status == 0xFF)
+    {
+        int fine = check_MTrk_meta_payload(ps->meta_type, len, p);
+        if (!fine) return fail(ps);
+        end_of_track = fine == 2;
+
+        ev->kind = META;
+        ev->ev.meta_ev.type = ps->meta_type;
+        ev->ev.meta_ev.len  = len;
+        ev->ev.meta_ev.data = end_of_track ? NULL : (void*) p;
+        MIDI_STAT_ADD(events[MIDI_STAT_META], 1);
+    }
+    else
+    {
+        ev->kind = SYS;
+        ev->ev.sysex_ev.type = ps->status;
+        ev->ev.sysex_ev.len  = len;
+        ev->ev.sysex_ev.data = (void*) p;
+        MIDI_STAT_ADD(events[MIDI_STAT_SYSEX], 1);
+    }
+
+    if (!emit(ps)) return fail(ps);
+
+    // the rest of the chunk after End Of Track is ignored, after the
+    // last track there's nothing left to wait for
+    if (end_of_track)
+    {
+        ps->state = PUSH_SKIP;
+        if (ps->chunk_left == 0 || ps->sev.track + 1 == ps->mthd.ntracks) end_track(ps);
+    }
+    else next_event(ps);
+    return 1;
+}
+
+// the length is known, empty payloads go out right away
+static int start_payload(MIDI_push *ps)
+{
+    ps->payload_len = ps->vlq;
+    ps->payload_got = 0;
+    if (ps->payload_len > ps->chunk_left) return fail(ps);
+    // empty payloads still point somewhere, as they do in the pull parser
+    static const uint8_t empty[1];
+    if (ps->payload_len == 0) return emit_payload(ps, empty);
+
+    ps->state = PUSH_PAYLOAD;
+    return 1;
+}
+
+static int header_byte(MIDI_push *ps, uint8_t byte)
+{
+    ps->head[ps->nhead++] = byte;
+
+    if (ps->state == PUSH_MTHD)
+    {
+        if (ps->nhead < 14) return 1;
+
+        MIDI_cursor cur = { ps->head, 14, 0 };
+        if (!check_for_MThd(&ps->mthd, &cur)) return fail(ps);
+        ps->nhead = 0;
+        ps->state = PUSH_CHUNK;
+        return 1;
+    }
+
+    if (ps->nhead < 8) return 1;
+    if (read_u32_be(ps->head) != MTrk_string) return fail(ps);
+
+    ps->chunk_left     = read_u32_be(ps->head + 4);
+    ps->running_status = 0;
+    ps->sev.index      = 0;
+    ps->sev.tick       = 0;
+    next_event(ps);
+    return 1;
+}
+
+// one byte of an event, chunk_left was already checked and charged
+static int event_byte(MIDI_push *ps, uint8_t byte)
+{
+    int bad = 0;
+    switch (ps->state)
+    {
+    case PUSH_DELTA:
+        if (!vlq_step(ps, byte, &bad)) return bad ? fail(ps) : 1;
+        if (bad) return fail(ps);
+        ps->delta = ps->vlq;
+        ps->state = PUSH_STATUS;
+
+        // a delta time must be followed by an event
+        if (ps->chunk_left == 0) return fail(ps);
+        return 1;
+
+    case PUSH_STATUS:
+        ps->status = byte;
+        ps->vlq = 0;
+        ps->vlq_bytes = 0;
+        if (byte == 0xFF)
+        {
+            ps->state = PUSH_META_TYPE;
+            return 1;
+        }
+        if (byte == 0xF0 || byte == 0xF7)
+        {
+            ps->state = PUSH_LENGTH;
+            return 1;
+        }
+
+        ps->ndata = 0;
+        if (byte >= 0x80)
+        {
+            if (MIDI_channel_data_len[byte >> 4] == 0) return fail(ps);
+            ps->running_status = byte;
+            ps->state = PUSH_DATA;
+            return 1;
+        }
+
+        // running status, the byte is the first parameter
+        if (MIDI_channel_data_len[ps->running_status >> 4] == 0) return fail(ps);
+        MIDI_STAT_ADD(running_status, 1);
+        ps->state = PUSH_DATA;
+        /* fall through */
+
+    case PUSH_DATA:
+        if (byte > 127) return fail(ps);
+        ps->data[ps->ndata++] = byte;
+        if (ps->ndata == MIDI_channel_data_len[ps->running_status >> 4]) return emit_channel(ps);
+        return 1;
+
+    case PUSH_META_TYPE:
+        ps->meta_type = byte;
+        ps->state = PUSH_LENGTH;
+        return 1;
+
+    case PUSH_LENGTH:
+        if (!vlq_step(ps, byte, &bad)) return bad ? fail(ps) : 1;
+        if (bad) return fail(ps);
+        return start_payload(ps);
+
+    default:
+        return fail(ps);
+    }
+}
+
+int MIDI_push_feed(MIDI_push *ps, const uint8_t *bytes, size_t n)
+{
+    if (!ps || !ps->cb || ps->state == PUSH_FAILED) return 0;
+    if (!bytes && n) return fail(ps);
+    MIDI_STAT_ADD(bytes_read, n);
+
+    size_t i = 0;
+    while (i < n)
+    {
+        switch (ps->state)
+        {
+        case PUSH_DONE:
+            return 1;
+
+        case PUSH_MTHD:
+        case PUSH_CHUNK:
+            if (!header_byte(ps, bytes[i++])) return 0;
+            break;
+
+        case PUSH_SKIP:
+        {
+            size_t k = n - i < ps->chunk_left ? n - i : ps->chunk_left;
+            i += k;
+            ps->chunk_left -= (uint32_t) k;
+            if (ps->chunk_left == 0) end_track(ps);
+            break;
+        }
+
+        case PUSH_PAYLOAD:
+        {
+            uint32_t need = ps->payload_len - ps->payload_got;
+            size_t   k    = n - i < need ? n - i : need;
+            ps->chunk_left -= (uint32_t) k;
+
+            // whole in this piece, it's handed out without a copy
+            if (ps->payload_got == 0 && k == need)
+            {
+                const uint8_t *p = bytes + i;
+                i += k;
+                if (!emit_payload(ps, p)) return 0;
+                break;
+            }
+
+            if (ps->payload_cap < ps->payload_len)
+            {
+                uint8_t *buf = (uint8_t*) realloc(ps->payload, ps->payload_len);
+                if (!buf) return fail(ps);
+                MIDI_STAT_ALLOC(ps->payload_len);
+                ps->payload     = buf;
+                ps->payload_cap = ps->payload_len;
+            }
+            memcpy(ps->payload + ps->payload_got, bytes + i, k);
+            ps->payload_got += (uint32_t) k;
+            i += k;
+            if (ps->payload_got == ps->payload_len && !emit_payload(ps, ps->payload)) return 0;
+            break;
+        }
+
+        default:
+            // an event can't run past the end of its chunk
+            if (ps->chunk_left == 0) return fail(ps);
+            ps->chunk_left--;
+            if (!event_byte(ps, bytes[i++])) return 0;
+            break;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "midi_stats.h"
+
+static const char *kind_names[MIDI_STAT_KINDS] = {
+    "note_off", "note_on", "poly_pressure", "control", "program",
+    "channel_pressure", "pitch_bend", "meta", "sysex"
+};
+
+void MIDI_stats_free(MIDI_stats *st)
+{
+    if (!st) return;
+    free(st->track_ns);
+    memset(st, 0, sizeof(MIDI_stats));
+}
+
+int MIDI_stats_enabled(void)
+{
+#ifdef MIDI_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// ---------------------------------------------------
+
+#ifdef MIDI_STATS
+
+__thread MIDI_stat_counts MIDI_stat_tally;
+
+uint64_t MIDI_stat_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+void MIDI_stat_flush(MIDI_stats *st)
+{
+    MIDI_stat_counts *t = &MIDI_stat_tally;
+    if (st)
+    {
+        // workers of one parse flush concurrently
+        MIDI_stat_counts *c = &st->counts;
+        __atomic_fetch_add(&c->bytes_read,     t->bytes_read,     __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->bytes_written,  t->bytes_written,  __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->running_status, t->running_status, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->skipped,        t->skipped,        __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->grows,          t->grows,          __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->mallocs,        t->mallocs,        __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->malloc_bytes,   t->malloc_bytes,   __ATOMIC_RELAXED);
+        for (int k = 0; k < MIDI_STAT_KINDS; ++k)
+            __atomic_fetch_add(&c->events[k], t->events[k], __ATOMIC_RELAXED);
+    }
+    memset(t, 0, sizeof(MIDI_stat_counts));
+}
+
+int MIDI_stat_tracks(MIDI_stats *st, uint16_t ntracks)
+{
+    uint64_t *ns = (uint64_t*) realloc(st->track_ns, sizeof(uint64_t) * (ntracks ? ntracks : 1));
+    if (!ns) return 0;
+
+    memset(ns, 0, sizeof(uint64_t) * ntracks);
+    st->track_ns = ns;
+    st->ntracks  = ntracks;
+    return 1;
+}
+
+#endif
+
+// ---------------------------------------------------
+
+static double rate(uint64_t n, uint64_t ns)
+{
+    return ns ? (double) n * 1e9 / (double) ns : 0.0;
+}
+
+static void print_text(const MIDI_stats *st, FILE *fp)
+{
+    const MIDI_stat_counts *c = &st->counts;
+    uint64_t events = 0;
+    for (int k = 0; k < MIDI_STAT_KINDS; ++k) events += c->events[k];
+
+    fprintf(fp, "Stats:\n");
+    fprintf(fp, "  Parse: %.3f ms, %llu bytes, %.2f MB/s, %.0f events/s\n",
+            st->parse_ns / 1e6, (unsigned long long) c->bytes_read,
+            rate(c->bytes_read, st->parse_ns) / 1e6, rate(events, st->parse_ns));
+    fprintf(fp, "  JSON: %.3f ms, %llu bytes, %.2f MB/s\n",
+            st->json_ns / 1e6, (unsigned long long) c->bytes_written,
+            rate(c->bytes_written, st->json_ns) / 1e6);
+    fprintf(fp, "  Events: %llu, %llu with running status\n",
+            (unsigned long long) events, (unsigned long long) c->running_status);
+    if (c->skipped)
+        fprintf(fp, "  Skipped: %llu\n", (unsigned long long) c->skipped);
+    for (int k = 0; k < MIDI_STAT_KINDS; ++k)
+        if (c->events[k])
+            fprintf(fp, "    %-17s %llu\n", kind_names[k], (unsigned long long) c->events[k]);
+    fprintf(fp, "  Allocations: %llu (%llu bytes), %llu event array grows\n",
+            (unsigned long long) c->mallocs, (unsigned long long) c->malloc_bytes,
+            (unsigned long long) c->grows);
+    for (uint16_t i = 0; i < st->ntracks; ++i)
+        fprintf(fp, "  Track %u: %.3f ms\n", i, st->track_ns[i] / 1e6);
+}
+
+static void print_json(const MIDI_stats *st, FILE *fp)
+{
+    const MIDI_stat_counts *c = &st->counts;
+
+    fprintf(fp, "{\"enabled\":%s,\"parse_ns\":%llu,\"json_ns\":%llu,",
+            MIDI_stats_enabled() ? "true" : "false",
+            (unsigned long long) st->parse_ns, (unsigned long long) st->json_ns);
+    fprintf(fp, "\"bytes_read\":%llu,\"bytes_written\":%llu,\"running_status\":%llu,",
+            (unsigned long long) c->bytes_read, (unsigned long long) c->bytes_written,
+            (unsigned long long) c->running_status);
+    fprintf(fp, "\"skipped\":%llu,\"grows\":%llu,\"mallocs\":%llu,\"malloc_bytes\":%llu,\"events\":{",
+            (unsigned long long) c->skipped, (unsigned long long) c->grows, (unsigned long long) c->mallocs,
+            (unsigned long long) c->malloc_bytes);
+    for (int k = 0; k < MIDI_STAT_KINDS; ++k)
+        fprintf(fp, "%s\"%s\":%llu", k ? "," : "", kind_names[k],
+                (unsigned long long) c->events[k]);
+    fprintf(fp, "},\"track_ns\":[");
+    for (uint16_t i = 0; i < st->ntracks; ++i)
+        fprintf(fp, "%s%llu", i ? "," : "", (unsigned long long) st->track_ns[i]);
+    fprintf(fp, "]}\n");
+}
+
+void MIDI_stats_print(const MIDI_stats *st, FILE *fp, int json)
+{
+    if (json)
+    {
+        print_json(st, fp);
+        return;
+    }
+    if (!MIDI_stats_enabled())
+    {
+        fprintf(fp, "Stats: not compiled in, rebuild with make STATS=1\n");
+        return;
+    }
+    print_text(st, fp);
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "midi_writer.h"
+
+// status, meta type and two VLQs, everything of an event but its payload
+#define EVENT_HEAD_MAX 10
+
+// minimal form, the highest group first, v is at most MIDI_VLQ_MAX
+static inline uint8_t *put_vlq(uint8_t *p, uint32_t v)
+{
+    if (v >= 1u << 21) *p++ = (uint8_t)(0x80 | (v >> 21));
+    if (v >= 1u << 14) *p++ = (uint8_t)(0x80 | ((v >> 14) & 0x7F));
+    if (v >= 1u << 7)  *p++ = (uint8_t)(0x80 | ((v >> 7) & 0x7F));
+    *p++ = (uint8_t)(v & 0x7F);
+    return p;
+}
+
+static inline void put_u32_be(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+// ---------------------------------------------------
+
+int write_MTrk_SMF(const MTrk *mtrk, Out_buffer *out)
+{
+    if (!mtrk || !out || out->fp) return 0;
+
+    // the size goes in once the events are down, so one pass is enough
+    size_t head = out->len;
+    uint8_t *p = (uint8_t*) out_reserve(out, 8 + mtrk->count * 4);
+    if (!p) return 0;
+    memcpy(p, "MTrk", 4);
+    p += 8;
+
+    // events are written through a local cursor, out only catches up
+    // when more room is needed
+    uint8_t *end = (uint8_t*) out->data + out->cap;
+    uint8_t running = 0;
+    for (size_t i = 0; i < mtrk->count; ++i)
+    {
+        const MTrk_event *ev = &mtrk->events[i];
+        if (ev->delta_time > MIDI_VLQ_MAX) return 0;
+
+        uint32_t    len  = 0;
+        const void *data = NULL;
+        if (ev->kind != CH)
+        {
+            len  = ev->kind == META ? ev->ev.meta_ev.len  : ev->ev.sysex_ev.len;
+            data = ev->kind == META ? ev->ev.meta_ev.data : ev->ev.sysex_ev.data;
+            if (len > MIDI_VLQ_MAX || (len && !data)) return 0;
+        }
+
+        if ((size_t)(end - p) < EVENT_HEAD_MAX + (size_t) len)
+        {
+            out->len = (size_t)(p - (uint8_t*) out->data);
+            p = (uint8_t*) out_reserve(out, EVENT_HEAD_MAX + (size_t) len);
+            if (!p) return 0;
+            end = (uint8_t*) out->data + out->cap;
+        }
+        p = put_vlq(p, ev->delta_time);
+
+        if (ev->kind == CH)
+        {
+            const Channel_event *ch = &ev->ev.channel_ev;
+            uint8_t status = (uint8_t)(ch->type << 4 | ch->channel);
+            uint8_t n = MIDI_channel_data_len[ch->type & 0x0F];
+            if (!n || ch->type > 0x0F || ch->channel > 0x0F) return 0;
+            if ((ch->param1 | ch->param2) > 0x7F) return 0;
+
+            if (status != running) *p++ = status;
+            running = status;
+
+            p[0] = ch->param1;
+            p[1] = ch->param2;
+            p += n;
+        }
+        else
+        {
+            if (ev->kind == META)
+            {
+                *p++ = 0xFF;
+                *p++ = ev->ev.meta_ev.type;
+            }
+            else
+            {
+                *p++ = ev->ev.sysex_ev.type == 0xF7 ? 0xF7 : 0xF0;
+            }
+            p = put_vlq(p, len);
+            if (len) memcpy(p, data, len);
+            p += len;
+            running = 0;
+        }
+    }
+    out->len = (size_t)(p - (uint8_t*) out->data);
+
+    size_t size = out->len - head - 8;
+    if (size > UINT32_MAX) return 0;
+    put_u32_be((uint8_t*) out->data + head + 4, (uint32_t) size);
+    return !out->error;
+}
+
+static void put_MThd(const MThd *mthd, uint8_t head[14])
+{
+    memcpy(head, "MThd", 4);
+    put_u32_be(head + 4, 6);
+    head[8]  = (uint8_t)(mthd->fmt >> 8);
+    head[9]  = (uint8_t) mthd->fmt;
+    head[10] = (uint8_t)(mthd->ntracks >> 8);
+    head[11] = (uint8_t) mthd->ntracks;
+    head[12] = (uint8_t)(mthd->division >> 8);
+    head[13] = (uint8_t) mthd->division;
+}
+
+int write_MIDI_to_SMF_buffer(const MIDI_file *midi, Out_buffer *out)
+{
+    if (!midi || !out) return 0;
+
+    uint8_t head[14];
+    put_MThd(&midi->mthd, head);
+    out_write(out, head, sizeof head);
+
+    for (uint16_t i = 0; i < midi->mthd.ntracks; ++i)
+        if (!write_MTrk_SMF(&midi->mtrk[i], out)) return 0;
+    return !out->error;
+}
+
+// every track is encoded into one reused buffer and goes out in one write
+int write_MIDI_file(const MIDI_file *midi, FILE *fp)
+{
+    if (!midi || !fp) return 0;
+
+    uint8_t head[14];
+    put_MThd(&midi->mthd, head);
+    if (fwrite(head, 1, sizeof head, fp) != sizeof head) return 0;
+
+    Out_buffer out;
+    if (!out_init_mem(&out, 0)) return 0;
+
+    int ok = 1;
+    for (uint16_t i = 0; i < midi->mthd.ntracks && ok; ++i)
+    {
+        out.len = 0;
+        ok = write_MTrk_SMF(&midi->mtrk[i], &out) &&
+             fwrite(out.data, 1, out.len, fp) == out.len;
+        MIDI_STAT_ADD(bytes_written, out.len);
+    }
+
+    out_free(&out);
+    return ok && fflush(fp) == 0;
+}
+
+int write_MIDI_file_path(const MIDI_file *midi, const char *filename)
+{
+    if (!midi || !filename) return 0;
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) return 0;
+
+    int result = write_MIDI_file(midi, fp);
+    if (fclose(fp) != 0) result = 0;
+
+    return result;
+}
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "midi_parser.h"
+
+static int soa_alloc(MTrk_soa *soa, size_t count, size_t npayloads)
+{
+    // one byte more so empty tracks still get valid pointers
+    soa->delta    = (uint32_t*) malloc(sizeof(uint32_t) * (count + 1));
+    soa->status   = (uint8_t*) malloc(count + 1);
+    soa->params   = (uint8_t(*)[2]) malloc(sizeof(*soa->params) * (count + 1));
+    soa->payloads = (MTrk_soa_payload*) malloc(sizeof(MTrk_soa_payload) * (npayloads + 1));
+
+    if (!soa->delta || !soa->status || !soa->params || !soa->payloads)
+    {
+        free_MTrk_soa(soa);
+        return 0;
+    }
+    return 1;
+}
+
+// stores one decoded event at position i, payloads are borrowed
+static void soa_put(MTrk_soa *soa, size_t i, const MTrk_event *ev)
+{
+    soa->delta[i] = ev->delta_time;
+
+    switch (ev->kind)
+    {
+    case CH:
+        soa->status[i]    = (uint8_t)(ev->ev.channel_ev.type << 4 | ev->ev.channel_ev.channel);
+        soa->params[i][0] = ev->ev.channel_ev.param1;
+        soa->params[i][1] = ev->ev.channel_ev.param2;
+        return;
+
+    case META:
+    {
+        MTrk_soa_payload *p = &soa->payloads[soa->npayloads++];
+        p->event  = (uint32_t)i;
+        p->type   = ev->ev.meta_ev.type;
+        p->len    = ev->ev.meta_ev.len;
+        p->data   = (const uint8_t*)ev->ev.meta_ev.data;
+        soa->status[i] = 0xFF;
+        break;
+    }
+
+    case SYS:
+    {
+        MTrk_soa_payload *p = &soa->payloads[soa->npayloads++];
+        p->event  = (uint32_t)i;
+        p->type   = 0;
+        p->len    = ev->ev.sysex_ev.len;
+        p->data   = (const uint8_t*)ev->ev.sysex_ev.data;
+        soa->status[i] = ev->ev.sysex_ev.type;
+        break;
+    }
+    }
+
+    soa->params[i][0] = 0;
+    soa->params[i][1] = 0;
+}
+
+int MTrk_to_soa(const MTrk *mtrk, MTrk_soa *soa)
+{
+    if (!mtrk || !soa) return 0;
+    memset(soa, 0, sizeof(MTrk_soa));
+    if (mtrk->count > UINT32_MAX) return 0;
+
+    size_t npayloads = 0;
+    for (size_t i = 0; i < mtrk->count; ++i)
+        if (mtrk->events[i].kind != CH) npayloads++;
+
+    if (!soa_alloc(soa, mtrk->count, npayloads)) return 0;
+
+    for (size_t i = 0; i < mtrk->count; ++i)
+        soa_put(soa, i, &mtrk->events[i]);
+
+    soa->size  = mtrk->size;
+    soa->count = mtrk->count;
+    return 1;
+}
+
+int parse_MTrk_soa(const uint8_t *buf, const MTrk_chunk *chunk, MTrk_soa *soa)
+{
+    if (!buf || !chunk || !soa) return 0;
+    memset(soa, 0, sizeof(MTrk_soa));
+
+    // size the arrays exactly with a counting pass first
+    MTrk_reader rd;
+    MTrk_event  ev;
+    size_t count = 0, npayloads = 0;
+    int code;
+
+    MTrk_reader_init(&rd, buf + chunk->offset, chunk->avail, chunk->size);
+    while ((code = MTrk_reader_next(&rd, &ev)) > 0)
+    {
+        count++;
+        if (ev.kind != CH) npayloads++;
+    }
+    if (code < 0 || count > UINT32_MAX) return 0;
+
+    if (!soa_alloc(soa, count, npayloads)) return 0;
+
+    size_t i = 0;
+    MTrk_reader_init(&rd, buf + chunk->offset, chunk->avail, chunk->size);
+    while (MTrk_reader_next(&rd, &ev) > 0)
+        soa_put(soa, i++, &ev);
+
+    soa->size  = chunk->size;
+    soa->count = count;
+    return 1;
+}
+
+void free_MTrk_soa(MTrk_soa *soa)
+{
+    if (!soa) return;
+
+    free(soa->delta);
+    free(soa->status);
+    free(soa->params);
+    free(soa->payloads);
+    memset(soa, 0, sizeof(MTrk_soa));
+}
+
+const MTrk_soa_payload *MTrk_soa_payload_at(const MTrk_soa *soa, size_t event)
+{
+    // payloads are stored in event order
+    size_t lo = 0, hi = soa->npayloads;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (soa->payloads[mid].event < event) lo = mid + 1;
+        else                                  hi = mid;
+    }
+
+    if (lo < soa->npayloads && soa->payloads[lo].event == event)
+        return &soa->payloads[lo];
+    return NULL;
+}
+
+size_t MTrk_soa_bytes(const MTrk_soa *soa)
+{
+    return soa->count * (sizeof(uint32_t) + 1 + sizeof(*soa->params)) +
+           soa->npayloads * sizeof(MTrk_soa_payload);
+}
+
+size_t MTrk_soa_count_notes(const MTrk_soa *soa)
+{
+    // only the status and velocity arrays are touched
+    size_t notes = 0;
+    for (size_t i = 0; i < soa->count; ++i)
+        notes += (soa->status[i] & 0xF0) == 0x90 && soa->params[i][1] > 0;
+    return notes;
+}
+
+void MTrk_soa_transpose(MTrk_soa *soa, int semitones)
+{
+    for (size_t i = 0; i < soa->count; ++i)
+    {
+        uint8_t hi = soa->status[i] & 0xF0;
+        if (hi != 0x80 && hi != 0x90 && hi != 0xA0) continue;
+
+        int note = soa->params[i][0] + semitones;
+        if (note < 0)   note = 0;
+        if (note > 127) note = 127;
+        soa->params[i][0] = (uint8_t)note;
+    }
+}
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include "notes.h"
+
+// ---------------------------------------------------
+
+static int push_note(MIDI_note_list *list, const MIDI_note_pairer *p, uint8_t channel,
+                     uint8_t key, const Open_note *on, uint64_t end, uint8_t off_velocity)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        MIDI_note *items = (MIDI_note*) realloc(list->items, sizeof(MIDI_note) * cap);
+        if (!items) return 0;
+        list->items = items;
+        list->cap   = cap;
+    }
+
+    MIDI_note *n = &list->items[list->count++];
+    n->start        = on->start;
+    n->duration     = end - on->start;
+    n->track        = p->track;
+    n->channel      = channel;
+    n->key          = key;
+    n->velocity     = on->velocity;
+    n->off_velocity = off_velocity;
+    return 1;
+}
+
+// ends the i-th open note of a key and closes the gap it leaves
+static int end_note(MIDI_note_pairer *p, uint8_t ch, uint8_t key, unsigned i,
+                    uint64_t tick, uint8_t off_velocity, MIDI_note_list *out)
+{
+    Open_note *open = p->open[ch][key];
+    if (!push_note(out, p, ch, key, &open[i], tick, off_velocity)) return 0;
+
+    unsigned n = --p->count[ch][key];
+    memmove(&open[i], &open[i + 1], sizeof(Open_note) * (n - i));
+    return 1;
+}
+
+// notes held by the pedal end with the velocity of their own release
+static int end_held(MIDI_note_pairer *p, uint8_t ch, uint8_t key, uint64_t tick,
+                    MIDI_note_list *out)
+{
+    Open_note *open = p->open[ch][key];
+    for (unsigned i = 0; i < p->count[ch][key]; )
+    {
+        if (!open[i].held) { ++i; continue; }
+        if (!end_note(p, ch, key, i, tick, open[i].off_velocity, out)) return 0;
+    }
+    return 1;
+}
+
+void MIDI_note_pairer_init(MIDI_note_pairer *p, uint16_t track, int sustain)
+{
+    memset(p->count, 0, sizeof(p->count));
+    memset(p->pedal, 0, sizeof(p->pedal));
+    p->track   = track;
+    p->sustain = sustain;
+}
+
+static int note_on(MIDI_note_pairer *p, uint8_t ch, uint8_t key, uint8_t velocity,
+                   uint64_t tick, MIDI_note_list *out)
+{
+    // striking a key again ends what the pedal was holding on it
+    if (p->sustain && !end_held(p, ch, key, tick, out)) return 0;
+    if (p->count[ch][key] == MIDI_NOTE_DEPTH && !end_note(p, ch, key, 0, tick, 0, out))
+        return 0;
+
+    Open_note *on = &p->open[ch][key][p->count[ch][key]++];
+    on->start        = tick;
+    on->velocity     = velocity;
+    on->off_velocity = 0;
+    on->held         = 0;
+    return 1;
+}
+
+static int note_off(MIDI_note_pairer *p, uint8_t ch, uint8_t key, uint8_t velocity,
+                    uint64_t tick, MIDI_note_list *out)
+{
+    Open_note *open = p->open[ch][key];
+    for (unsigned i = 0; i < p->count[ch][key]; ++i)
+    {
+        if (open[i].held) continue;
+
+        if (p->sustain && p->pedal[ch])
+        {
+            open[i].held = 1;
+            open[i].off_velocity = velocity;
+            return 1;
+        }
+        return end_note(p, ch, key, i, tick, velocity, out);
+    }
+
+    // a release with nothing to release is dropped
+    return 1;
+}
+
+int MIDI_note_pairer_feed(MIDI_note_pairer *p, uint64_t tick, const MTrk_event *ev,
+                          MIDI_note_list *out)
+{
+    if (ev->kind != CH) return 1;
+
+    const Channel_event *ch = &ev->ev.channel_ev;
+    uint8_t c = ch->channel & 0x0F, key = ch->param1 & 0x7F;
+
+    switch (ch->type)
+    {
+    case 0x9:
+        if (ch->param2 > 0) return note_on(p, c, key, ch->param2, tick, out);
+        return note_off(p, c, key, 0, tick, out);
+    case 0x8:
+        return note_off(p, c, key, ch->param2, tick, out);
+    case 0xB:
+        if (ch->param1 != 64 || !p->sustain) return 1;
+
+        int down = ch->param2 >= 64;
+        if (p->pedal[c] && !down)
+        {
+            for (unsigned k = 0; k < 128; ++k)
+            {
+                if (p->count[c][k] && !end_held(p, c, (uint8_t) k, tick, out))
+                    return 0;
+            }
+        }
+        p->pedal[c] = (uint8_t) down;
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+int MIDI_note_pairer_flush(MIDI_note_pairer *p, uint64_t tick, MIDI_note_list *out)
+{
+    for (unsigned c = 0; c < 16; ++c)
+    {
+        for (unsigned k = 0; k < 128; ++k)
+        {
+            while (p->count[c][k] > 0)
+            {
+                const Open_note *on = &p->open[c][k][0];
+                uint8_t off = on->held ? on->off_velocity : 0;
+                if (!end_note(p, (uint8_t) c, (uint8_t) k, 0, tick, off, out)) return 0;
+            }
+        }
+        p->pedal[c] = 0;
+    }
+    return 1;
+}
+
+// ---------------------------------------------------
+
+static int pair_track(MIDI_note_pairer *p, const MTrk *mtrk, uint16_t track,
+                      int sustain, MIDI_note_list *out)
+{
+    MIDI_note_pairer_init(p, track, sustain);
+
+    uint64_t tick = 0;
+    for (size_t i = 0; i < mtrk->count; ++i)
+    {
+        tick += mtrk->events[i].delta_time;
+        if (!MIDI_note_pairer_feed(p, tick, &mtrk->events[i], out)) return 0;
+    }
+    return MIDI_note_pairer_flush(p, tick, out);
+}
+
+static int compare_notes(const void *a, const void *b)
+{
+    const MIDI_note *x = (const MIDI_note*) a;
+    const MIDI_note *y = (const MIDI_note*) b;
+
+    if (x->start   != y->start)   return x->start   < y->start   ? -1 : 1;
+    if (x->track   != y->track)   return x->track   < y->track   ? -1 : 1;
+    if (x->channel != y->channel) return x->channel < y->channel ? -1 : 1;
+    if (x->key     != y->key)     return x->key     < y->key     ? -1 : 1;
+    return 0;
+}
+
+void MIDI_notes_sort(MIDI_note_list *list)
+{
+    if (list && list->count > 1)
+        qsort(list->items, list->count, sizeof(MIDI_note), compare_notes);
+}
+
+int MIDI_notes_from_MTrk(const MTrk *mtrk, uint16_t track, int sustain,
+                         MIDI_note_list *out)
+{
+    if (!mtrk || !out) return 0;
+
+    // the slots are too big for the stack
+    MIDI_note_pairer *p = (MIDI_note_pairer*) malloc(sizeof(MIDI_note_pairer));
+    if (!p) return 0;
+
+    size_t before = out->count;
+    int ok = pair_track(p, mtrk, track, sustain, out);
+    free(p);
+
+    if (ok && out->count - before > 1)
+        qsort(out->items + before, out->count - before, sizeof(MIDI_note), compare_notes);
+    return ok;
+}
+
+int MIDI_notes_from_file(const MIDI_file *midi, int sustain, MIDI_note_list *out)
+{
+    if (!midi || !out) return 0;
+
+    MIDI_note_pairer *p = (MIDI_note_pairer*) malloc(sizeof(MIDI_note_pairer));
+    if (!p) return 0;
+
+    int ok = 1;
+    for (uint16_t t = 0; ok && t < midi->mthd.ntracks; ++t)
+        ok = pair_track(p, &midi->mtrk[t], t, sustain, out);
+    free(p);
+
+    if (ok) MIDI_notes_sort(out);
+    return ok;
+}
+
+void free_MIDI_note_list(MIDI_note_list *list)
+{
+    if (!list) return;
+
+    free(list->items);
+    memset(list, 0, sizeof(MIDI_note_list));
+}
+
+// ---------------------------------------------------
+
+static void put_le(uint8_t *dst, uint64_t v, int n)
+{
+    for (int i = 0; i < n; ++i) dst[i] = (uint8_t)(v >> (8 * i));
+}
+
+int write_MIDI_notes_binary(const MIDI_note_list *list, FILE *fp)
+{
+    if (!list || !fp) return 0;
+
+    uint8_t head[16];
+    put_le(head, MIDI_NOTES_MAGIC, 4);
+    put_le(head + 4, MIDI_NOTES_VERSION, 4);
+    put_le(head + 8, list->count, 8);
+    if (fwrite(head, 1, sizeof(head), fp) != sizeof(head)) return 0;
+
+    // records are staged in blocks so fwrite isn't called per note
+    uint8_t block[24 * 1024];
+    size_t  used = 0;
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        const MIDI_note *n = &list->items[i];
+        uint8_t *r = block + used;
+        put_le(r, n->start, 8);
+        put_le(r + 8, n->duration, 8);
+        put_le(r + 16, n->track, 2);
+        r[18] = n->channel;
+        r[19] = n->key;
+        r[20] = n->velocity;
+        r[21] = n->off_velocity;
+        r[22] = 0;
+        r[23] = 0;
+
+        used += 24;
+        if (used == sizeof(block) || i + 1 == list->count)
+        {
+            if (fwrite(block, 1, used, fp) != used) return 0;
+            used = 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "out_buffer.h"
+#include "midi_stats.h"
+
+int out_init_file(Out_buffer *out, FILE *fp)
+{
+    memset(out, 0, sizeof(Out_buffer));
+    out->data = (char*) malloc(OUT_BUFFER_SIZE);
+    if (!out->data) return 0;
+    MIDI_STAT_ALLOC(OUT_BUFFER_SIZE);
+
+    out->cap = OUT_BUFFER_SIZE;
+    out->fp  = fp;
+    return 1;
+}
+
+int out_init_mem(Out_buffer *out, size_t initial)
+{
+    memset(out, 0, sizeof(Out_buffer));
+    if (initial == 0) initial = 4096;
+
+    out->data = (char*) malloc(initial);
+    if (!out->data) return 0;
+    MIDI_STAT_ALLOC(initial);
+
+    out->cap = initial;
+    return 1;
+}
+
+static int out_drain(Out_buffer *out)
+{
+    if (!out->fp || out->len == 0) return 1;
+
+    if (fwrite(out->data, 1, out->len, out->fp) != out->len)
+        out->error = 1;
+    MIDI_STAT_ADD(bytes_written, out->len);
+    out->len = 0;
+    return !out->error;
+}
+
+char *out_reserve_slow(Out_buffer *out, size_t n)
+{
+    if (out->error || !out->data) return NULL;
+
+    if (out->fp)
+    {
+        if (!out_drain(out)) return NULL;
+        if (out->cap >= n) return out->data;
+    }
+
+    size_t cap = out->cap;
+    while (cap - out->len < n)
+    {
+        if (cap > SIZE_MAX / 2) { out->error = 1; return NULL; }
+        cap *= 2;
+    }
+
+    char *data = (char*) realloc(out->data, cap);
+    if (!data) { out->error = 1; return NULL; }
+    MIDI_STAT_ALLOC(cap);
+
+    out->data = data;
+    out->cap  = cap;
+    return out->data + out->len;
+}
+
+int out_flush(Out_buffer *out)
+{
+    if (out->error) return 0;
+    if (!out_drain(out)) return 0;
+    if (out->fp && fflush(out->fp) != 0) out->error = 1;
+    return !out->error;
+}
+
+void out_free(Out_buffer *out)
+{
+    free(out->data);
+    memset(out, 0, sizeof(Out_buffer));
+}
@@ -0,0 +1,344 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "parse_cache.h"
+#include "snapshot.h"
+
+#define CACHE_EXT     ".snap"
+#define CACHE_TMP     "tmp."
+#define CACHE_LOCK    ".lock"
+#define CACHE_KEY_LEN 32
+
+// eviction goes a bit below the limit so it doesn't run on every store
+#define CACHE_LOW_WATER(max) ((max) / 10 * 9)
+
+// ---------------------------------------------------
+
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// two independent multiply-xorshift lanes over 8 byte words, one
+// multiply per word and lane
+void MIDI_cache_key(const uint8_t *buf, size_t len, uint64_t key[2])
+{
+    uint64_t a = 0x9E3779B97F4A7C15ull ^ len;
+    uint64_t b = 0xD6E8FEB86659FD93ull ^ (len << 1);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, buf + i, 8);
+        a = (a ^ w) * 0x87C37B91114253D5ull;
+        a ^= a >> 31;
+        b = (b ^ w) * 0x4CF5AD432745937Full;
+        b ^= b >> 29;
+    }
+
+    uint64_t tail = 0;
+    for (size_t j = 0; i + j < len; ++j)
+        tail |= (uint64_t) buf[i + j] << (8 * j);
+    a = (a ^ tail) * 0x87C37B91114253D5ull;
+    b = (b ^ tail) * 0x4CF5AD432745937Full;
+
+    key[0] = mix64(a ^ (b >> 17));
+    key[1] = mix64(b ^ (a << 13));
+}
+
+static char *entry_path(const MIDI_cache *cache, const char *name)
+{
+    size_t dlen = strlen(cache->dir), nlen = strlen(name);
+    char *path = (char*) malloc(dlen + nlen + 2);
+    if (!path) return NULL;
+
+    memcpy(path, cache->dir, dlen);
+    path[dlen] = '/';
+    memcpy(path + dlen + 1, name, nlen + 1);
+    return path;
+}
+
+static char *key_path(const MIDI_cache *cache, const uint64_t key[2])
+{
+    char name[CACHE_KEY_LEN + sizeof(CACHE_EXT)];
+    snprintf(name, sizeof(name), "%016llx%016llx" CACHE_EXT,
+             (unsigned long long) key[0], (unsigned long long) key[1]);
+    return entry_path(cache, name);
+}
+
+static int is_entry_name(const char *name)
+{
+    size_t n = strlen(name);
+    return n == CACHE_KEY_LEN + strlen(CACHE_EXT) &&
+           !strcmp(name + CACHE_KEY_LEN, CACHE_EXT);
+}
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    char    *path;
+    uint64_t size;
+    time_t   mtime;
+} Cache_entry;
+
+static int compare_entries(const void *a, const void *b)
+{
+    const Cache_entry *x = (const Cache_entry*) a;
+    const Cache_entry *y = (const Cache_entry*) b;
+    if (x->mtime != y->mtime) return x->mtime < y->mtime ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+// lists the entries, or only sizes them up when out is NULL, and drops
+// temp files nobody finished writing. returns the total size, or
+// UINT64_MAX when the directory can't be read
+static uint64_t scan_entries(const MIDI_cache *cache, Cache_entry **out, size_t *count)
+{
+    if (out)
+    {
+        *out   = NULL;
+        *count = 0;
+    }
+
+    DIR *d = opendir(cache->dir);
+    if (!d) return UINT64_MAX;
+
+    Cache_entry *items = NULL;
+    size_t n = 0, cap = 0;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        const char *name = ent->d_name;
+        int tmp = !strncmp(name, CACHE_TMP, strlen(CACHE_TMP));
+        if (!tmp && !is_entry_name(name)) continue;
+
+        char *path = entry_path(cache, name);
+        struct stat st;
+        if (!path || stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            free(path);
+            continue;
+        }
+
+        if (tmp)
+        {
+            if (now - st.st_mtime > MIDI_CACHE_STALE_TMP) unlink(path);
+            free(path);
+            continue;
+        }
+
+        if (out && n == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            Cache_entry *grown = (Cache_entry*) realloc(items, sizeof(Cache_entry) * cap);
+            if (!grown)
+            {
+                free(path);
+                break;
+            }
+            items = grown;
+        }
+
+        total += (uint64_t) st.st_size;
+        if (out)
+        {
+            items[n].path  = path;
+            items[n].size  = (uint64_t) st.st_size;
+            items[n].mtime = st.st_mtime;
+            n++;
+        }
+        else free(path);
+    }
+    closedir(d);
+
+    if (out)
+    {
+        *out   = items;
+        *count = n;
+    }
+    return total;
+}
+
+// the lock file keeps two processes from evicting at once, a process
+// that finds it taken leaves eviction to the other one
+static int lock_dir(const MIDI_cache *cache)
+{
+    char *path = entry_path(cache, CACHE_LOCK);
+    if (!path) return -1;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd < 0) return -1;
+
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    if (fcntl(fd, F_SETLK, &fl) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// called with cache->lock held
+static void evict(MIDI_cache *cache)
+{
+    int fd = lock_dir(cache);
+    if (fd < 0) return;
+
+    Cache_entry *items;
+    size_t count;
+    uint64_t total = scan_entries(cache, &items, &count);
+    if (total != UINT64_MAX)
+    {
+        qsort(items, count, sizeof(Cache_entry), compare_entries);
+
+        // oldest first, an entry someone else removed already is fine
+        uint64_t target = CACHE_LOW_WATER(cache->max_bytes);
+        for (size_t i = 0; i < count && total > target; ++i)
+        {
+            if (unlink(items[i].path) == 0 || errno == ENOENT)
+            {
+                total -= items[i].size;
+                cache->stats.evictions++;
+            }
+        }
+        cache->bytes = total;
+    }
+
+    for (size_t i = 0; i < count; ++i) free(items[i].path);
+    free(items);
+    close(fd);
+}
+
+// ---------------------------------------------------
+
+int MIDI_cache_open(MIDI_cache *cache, const char *dir, uint64_t max_bytes)
+{
+    if (!cache || !dir) return 0;
+    memset(cache, 0, sizeof(MIDI_cache));
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return 0;
+
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return 0;
+
+    size_t n = strlen(dir);
+    cache->dir = (char*) malloc(n + 1);
+    if (!cache->dir) return 0;
+    memcpy(cache->dir, dir, n + 1);
+
+    cache->max_bytes = max_bytes ? max_bytes : MIDI_CACHE_DEFAULT_SIZE;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    uint64_t total = scan_entries(cache, NULL, NULL);
+    cache->bytes = total == UINT64_MAX ? 0 : total;
+    if (cache->bytes > cache->max_bytes) evict(cache);
+    return 1;
+}
+
+void MIDI_cache_close(MIDI_cache *cache)
+{
+    if (!cache || !cache->dir) return;
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->dir);
+    memset(cache, 0, sizeof(MIDI_cache));
+}
+
+void MIDI_cache_get_stats(MIDI_cache *cache, MIDI_cache_stats *stats)
+{
+    if (!cache || !stats) return;
+
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+int MIDI_cache_lookup(MIDI_cache *cache, const uint64_t key[2],
+                      MIDI_file *midi, MIDI_arena *arena)
+{
+    if (!cache || !cache->dir || !key || !midi) return 0;
+
+    char *path = key_path(cache, key);
+    MIDI_snapshot snap;
+    int hit = path && open_MIDI_snapshot(path, &snap);
+
+    int corrupt = 0;
+    if (hit)
+    {
+        hit = MIDI_snapshot_to_file(&snap, midi, arena);
+        close_MIDI_snapshot(&snap);
+        if (hit) utimensat(AT_FDCWD, path, NULL, 0);
+    }
+    else if (path && access(path, F_OK) == 0)
+    {
+        // there but unreadable, the store after the miss replaces it
+        corrupt = 1;
+    }
+    free(path);
+
+    pthread_mutex_lock(&cache->lock);
+    if (hit) cache->stats.hits++;
+    else     cache->stats.misses++;
+    if (corrupt) cache->stats.errors++;
+    pthread_mutex_unlock(&cache->lock);
+
+    return hit;
+}
+
+int MIDI_cache_store(MIDI_cache *cache, const uint64_t key[2], const MIDI_file *midi)
+{
+    if (!cache || !cache->dir || !key || !midi) return 0;
+
+    pthread_mutex_lock(&cache->lock);
+    uint64_t seq = cache->tmp_seq++;
+    pthread_mutex_unlock(&cache->lock);
+
+    char name[64];
+    snprintf(name, sizeof(name), CACHE_TMP "%ld.%llu",
+             (long) getpid(), (unsigned long long) seq);
+    char *tmp   = entry_path(cache, name);
+    char *final = key_path(cache, key);
+
+    int ok = tmp && final && write_MIDI_snapshot_file(midi, tmp);
+    struct stat st;
+    ok = ok && stat(tmp, &st) == 0;
+    // rename is atomic, readers see the old entry or the new one
+    ok = ok && rename(tmp, final) == 0;
+    if (!ok && tmp) unlink(tmp);
+    free(tmp);
+    free(final);
+
+    pthread_mutex_lock(&cache->lock);
+    if (ok)
+    {
+        cache->stats.stores++;
+        cache->bytes += (uint64_t) st.st_size;
+        if (cache->bytes > cache->max_bytes) evict(cache);
+    }
+    else cache->stats.errors++;
+    pthread_mutex_unlock(&cache->lock);
+
+    return ok;
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "seek_index.h"
+#include "parse_cache.h"
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    MIDI_seek_point *items;
+    size_t           count;
+    size_t           cap;
+} Point_list;
+
+static int push_point(Point_list *list, const MTrk_reader *rd, uint32_t index)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        MIDI_seek_point *items = (MIDI_seek_point*) realloc(list->items, sizeof(MIDI_seek_point) * cap);
+        if (!items) return 0;
+        list->items = items;
+        list->cap   = cap;
+    }
+
+    MIDI_seek_point *p = &list->items[list->count++];
+    p->offset = (uint32_t) rd->cur.pos;
+    p->index  = index;
+    p->tick   = rd->tick;
+    p->running_status = rd->running_status;
+    return 1;
+}
+
+static int alloc_tables(MIDI_seek_index *idx, uint16_t ntracks)
+{
+    idx->chunks = (MTrk_chunk*) calloc(ntracks, sizeof(MTrk_chunk));
+    idx->first  = (size_t*) calloc((size_t) ntracks + 1, sizeof(size_t));
+    return idx->chunks && idx->first;
+}
+
+int MIDI_seek_index_build(MIDI_seek_index *idx, const uint8_t *buf, size_t len,
+                          uint32_t interval)
+{
+    if (!idx || !buf) return 0;
+    memset(idx, 0, sizeof(MIDI_seek_index));
+
+    MIDI_cursor cur = { buf, len, 0 };
+    if (!check_for_MThd(&idx->mthd, &cur)) return 0;
+
+    uint16_t ntracks = idx->mthd.ntracks;
+    idx->len      = len;
+    idx->interval = interval ? interval : MIDI_SEEK_DEFAULT_INTERVAL;
+    MIDI_cache_key(buf, len, idx->key);
+    if (!alloc_tables(idx, ntracks) ||
+        !scan_MTrk_chunks(&cur, ntracks, idx->chunks))
+    {
+        MIDI_seek_index_free(idx);
+        return 0;
+    }
+
+    Point_list list = { NULL, 0, 0 };
+    for (uint16_t t = 0; t < ntracks; ++t)
+    {
+        const MTrk_chunk *chunk = &idx->chunks[t];
+        MTrk_reader rd;
+        MTrk_reader_init(&rd, buf + chunk->offset, chunk->avail, chunk->size);
+
+        idx->first[t] = list.count;
+
+        MTrk_event ev;
+        uint32_t index = 0;
+        int code = 1;
+        while (code > 0)
+        {
+            if (index % idx->interval == 0 && !rd.done &&
+                !push_point(&list, &rd, index))
+                code = -1;
+            else if ((code = MTrk_reader_next(&rd, &ev)) > 0)
+                ++index;
+        }
+
+        if (code < 0)
+        {
+            free(list.items);
+            MIDI_seek_index_free(idx);
+            return 0;
+        }
+    }
+    idx->first[ntracks] = list.count;
+    idx->points = list.items;
+
+    return 1;
+}
+
+void MIDI_seek_index_free(MIDI_seek_index *idx)
+{
+    if (!idx) return;
+
+    free(idx->chunks);
+    free(idx->first);
+    free(idx->points);
+    memset(idx, 0, sizeof(MIDI_seek_index));
+}
+
+// ---------------------------------------------------
+
+static int put_le(FILE *fp, uint64_t v, int n)
+{
+    uint8_t b[8];
+    for (int i = 0; i < n; ++i) b[i] = (uint8_t)(v >> (8 * i));
+    return fwrite(b, 1, (size_t) n, fp) == (size_t) n;
+}
+
+static int get_le(FILE *fp, uint64_t *v, int n)
+{
+    uint8_t b[8];
+    if (fread(b, 1, (size_t) n, fp) != (size_t) n) return 0;
+
+    *v = 0;
+    for (int i = 0; i < n; ++i) *v |= (uint64_t) b[i] << (8 * i);
+    return 1;
+}
+
+int MIDI_seek_index_save(const MIDI_seek_index *idx, const char *path)
+{
+    if (!idx || !idx->first || !path) return 0;
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return 0;
+
+    uint16_t ntracks = idx->mthd.ntracks;
+    int ok = put_le(fp, MIDI_SEEK_MAGIC, 4)   &&
+             put_le(fp, MIDI_SEEK_VERSION, 4) &&
+             put_le(fp, idx->len, 8)           &&
+             put_le(fp, idx->key[0], 8)        &&
+             put_le(fp, idx->key[1], 8)        &&
+             put_le(fp, idx->mthd.fmt, 2)      &&
+             put_le(fp, ntracks, 2)            &&
+             put_le(fp, idx->mthd.division, 2) &&
+             put_le(fp, idx->interval, 4);
+
+    for (uint16_t t = 0; ok && t < ntracks; ++t)
+    {
+        ok = put_le(fp, idx->chunks[t].offset, 8) &&
+             put_le(fp, idx->chunks[t].avail, 8)  &&
+             put_le(fp, idx->chunks[t].size, 4)   &&
+             put_le(fp, idx->first[t + 1] - idx->first[t], 8);
+    }
+
+    for (size_t i = 0; ok && i < idx->first[ntracks]; ++i)
+    {
+        const MIDI_seek_point *p = &idx->points[i];
+        ok = put_le(fp, p->offset, 4) &&
+             put_le(fp, p->index, 4)  &&
+             put_le(fp, p->tick, 8)   &&
+             put_le(fp, p->running_status, 1);
+    }
+
+    if (fclose(fp) != 0) ok = 0;
+    return ok;
+}
+
+int MIDI_seek_index_load(MIDI_seek_index *idx, const char *path,
+                         const uint8_t *buf, size_t len)
+{
+    if (!idx || !path || !buf) return 0;
+    memset(idx, 0, sizeof(MIDI_seek_index));
+
+    MIDI_cursor cur = { buf, len, 0 };
+    if (!check_for_MThd(&idx->mthd, &cur)) return 0;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    uint16_t ntracks = idx->mthd.ntracks;
+    uint64_t magic = 0, version = 0, size = 0, fmt = 0, n = 0, division = 0, interval = 0;
+    uint64_t key[2] = { 0, 0 };
+    int ok = get_le(fp, &magic, 4) && get_le(fp, &version, 4) &&
+             get_le(fp, &size, 8)  && get_le(fp, &key[0], 8)  &&
+             get_le(fp, &key[1], 8) && get_le(fp, &fmt, 2)    &&
+             get_le(fp, &n, 2)     && get_le(fp, &division, 2) &&
+             get_le(fp, &interval, 4);
+
+    ok = ok && magic == MIDI_SEEK_MAGIC && version == MIDI_SEEK_VERSION &&
+         size == len && fmt == idx->mthd.fmt && n == ntracks &&
+         division == idx->mthd.division && interval > 0;
+
+    // same size and header isn't enough, a changed velocity or tempo
+    // keeps both. hashing is only paid once the cheap checks pass
+    if (ok) MIDI_cache_key(buf, len, idx->key);
+    ok = ok && key[0] == idx->key[0] && key[1] == idx->key[1];
+    ok = ok && alloc_tables(idx, ntracks);
+
+    idx->len      = len;
+    idx->interval = (uint32_t) interval;
+
+    for (uint16_t t = 0; ok && t < ntracks; ++t)
+    {
+        uint64_t offset = 0, avail = 0, chunk_size = 0, npoints = 0;
+        ok = get_le(fp, &offset, 8) && get_le(fp, &avail, 8) &&
+             get_le(fp, &chunk_size, 4) && get_le(fp, &npoints, 8);
+
+        // the chunk has to lie inside buf, every point takes at least a byte
+        ok = ok && offset <= len && avail <= len - offset &&
+             npoints > 0 && npoints <= avail + 1;
+        if (!ok) break;
+
+        idx->chunks[t].offset = (size_t) offset;
+        idx->chunks[t].avail  = (size_t) avail;
+        idx->chunks[t].size   = (uint32_t) chunk_size;
+        idx->first[t + 1]     = idx->first[t] + (size_t) npoints;
+    }
+
+    size_t total = ok ? idx->first[ntracks] : 0;
+    if (ok)
+    {
+        idx->points = (MIDI_seek_point*) malloc(sizeof(MIDI_seek_point) * total);
+        ok = idx->points != NULL;
+    }
+
+    for (uint16_t t = 0; ok && t < ntracks; ++t)
+    {
+        for (size_t i = idx->first[t]; ok && i < idx->first[t + 1]; ++i)
+        {
+            uint64_t offset = 0, index = 0, tick = 0, rs = 0;
+            ok = get_le(fp, &offset, 4) && get_le(fp, &index, 4) &&
+                 get_le(fp, &tick, 8)   && get_le(fp, &rs, 1)    &&
+                 offset <= idx->chunks[t].avail;
+
+            idx->points[i].offset = (uint32_t) offset;
+            idx->points[i].index  = (uint32_t) index;
+            idx->points[i].tick   = tick;
+            idx->points[i].running_status = (uint8_t) rs;
+        }
+    }
+
+    fclose(fp);
+    if (!ok) MIDI_seek_index_free(idx);
+    return ok;
+}
+
+// ---------------------------------------------------
+
+int MIDI_seek_reader(const MIDI_seek_index *idx, const uint8_t *buf, uint16_t track,
+                     const MIDI_seek_point *p, MTrk_reader *rd)
+{
+    if (!idx || !buf || !p || !rd || track >= idx->mthd.ntracks) return 0;
+
+    const MTrk_chunk *chunk = &idx->chunks[track];
+    if (p->offset > chunk->avail) return 0;
+
+    MTrk_reader_init(rd, buf + chunk->offset, chunk->avail, chunk->size);
+    rd->cur.pos        = p->offset;
+    rd->tick           = p->tick;
+    rd->running_status = p->running_status;
+    return 1;
+}
+
+// the last point of the track whose event can't be at or after tick,
+// the first point when every one of them can
+static const MIDI_seek_point *find_point(const MIDI_seek_index *idx, uint16_t track,
+                                         uint64_t tick)
+{
+    size_t lo = idx->first[track], hi = idx->first[track + 1];
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->points[mid].tick < tick) lo = mid;
+        else                              hi = mid;
+    }
+    return &idx->points[lo];
+}
+
+int MIDI_seek_range(const MIDI_seek_index *idx, const uint8_t *buf,
+                    uint64_t from, uint64_t to, MIDI_event_cb cb, void *user)
+{
+    if (!idx || !buf || !cb) return 0;
+
+    for (uint16_t t = 0; t < idx->mthd.ntracks; ++t)
+    {
+        const MIDI_seek_point *p = find_point(idx, t, from);
+
+        MTrk_reader rd;
+        if (!MIDI_seek_reader(idx, buf, t, p, &rd)) return 0;
+
+        MIDI_stream_event sev;
+        sev.track = t;
+        sev.index = p->index;
+
+        int code;
+        while ((code = MTrk_reader_next(&rd, &sev.event)) > 0)
+        {
+            if (rd.tick >= to) break;
+
+            sev.tick = rd.tick;
+            if (rd.tick >= from && !cb(&sev, user)) return 0;
+            sev.index++;
+        }
+        if (code < 0) return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+#define SNAP_BLOCK_EVENTS 1024
+
+// ---------------------------------------------------
+
+static void put_le(uint8_t *dst, uint64_t v, int n)
+{
+    for (int i = 0; i < n; ++i) dst[i] = (uint8_t)(v >> (8 * i));
+}
+
+static int host_is_little_endian(void)
+{
+    const uint16_t one = 1;
+    return *(const uint8_t*) &one == 1;
+}
+
+static int event_payload(const MTrk_event *ev, const uint8_t **data, uint32_t *len)
+{
+    if (ev->kind == META)
+    {
+        *data = (const uint8_t*) ev->ev.meta_ev.data;
+        *len  = ev->ev.meta_ev.len;
+        return 1;
+    }
+    if (ev->kind == SYS)
+    {
+        *data = (const uint8_t*) ev->ev.sysex_ev.data;
+        *len  = ev->ev.sysex_ev.len;
+        return 1;
+    }
+    return 0;
+}
+
+static void pack_event(uint8_t *r, const MTrk_event *ev, uint64_t *blob)
+{
+    memset(r, 0, sizeof(MIDI_snap_event));
+    put_le(r, ev->delta_time, 4);
+    r[4] = (uint8_t) ev->kind;
+
+    const uint8_t *data;
+    uint32_t       len;
+    if (!event_payload(ev, &data, &len))
+    {
+        const Channel_event *ch = &ev->ev.channel_ev;
+        r[5] = ch->type;
+        r[6] = ch->channel;
+        r[7] = ch->param1;
+        put_le(r + 8, ch->param2, 4);
+        return;
+    }
+
+    r[5] = ev->kind == META ? ev->ev.meta_ev.type : ev->ev.sysex_ev.type;
+    put_le(r + 8, len, 4);
+    put_le(r + 12, data ? *blob : MIDI_SNAP_NO_DATA, 4);
+    if (data) *blob += len;
+}
+
+int write_MIDI_snapshot(const MIDI_file *midi, FILE *fp)
+{
+    if (!midi || !midi->mtrk || !fp) return 0;
+
+    uint16_t ntracks = midi->mthd.ntracks;
+    uint64_t nevents = 0, blob_size = 0;
+    for (uint16_t t = 0; t < ntracks; ++t)
+    {
+        const MTrk *mtrk = &midi->mtrk[t];
+        nevents += mtrk->count;
+        for (size_t i = 0; i < mtrk->count; ++i)
+        {
+            const uint8_t *data;
+            uint32_t       len;
+            if (event_payload(&mtrk->events[i], &data, &len) && data) blob_size += len;
+        }
+    }
+    // offsets are 32 bit, NO_DATA included
+    if (blob_size >= MIDI_SNAP_NO_DATA) return 0;
+
+    uint64_t tracks_offset = sizeof(MIDI_snap_header);
+    uint64_t events_offset = tracks_offset + (uint64_t) ntracks * sizeof(MIDI_snap_track);
+    events_offset = (events_offset + 7) & ~(uint64_t) 7;
+    uint64_t blob_offset = events_offset + nevents * sizeof(MIDI_snap_event);
+
+    uint8_t head[sizeof(MIDI_snap_header)];
+    memset(head, 0, sizeof(head));
+    put_le(head +  0, MIDI_SNAP_MAGIC, 4);
+    put_le(head +  4, MIDI_SNAP_VERSION, 4);
+    put_le(head +  8, midi->mthd.fmt, 2);
+    put_le(head + 10, ntracks, 2);
+    put_le(head + 12, midi->mthd.division, 2);
+    put_le(head + 16, nevents, 8);
+    put_le(head + 24, tracks_offset, 8);
+    put_le(head + 32, events_offset, 8);
+    put_le(head + 40, blob_offset, 8);
+    put_le(head + 48, blob_size, 8);
+    put_le(head + 56, blob_offset + blob_size, 8);
+    if (fwrite(head, 1, sizeof(head), fp) != sizeof(head)) return 0;
+
+    uint64_t first = 0;
+    for (uint16_t t = 0; t < ntracks; ++t)
+    {
+        uint8_t r[sizeof(MIDI_snap_track)];
+        memset(r, 0, sizeof(r));
+        put_le(r, midi->mtrk[t].size, 4);
+        put_le(r + 8, first, 8);
+        put_le(r + 16, midi->mtrk[t].count, 8);
+        if (fwrite(r, 1, sizeof(r), fp) != sizeof(r)) return 0;
+        first += midi->mtrk[t].count;
+    }
+
+    static const uint8_t pad[8] = { 0 };
+    size_t npad = (size_t)(events_offset - tracks_offset - (uint64_t) ntracks * sizeof(MIDI_snap_track));
+    if (npad && fwrite(pad, 1, npad, fp) != npad) return 0;
+
+    // events are packed in blocks, payload offsets count up in the same
+    // order the blob is written below
+    uint8_t  block[SNAP_BLOCK_EVENTS * sizeof(MIDI_snap_event)];
+    size_t   used = 0;
+    uint64_t blob = 0;
+    for (uint16_t t = 0; t < ntracks; ++t)
+    {
+        const MTrk *mtrk = &midi->mtrk[t];
+        for (size_t i = 0; i < mtrk->count; ++i)
+        {
+            pack_event(block + used, &mtrk->events[i], &blob);
+            used += sizeof(MIDI_snap_event);
+            if (used == sizeof(block))
+            {
+                if (fwrite(block, 1, used, fp) != used) return 0;
+                used = 0;
+            }
+        }
+    }
+    if (used && fwrite(block, 1, used, fp) != used) return 0;
+
+    for (uint16_t t = 0; t < ntracks; ++t)
+    {
+        const MTrk *mtrk = &midi->mtrk[t];
+        for (size_t i = 0; i < mtrk->count; ++i)
+        {
+            const uint8_t *data;
+            uint32_t       len;
+            if (!event_payload(&mtrk->events[i], &data, &len) || !data || !len) continue;
+            if (fwrite(data, 1, len, fp) != len) return 0;
+        }
+    }
+
+    return 1;
+}
+
+int write_MIDI_snapshot_file(const MIDI_file *midi, const char *filename)
+{
+    if (!midi || !filename) return 0;
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) return 0;
+
+    int result = write_MIDI_snapshot(midi, fp);
+    if (fclose(fp) != 0) result = 0;
+
+    return result;
+}
+
+// ---------------------------------------------------
+
+// the same checks the parser makes, so a snapshot can't hand the JSON
+// writer anything a parsed file couldn't
+static int check_event(const MIDI_snap_event *ev, uint64_t blob_size)
+{
+    switch (ev->kind)
+    {
+    case CH:
+        return ev->type >= 0x8 && ev->type <= 0xE && ev->channel < 16 &&
+               ev->param1 < 0x80 && ev->arg < 0x80;
+
+    case META:
+    case SYS:
+        if (ev->offset == MIDI_SNAP_NO_DATA)
+            return ev->kind == META && ev->type == 0x2F && ev->arg == 0;
+        if (ev->offset > blob_size || ev->arg > blob_size - ev->offset) return 0;
+        if (ev->kind == SYS) return ev->type == 0xF0 || ev->type == 0xF7;
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+static int check_snapshot(const MIDI_snapshot *snap)
+{
+    const MIDI_snap_header *h = snap->header;
+    uint64_t len = snap->map.len;
+
+    if (h->magic != MIDI_SNAP_MAGIC || h->version != MIDI_SNAP_VERSION) return 0;
+    if (h->file_size != len || h->fmt > 2 || h->ntracks == 0) return 0;
+    if (h->fmt == 0 && h->ntracks != 1) return 0;
+
+    if (h->tracks_offset % 8 || h->events_offset % 8) return 0;
+    if (h->tracks_offset < sizeof(MIDI_snap_header) || h->tracks_offset > len) return 0;
+    if ((len - h->tracks_offset) / sizeof(MIDI_snap_track) < h->ntracks) return 0;
+    if (h->events_offset < h->tracks_offset + (uint64_t) h->ntracks * sizeof(MIDI_snap_track)) return 0;
+    if (h->events_offset > len) return 0;
+    if ((len - h->events_offset) / sizeof(MIDI_snap_event) < h->nevents) return 0;
+    if (h->blob_offset < h->events_offset + h->nevents * sizeof(MIDI_snap_event)) return 0;
+    if (h->blob_offset > len || h->blob_size > len - h->blob_offset) return 0;
+
+    const MIDI_snap_track *tracks = snap->tracks;
+    for (uint16_t t = 0; t < h->ntracks; ++t)
+    {
+        if (tracks[t].first > h->nevents || tracks[t].count > h->nevents - tracks[t].first)
+            return 0;
+    }
+
+    for (uint64_t i = 0; i < h->nevents; ++i)
+    {
+        const MIDI_snap_event *ev = &snap->events[i];
+        if (!check_event(ev, h->blob_size)) return 0;
+        if (ev->kind == META && ev->offset != MIDI_SNAP_NO_DATA &&
+            !check_MTrk_meta_payload(ev->type, ev->arg, snap->blob + ev->offset))
+            return 0;
+    }
+    return 1;
+}
+
+int open_MIDI_snapshot(const char *path, MIDI_snapshot *snap)
+{
+    if (!path || !snap) return 0;
+    memset(snap, 0, sizeof(MIDI_snapshot));
+    if (!host_is_little_endian()) return 0;
+
+    if (!open_MIDI_map(path, &snap->map)) return 0;
+    if (snap->map.len < sizeof(MIDI_snap_header))
+    {
+        close_MIDI_snapshot(snap);
+        return 0;
+    }
+
+    const uint8_t *base = snap->map.buf;
+    snap->header = (const MIDI_snap_header*) base;
+    if (snap->header->magic != MIDI_SNAP_MAGIC)
+    {
+        close_MIDI_snapshot(snap);
+        return 0;
+    }
+
+    snap->tracks = (const MIDI_snap_track*) (base + snap->header->tracks_offset);
+    snap->events = (const MIDI_snap_event*) (base + snap->header->events_offset);
+    snap->blob   = base + snap->header->blob_offset;
+    if (!check_snapshot(snap))
+    {
+        close_MIDI_snapshot(snap);
+        return 0;
+    }
+    return 1;
+}
+
+void close_MIDI_snapshot(MIDI_snapshot *snap)
+{
+    if (!snap) return;
+
+    close_MIDI_map(&snap->map);
+    memset(snap, 0, sizeof(MIDI_snapshot));
+}
+
+// ---------------------------------------------------
+
+static void unpack_event(const uint8_t *blob, const MIDI_snap_event *r, MTrk_event *ev)
+{
+    memset(ev, 0, sizeof(MTrk_event));
+    ev->delta_time = r->delta_time;
+    ev->kind       = (Event_kind) r->kind;
+
+    void *data = r->offset == MIDI_SNAP_NO_DATA ? NULL : (void*)(blob + r->offset);
+    switch (ev->kind)
+    {
+    case CH:
+        ev->ev.channel_ev.type    = r->type;
+        ev->ev.channel_ev.channel = r->channel;
+        ev->ev.channel_ev.param1  = r->param1;
+        ev->ev.channel_ev.param2  = (uint8_t) r->arg;
+        break;
+    case META:
+        ev->ev.meta_ev.type = r->type;
+        ev->ev.meta_ev.len  = r->arg;
+        ev->ev.meta_ev.data = data;
+        break;
+    case SYS:
+        ev->ev.sysex_ev.type = r->type;
+        ev->ev.sysex_ev.len  = r->arg;
+        ev->ev.sysex_ev.data = data;
+        break;
+    }
+}
+
+int MIDI_snapshot_to_file(const MIDI_snapshot *snap, MIDI_file *midi, MIDI_arena *arena)
+{
+    if (!snap || !snap->header || !midi) return 0;
+    memset(midi, 0, sizeof(MIDI_file));
+
+    // the header is rebuilt the way the parser reads it
+    const MIDI_snap_header *h = snap->header;
+    uint8_t mthd[14] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6 };
+    mthd[8]  = (uint8_t)(h->fmt >> 8);
+    mthd[9]  = (uint8_t) h->fmt;
+    mthd[10] = (uint8_t)(h->ntracks >> 8);
+    mthd[11] = (uint8_t) h->ntracks;
+    mthd[12] = (uint8_t)(h->division >> 8);
+    mthd[13] = (uint8_t) h->division;
+    MIDI_cursor cur = { mthd, sizeof(mthd), 0 };
+    if (!check_for_MThd(&midi->mthd, &cur)) return 0;
+
+    const uint8_t *blob = snap->blob;
+    if (arena && h->blob_size > 0)
+    {
+        uint8_t *copy = (uint8_t*) arena_alloc(arena, (size_t) h->blob_size);
+        if (!copy) return 0;
+        memcpy(copy, snap->blob, (size_t) h->blob_size);
+        blob = copy;
+    }
+
+    midi->mtrk = (MTrk*) calloc(h->ntracks, sizeof(MTrk));
+    if (!midi->mtrk)
+    {
+        free_MIDI_file(midi);
+        return 0;
+    }
+
+    for (uint16_t t = 0; t < h->ntracks; ++t)
+    {
+        const MIDI_snap_track *st = &snap->tracks[t];
+        MTrk *mtrk = &midi->mtrk[t];
+        mtrk->size = st->size;
+        if (st->count == 0) continue;
+
+        mtrk->events = (MTrk_event*) malloc(sizeof(MTrk_event) * st->count);
+        if (!mtrk->events)
+        {
+            free_MIDI_file(midi);
+            return 0;
+        }
+        mtrk->count = mtrk->cap = st->count;
+
+        for (uint64_t i = 0; i < st->count; ++i)
+            unpack_event(blob, &snap->events[st->first + i], &mtrk->events[i]);
+    }
+    return 1;
+}
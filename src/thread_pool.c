@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+// every worker owns a contiguous range of task indices, takes from its
+// front and, once empty, steals the back half of the fullest range
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t          lo;
+    size_t          hi;
+} Task_range;
+
+typedef struct
+{
+    Task_range  *ranges;
+    unsigned     nworkers;
+    pool_task_fn fn;
+    void        *ctx;
+} Pool;
+
+typedef struct
+{
+    Pool    *pool;
+    unsigned id;
+} Pool_worker;
+
+static int pop_own(Task_range *r, size_t *task)
+{
+    int found = 0;
+    pthread_mutex_lock(&r->lock);
+    if (r->lo < r->hi)
+    {
+        *task = r->lo++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return found;
+}
+
+static int steal(Pool *pool, unsigned self)
+{
+    // pick the victim with the most work left, sizes are only a hint
+    unsigned victim = self;
+    size_t   best   = 0;
+    for (unsigned i = 0; i < pool->nworkers; ++i)
+    {
+        if (i == self) continue;
+        Task_range *r = &pool->ranges[i];
+        pthread_mutex_lock(&r->lock);
+        size_t left = r->hi - r->lo;
+        pthread_mutex_unlock(&r->lock);
+        if (left > best) { best = left; victim = i; }
+    }
+    if (victim == self) return 0;
+
+    Task_range *v = &pool->ranges[victim];
+    size_t lo = 0, hi = 0;
+    pthread_mutex_lock(&v->lock);
+    size_t left = v->hi - v->lo;
+    if (left > 0)
+    {
+        size_t take = (left + 1) / 2;
+        hi = v->hi;
+        lo = hi - take;
+        v->hi = lo;
+    }
+    pthread_mutex_unlock(&v->lock);
+    if (lo == hi) return 1;   // lost the race, look again
+
+    Task_range *own = &pool->ranges[self];
+    pthread_mutex_lock(&own->lock);
+    own->lo = lo;
+    own->hi = hi;
+    pthread_mutex_unlock(&own->lock);
+    return 1;
+}
+
+static void *pool_worker(void *arg)
+{
+    Pool_worker *w = (Pool_worker*) arg;
+    Pool *pool = w->pool;
+
+    for (;;)
+    {
+        size_t task;
+        if (pop_own(&pool->ranges[w->id], &task))
+        {
+            pool->fn(task, w->id, pool->ctx);
+            continue;
+        }
+        if (!steal(pool, w->id)) break;
+    }
+
+    return NULL;
+}
+
+void parallel_for(size_t ntasks, unsigned nthreads, pool_task_fn fn, void *ctx)
+{
+    if (!fn || ntasks == 0) return;
+
+    if (nthreads > ntasks) nthreads = (unsigned)ntasks;
+    if (nthreads <= 1)
+    {
+        for (size_t i = 0; i < ntasks; ++i) fn(i, 0, ctx);
+        return;
+    }
+
+    Task_range  *ranges  = (Task_range*) malloc(sizeof(Task_range) * nthreads);
+    pthread_t   *threads = (pthread_t*) malloc(sizeof(pthread_t) * nthreads);
+    Pool_worker *workers = (Pool_worker*) malloc(sizeof(Pool_worker) * nthreads);
+    if (!ranges || !threads || !workers)
+    {
+        free(ranges);
+        free(threads);
+        free(workers);
+        for (size_t i = 0; i < ntasks; ++i) fn(i, 0, ctx);
+        return;
+    }
+
+    // start from an even split, stealing evens out the rest
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        pthread_mutex_init(&ranges[i].lock, NULL);
+        ranges[i].lo = ntasks * i / nthreads;
+        ranges[i].hi = ntasks * (i + 1) / nthreads;
+    }
+
+    Pool pool = { ranges, nthreads, fn, ctx };
+
+    // if we can't get threads, the caller steals every range alone
+    unsigned started = 0;
+    for (unsigned i = 1; i < nthreads; ++i)
+    {
+        workers[i].pool = &pool;
+        workers[i].id   = i;
+        if (pthread_create(&threads[i], NULL, pool_worker, &workers[i]) != 0) break;
+        started = i;
+    }
+
+    Pool_worker self = { &pool, 0 };
+    pool_worker(&self);
+
+    for (unsigned i = 1; i <= started; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (unsigned i = 0; i < nthreads; ++i)
+        pthread_mutex_destroy(&ranges[i].lock);
+    free(ranges);
+    free(threads);
+    free(workers);
+}
@@ -0,0 +1,334 @@
+#include <stdlib.h>
+#include <string.h>
+#include "timeline.h"
+
+// ---------------------------------------------------
+
+static int tick_before(const MIDI_timeline *tl, uint16_t a, uint16_t b)
+{
+    if (tl->ticks[a] != tl->ticks[b]) return tl->ticks[a] < tl->ticks[b];
+    return a < b;
+}
+
+static void sift_down(MIDI_timeline *tl, uint16_t i)
+{
+    uint16_t *heap = tl->heap;
+    for (;;)
+    {
+        uint32_t l = 2u * i + 1, r = l + 1, min = i;
+        if (l < tl->nheap && tick_before(tl, heap[l], heap[min])) min = l;
+        if (r < tl->nheap && tick_before(tl, heap[r], heap[min])) min = r;
+        if (min == i) return;
+
+        uint16_t tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = (uint16_t) min;
+    }
+}
+
+// ---------------------------------------------------
+
+// SMPTE files count ticks per frame and ignore tempo events, -29 is 29.97
+static uint64_t smpte_usec(const MThd *mthd, uint64_t tick)
+{
+    int fps = -mthd->timediv.frames_per_sec.smpte;
+    uint64_t tpf = mthd->timediv.frames_per_sec.ticks;
+    if (fps <= 0 || tpf == 0) return 0;
+
+    if (fps == 29) return tick * 100100 / (3 * tpf);
+    return tick * 1000000 / ((uint64_t) fps * tpf);
+}
+
+static uint64_t clock_usec(const MThd *mthd, const Timeline_clock *clk, uint64_t tick)
+{
+    if (mthd->division & 0x8000) return smpte_usec(mthd, tick);
+
+    uint64_t tpb = mthd->timediv.ticks_per_beat;
+    if (tpb == 0) return clk->usec;
+
+    // measured from the last tempo change so rounding never piles up
+    return clk->usec + (tick - clk->tick) * clk->tempo / tpb;
+}
+
+// microseconds per quarter note of a Set Tempo event, 0 for anything else
+static uint32_t event_tempo(const MTrk_event *event)
+{
+    if (event->kind != META || event->ev.meta_ev.type != 0x51 ||
+        event->ev.meta_ev.len < 3 || !event->ev.meta_ev.data)
+        return 0;
+
+    const uint8_t *d = (const uint8_t*) event->ev.meta_ev.data;
+    return (uint32_t) d[0] << 16 | (uint32_t) d[1] << 8 | d[2];
+}
+
+int MIDI_timeline_init(MIDI_timeline *tl, const MIDI_file *midi)
+{
+    if (!tl || !midi) return 0;
+    memset(tl, 0, sizeof(MIDI_timeline));
+
+    uint16_t ntracks = midi->mthd.ntracks;
+    size_t   nclocks = midi->mthd.fmt == 2 ? ntracks : 1;
+
+    tl->midi   = midi;
+    tl->next   = (size_t*) calloc(ntracks, sizeof(size_t));
+    tl->ticks  = (uint64_t*) calloc(ntracks, sizeof(uint64_t));
+    tl->heap   = (uint16_t*) malloc(sizeof(uint16_t) * ntracks);
+    tl->clocks = (Timeline_clock*) calloc(nclocks, sizeof(Timeline_clock));
+    if (!tl->next || !tl->ticks || !tl->heap || !tl->clocks)
+    {
+        MIDI_timeline_free(tl);
+        return 0;
+    }
+
+    for (size_t i = 0; i < nclocks; ++i)
+        tl->clocks[i].tempo = MIDI_DEFAULT_TEMPO;
+
+    for (uint16_t i = 0; i < ntracks; ++i)
+    {
+        if (midi->mtrk[i].count == 0) continue;
+        tl->ticks[i] = midi->mtrk[i].events[0].delta_time;
+        tl->heap[tl->nheap++] = i;
+    }
+    for (uint16_t i = tl->nheap / 2; i-- > 0; )
+        sift_down(tl, i);
+
+    return 1;
+}
+
+int MIDI_timeline_next(MIDI_timeline *tl, MIDI_timeline_event *out)
+{
+    if (!tl || !out || tl->nheap == 0) return 0;
+
+    uint16_t          track = tl->heap[0];
+    const MTrk       *mtrk  = &tl->midi->mtrk[track];
+    size_t            index = tl->next[track];
+    const MTrk_event *event = &mtrk->events[index];
+    Timeline_clock   *clk   = &tl->clocks[tl->midi->mthd.fmt == 2 ? track : 0];
+
+    out->track = track;
+    out->index = index;
+    out->tick  = tl->ticks[track];
+    out->usec  = clock_usec(&tl->midi->mthd, clk, out->tick);
+    out->event = event;
+
+    // a tempo change takes effect for everything after it, ties included
+    uint32_t tempo = event_tempo(event);
+    if (tempo > 0)
+    {
+        clk->tick  = out->tick;
+        clk->usec  = out->usec;
+        clk->tempo = tempo;
+    }
+
+    // advance the track in place, or drop it once it runs out
+    if (++tl->next[track] < mtrk->count)
+        tl->ticks[track] += mtrk->events[index + 1].delta_time;
+    else
+        tl->heap[0] = tl->heap[--tl->nheap];
+    sift_down(tl, 0);
+
+    return 1;
+}
+
+void MIDI_timeline_free(MIDI_timeline *tl)
+{
+    if (!tl) return;
+
+    free(tl->next);
+    free(tl->ticks);
+    free(tl->heap);
+    free(tl->clocks);
+    memset(tl, 0, sizeof(MIDI_timeline));
+}
+
+// ---------------------------------------------------
+
+typedef struct
+{
+    uint64_t tick;
+    uint32_t tempo;
+    uint16_t track;
+    size_t   index;
+} Tempo_change;
+
+// same order as the timeline, so the last of several changes on one tick wins
+static int compare_changes(const void *a, const void *b)
+{
+    const Tempo_change *x = (const Tempo_change*) a;
+    const Tempo_change *y = (const Tempo_change*) b;
+
+    if (x->tick  != y->tick)  return x->tick  < y->tick  ? -1 : 1;
+    if (x->track != y->track) return x->track < y->track ? -1 : 1;
+    if (x->index != y->index) return x->index < y->index ? -1 : 1;
+    return 0;
+}
+
+static size_t collect_changes(const MIDI_file *midi, uint16_t track, Tempo_change *changes)
+{
+    size_t n = 0;
+    for (uint16_t t = 0; t < midi->mthd.ntracks; ++t)
+    {
+        if (midi->mthd.fmt == 2 && t != track) continue;
+
+        const MTrk *mtrk = &midi->mtrk[t];
+        uint64_t tick = 0;
+        for (size_t i = 0; i < mtrk->count; ++i)
+        {
+            tick += mtrk->events[i].delta_time;
+            uint32_t tempo = event_tempo(&mtrk->events[i]);
+            if (tempo == 0) continue;
+
+            if (changes)
+            {
+                changes[n].tick  = tick;
+                changes[n].tempo = tempo;
+                changes[n].track = t;
+                changes[n].index = i;
+            }
+            ++n;
+        }
+    }
+    return n;
+}
+
+int MIDI_tempo_map_init(MIDI_tempo_map *map, const MIDI_file *midi, uint16_t track)
+{
+    if (!map || !midi) return 0;
+    memset(map, 0, sizeof(MIDI_tempo_map));
+    if (midi->mthd.fmt == 2 && track >= midi->mthd.ntracks) return 0;
+
+    map->mthd = &midi->mthd;
+
+    // SMPTE time doesn't depend on tempo, one segment is enough
+    size_t nchanges = (midi->mthd.division & 0x8000) ? 0 : collect_changes(midi, track, NULL);
+
+    Tempo_change *changes = NULL;
+    if (nchanges > 0)
+    {
+        changes = (Tempo_change*) malloc(sizeof(Tempo_change) * nchanges);
+        if (!changes) return 0;
+        collect_changes(midi, track, changes);
+        qsort(changes, nchanges, sizeof(Tempo_change), compare_changes);
+    }
+
+    map->segs = (Timeline_clock*) malloc(sizeof(Timeline_clock) * (nchanges + 1));
+    if (!map->segs)
+    {
+        free(changes);
+        return 0;
+    }
+
+    map->segs[0].tick  = 0;
+    map->segs[0].usec  = 0;
+    map->segs[0].tempo = MIDI_DEFAULT_TEMPO;
+    map->count = 1;
+
+    for (size_t i = 0; i < nchanges; ++i)
+    {
+        Timeline_clock *last = &map->segs[map->count - 1];
+        uint64_t usec = clock_usec(map->mthd, last, changes[i].tick);
+
+        // a change on the same tick replaces the segment instead of adding one
+        if (changes[i].tick != last->tick) last = &map->segs[map->count++];
+
+        last->tick  = changes[i].tick;
+        last->usec  = usec;
+        last->tempo = changes[i].tempo;
+    }
+
+    free(changes);
+    return 1;
+}
+
+void MIDI_tempo_map_free(MIDI_tempo_map *map)
+{
+    if (!map) return;
+
+    free(map->segs);
+    memset(map, 0, sizeof(MIDI_tempo_map));
+}
+
+// index of the last segment in [lo, count) starting at or before the key,
+// lo itself when none does
+static size_t find_by_tick(const MIDI_tempo_map *map, size_t lo, uint64_t tick)
+{
+    size_t hi = map->count;
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->segs[mid].tick <= tick) lo = mid;
+        else                             hi = mid;
+    }
+    return lo;
+}
+
+static size_t find_by_usec(const MIDI_tempo_map *map, size_t lo, uint64_t usec)
+{
+    size_t hi = map->count;
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->segs[mid].usec <= usec) lo = mid;
+        else                             hi = mid;
+    }
+    return lo;
+}
+
+static uint64_t seg_tick(const MIDI_tempo_map *map, const Timeline_clock *seg, uint64_t usec)
+{
+    const MThd *mthd = map->mthd;
+    if (mthd->division & 0x8000)
+    {
+        int fps = -mthd->timediv.frames_per_sec.smpte;
+        uint64_t tpf = mthd->timediv.frames_per_sec.ticks;
+        if (fps <= 0 || tpf == 0) return 0;
+
+        if (fps == 29) return usec * 3 * tpf / 100100;
+        return usec * (uint64_t) fps * tpf / 1000000;
+    }
+
+    uint64_t tpb = mthd->timediv.ticks_per_beat;
+    if (tpb == 0 || usec < seg->usec) return seg->tick;
+    return seg->tick + (usec - seg->usec) * tpb / seg->tempo;
+}
+
+uint64_t MIDI_tempo_map_usec(const MIDI_tempo_map *map, uint64_t tick)
+{
+    if (!map || map->count == 0) return 0;
+    return clock_usec(map->mthd, &map->segs[find_by_tick(map, 0, tick)], tick);
+}
+
+uint64_t MIDI_tempo_map_tick(const MIDI_tempo_map *map, uint64_t usec)
+{
+    if (!map || map->count == 0) return 0;
+    return seg_tick(map, &map->segs[find_by_usec(map, 0, usec)], usec);
+}
+
+void MIDI_tempo_map_usecs(const MIDI_tempo_map *map, const uint64_t *ticks,
+                          uint64_t *usecs, size_t n)
+{
+    if (!map || map->count == 0 || !ticks || !usecs) return;
+
+    size_t seg = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i > 0 && ticks[i] < ticks[i - 1]) seg = 0;
+        seg = find_by_tick(map, seg, ticks[i]);
+        usecs[i] = clock_usec(map->mthd, &map->segs[seg], ticks[i]);
+    }
+}
+
+void MIDI_tempo_map_ticks(const MIDI_tempo_map *map, const uint64_t *usecs,
+                          uint64_t *ticks, size_t n)
+{
+    if (!map || map->count == 0 || !usecs || !ticks) return;
+
+    size_t seg = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i > 0 && usecs[i] < usecs[i - 1]) seg = 0;
+        seg = find_by_usec(map, seg, usecs[i]);
+        ticks[i] = seg_tick(map, &map->segs[seg], usecs[i]);
+    }
+}
@@ -0,0 +1,143 @@
+#include <pthread.h>
+#include "vlq.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VLQ_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*Vlq_kernel)(const uint8_t*, size_t, uint32_t*, size_t, size_t*);
+
+// ---------------------------------------------------
+
+size_t MIDI_vlq_decode_many_scalar(const uint8_t *p, size_t len, uint32_t *out, size_t n,
+                                   size_t *used)
+{
+    size_t pos = 0, i = 0;
+    for (; i < n; ++i)
+    {
+        size_t k = MIDI_vlq_decode(p + pos, len - pos, &out[i]);
+        if (!k) break;
+        pos += k;
+    }
+    *used = pos;
+    return i;
+}
+
+#ifdef VLQ_X86
+
+// every clear top bit in ends marks the last byte of a quantity, so each
+// one is a SWAR decode with no per byte branch. returns the bytes used,
+// a quantity running past the block is left for the next load
+static inline size_t decode_block(const uint8_t *p, uint64_t ends, uint32_t *out,
+                                  size_t n, size_t *i, int *bad)
+{
+    size_t start = 0;
+    while (ends && *i < n)
+    {
+        size_t end = (size_t) __builtin_ctzll(ends);
+        if (end - start >= MIDI_VLQ_MAX_BYTES)
+        {
+            *bad = 1;
+            return start;
+        }
+        // the length is known already, so no branch on the first byte
+        const uint8_t *q = p + start;
+        uint32_t full = (uint32_t)(q[0] & 0x7F) << 21 | (uint32_t)(q[1] & 0x7F) << 14 |
+                        (uint32_t)(q[2] & 0x7F) << 7  | (uint32_t)(q[3] & 0x7F);
+        out[(*i)++] = full >> (7 * (MIDI_VLQ_MAX_BYTES - 1 - (end - start)));
+        start = end + 1;
+        ends &= ends - 1;
+    }
+
+    // five continuation bytes in a row can't be the start of anything valid
+    if (start == 0 && *i < n) *bad = 1;
+    return start;
+}
+
+// blocks only while a quantity starting anywhere in them can be read whole
+__attribute__((target("sse2")))
+static size_t decode_many_sse2(const uint8_t *p, size_t len, uint32_t *out, size_t n,
+                               size_t *used)
+{
+    size_t pos = 0, i = 0;
+    int bad = 0;
+    while (!bad && i < n && len - pos >= 16 + MIDI_VLQ_MAX_BYTES)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + pos));
+        uint64_t ends = ~(uint32_t) _mm_movemask_epi8(v) & 0xFFFFu;
+        pos += decode_block(p + pos, ends, out, n, &i, &bad);
+    }
+    if (bad)
+    {
+        *used = pos;
+        return i;
+    }
+
+    size_t tail;
+    i += MIDI_vlq_decode_many_scalar(p + pos, len - pos, out + i, n - i, &tail);
+    *used = pos + tail;
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_many_avx2(const uint8_t *p, size_t len, uint32_t *out, size_t n,
+                               size_t *used)
+{
+    size_t pos = 0, i = 0;
+    int bad = 0;
+    while (!bad && i < n && len - pos >= 32 + MIDI_VLQ_MAX_BYTES)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + pos));
+        uint64_t ends = (uint32_t) ~_mm256_movemask_epi8(v);
+        pos += decode_block(p + pos, ends, out, n, &i, &bad);
+    }
+    if (bad)
+    {
+        *used = pos;
+        return i;
+    }
+
+    size_t tail;
+    i += MIDI_vlq_decode_many_scalar(p + pos, len - pos, out + i, n - i, &tail);
+    *used = pos + tail;
+    return i;
+}
+
+#endif
+
+// ---------------------------------------------------
+
+static Vlq_kernel      vlq_kernel      = MIDI_vlq_decode_many_scalar;
+static const char     *vlq_kernel_name = "scalar";
+static pthread_once_t  vlq_once        = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void)
+{
+#ifdef VLQ_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        vlq_kernel      = decode_many_avx2;
+        vlq_kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        vlq_kernel      = decode_many_sse2;
+        vlq_kernel_name = "sse2";
+    }
+#endif
+}
+
+size_t MIDI_vlq_decode_many(const uint8_t *p, size_t len, uint32_t *out, size_t n,
+                            size_t *used)
+{
+    pthread_once(&vlq_once, pick_kernel);
+    return vlq_kernel(p, len, out, n, used);
+}
+
+const char *MIDI_vlq_kernel(void)
+{
+    pthread_once(&vlq_once, pick_kernel);
+    return vlq_kernel_name;
+}